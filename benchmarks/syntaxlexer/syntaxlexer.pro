@@ -0,0 +1,18 @@
+QT += testlib
+QT -= gui
+CONFIG += console testcase
+TARGET = tst_syntaxlexer
+
+INCLUDEPATH += ../..
+DEFINES += SOURCE_DIR=\\\"$$PWD/../..\\\"
+
+SOURCES += \
+        tst_syntaxlexer.cpp \
+        ../../contenthash.cpp \
+        ../../languagecache.cpp \
+        ../../syntaxlexer.cpp
+
+HEADERS += \
+    ../../contenthash.h \
+    ../../languagecache.h \
+    ../../syntaxlexer.h
@@ -0,0 +1,239 @@
+#include <QtTest>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include "languagecache.h"
+#include "syntaxlexer.h"
+
+// Checks and benchmarks for SyntaxLexer::lexLine().
+//
+// tokens() pins down the cases the regex highlighter got wrong: delimiters
+// of one kind inside a comment or string of another, several strings on a
+// line, and comments and strings carried from one line to the next.
+//
+// throughput() lexes the sources of this project the way
+// DocumentHighlighter does it, line by line, each line starting in the state
+// the previous one ended in, and fails below a minimum MB/s of UTF-16 text
+// per language. The minimums are several times below what a release build
+// reaches, so a loaded machine or a debug build still passes; falling below
+// them means the lexer lost its single linear pass. lexLines() runs the same
+// loop under QBENCHMARK for comparing changes.
+//
+//   qmake benchmarks/syntaxlexer && make && ./tst_syntaxlexer
+class SyntaxLexerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void tokens_data();
+    void tokens();
+    void throughput_data();
+    void throughput();
+    void lexLines_data();
+    void lexLines();
+
+private:
+    static bool loadLexer(const QString &language, SyntaxLexer &lexer);
+    static QStringList loadLines(const QStringList &nameFilters, qint64 &bytes);
+    static int stateAfter(const SyntaxLexer &lexer, const QString &text);
+    static QString describe(const QVector<SyntaxLexer::Token> &tokens);
+};
+
+bool SyntaxLexerTest::loadLexer(const QString &language, SyntaxLexer &lexer)
+{
+    // Straight from the definition, so no language cache is written
+    QFile file(QString(SOURCE_DIR) + "/languages/" + language + ".json");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    SyntaxLexer::Definition definition;
+    QString error;
+    if (!LanguageCache::parseDefinition(file.readAll(), definition, error)) {
+        return false;
+    }
+    lexer = SyntaxLexer(definition);
+    return true;
+}
+
+QStringList SyntaxLexerTest::loadLines(const QStringList &nameFilters, qint64 &bytes)
+{
+    QStringList lines;
+    bytes = 0;
+
+    const QDir directory(SOURCE_DIR);
+    const QStringList names = directory.entryList(nameFilters, QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        QFile file(directory.filePath(name));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        const QStringList fileLines = QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'));
+        for (const QString &line : fileLines) {
+            bytes += line.length() * qint64(sizeof(QChar));
+        }
+        lines += fileLines;
+    }
+    return lines;
+}
+
+// State the lines of text end in, 0 for no text
+int SyntaxLexerTest::stateAfter(const SyntaxLexer &lexer, const QString &text)
+{
+    int state = 0;
+    if (text.isEmpty()) {
+        return state;
+    }
+
+    QVector<SyntaxLexer::Token> tokens;
+    const QStringList lines = text.split(QLatin1Char('\n'));
+    for (const QString &line : lines) {
+        tokens.clear();
+        state = lexer.lexLine(line.constData(), line.length(), state, tokens);
+    }
+    return state;
+}
+
+// Tokens as "Type start length", comma separated
+QString SyntaxLexerTest::describe(const QVector<SyntaxLexer::Token> &tokens)
+{
+    static const char *const names[] = { "Keyword", "Type",    "Function",    "Number",
+                                         "String",  "Comment", "Preprocessor" };
+    QStringList parts;
+    for (const SyntaxLexer::Token &token : tokens) {
+        parts.append(QString("%1 %2 %3").arg(names[token.type]).arg(token.start).arg(token.length));
+    }
+    return parts.join(", ");
+}
+
+void SyntaxLexerTest::tokens_data()
+{
+    // previous is lexed first and gives the state the line starts in;
+    // the line has to end in the state endsIn ends in
+    QTest::addColumn<QString>("language");
+    QTest::addColumn<QString>("previous");
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<QString>("expected");
+    QTest::addColumn<QString>("endsIn");
+
+    QTest::newRow("line comment in string")
+        << "cpp" << "" << "s = \"http://x\";" << "String 4 10" << "";
+    QTest::newRow("quotes in line comment")
+        << "cpp" << "" << "x; // it's \"quoted\"" << "Comment 3 16" << "";
+    QTest::newRow("quote in block comment")
+        << "cpp" << "" << "/* don't */ int a;" << "Comment 0 11, Keyword 12 3" << "";
+    QTest::newRow("two strings on a line")
+        << "cpp" << "" << "f(\"a\", \"b\");" << "Function 0 1, String 2 3, String 7 3" << "";
+    QTest::newRow("escaped quote")
+        << "cpp" << "" << "\"a\\\"b\" + 1" << "String 0 6, Number 9 1" << "";
+    QTest::newRow("unterminated string ends with its line")
+        << "cpp" << "" << "\"open" << "String 0 5" << "";
+    QTest::newRow("block comment opens")
+        << "cpp" << "" << "int a; /* open" << "Keyword 0 3, Comment 7 7" << "/*";
+    QTest::newRow("block comment continues")
+        << "cpp" << "/* open" << "still \"in\" it" << "Comment 0 13" << "/*";
+    QTest::newRow("block comment closes")
+        << "cpp" << "/* open" << "done */ int b;" << "Comment 0 7, Keyword 8 3" << "";
+    QTest::newRow("python multi-line string")
+        << "py" << "x = \"\"\"start" << "it's # not a comment" << "String 0 20" << "\"\"\"";
+    QTest::newRow("js template string closes")
+        << "js" << "`a" << "b` // c" << "String 0 2, Comment 3 4" << "";
+}
+
+void SyntaxLexerTest::tokens()
+{
+    QFETCH(QString, language);
+    QFETCH(QString, previous);
+    QFETCH(QString, line);
+    QFETCH(QString, expected);
+    QFETCH(QString, endsIn);
+
+    SyntaxLexer lexer;
+    QVERIFY(loadLexer(language, lexer));
+
+    QVector<SyntaxLexer::Token> tokens;
+    const int state = lexer.lexLine(line.constData(), line.length(), stateAfter(lexer, previous), tokens);
+    QCOMPARE(describe(tokens), expected);
+    QCOMPARE(state, stateAfter(lexer, endsIn));
+}
+
+void SyntaxLexerTest::throughput_data()
+{
+    QTest::addColumn<QString>("language");
+    QTest::addColumn<QStringList>("nameFilters");
+    QTest::addColumn<double>("minimumMBps");
+
+    QTest::newRow("cpp") << "cpp" << (QStringList() << "*.cpp" << "*.h") << 40.0;
+    QTest::newRow("qml") << "qml" << (QStringList() << "*.qml") << 40.0;
+}
+
+void SyntaxLexerTest::throughput()
+{
+    QFETCH(QString, language);
+    QFETCH(QStringList, nameFilters);
+    QFETCH(double, minimumMBps);
+
+    SyntaxLexer lexer;
+    QVERIFY(loadLexer(language, lexer));
+
+    qint64 bytes;
+    const QStringList lines = loadLines(nameFilters, bytes);
+    QVERIFY(bytes > 0);
+
+    // Whole passes until enough time went by for the timer to be accurate
+    QVector<SyntaxLexer::Token> tokens;
+    qint64 lexed = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        int state = 0;
+        for (const QString &line : lines) {
+            tokens.clear();
+            state = lexer.lexLine(line.constData(), line.length(), state, tokens);
+        }
+        lexed += bytes;
+    } while (timer.elapsed() < 200);
+
+    const double mbps = lexed / 1e6 / (timer.nsecsElapsed() / 1e9);
+    qInfo("%s: %.1f MB/s of UTF-16, minimum %.1f", qPrintable(language), mbps, minimumMBps);
+    QVERIFY2(mbps >= minimumMBps, qPrintable(QString("%1 MB/s").arg(mbps, 0, 'f', 1)));
+}
+
+void SyntaxLexerTest::lexLines_data()
+{
+    QTest::addColumn<QString>("language");
+    QTest::addColumn<QStringList>("nameFilters");
+
+    QTest::newRow("cpp") << "cpp" << (QStringList() << "*.cpp" << "*.h");
+    QTest::newRow("qml") << "qml" << (QStringList() << "*.qml");
+}
+
+void SyntaxLexerTest::lexLines()
+{
+    QFETCH(QString, language);
+    QFETCH(QStringList, nameFilters);
+
+    SyntaxLexer lexer;
+    QVERIFY(loadLexer(language, lexer));
+
+    qint64 bytes;
+    const QStringList lines = loadLines(nameFilters, bytes);
+    QVERIFY(!lines.isEmpty());
+    qInfo("%s: %d lines, %.2f MB of UTF-16", qPrintable(language), int(lines.size()), bytes / 1e6);
+
+    QVector<SyntaxLexer::Token> tokens;
+    qint64 tokenCount = 0;
+    QBENCHMARK {
+        int state = 0;
+        for (const QString &line : lines) {
+            tokens.clear();
+            state = lexer.lexLine(line.constData(), line.length(), state, tokens);
+            tokenCount += tokens.size();
+        }
+    }
+    QVERIFY(tokenCount > 0);
+}
+
+QTEST_APPLESS_MAIN(SyntaxLexerTest)
+
+#include "tst_syntaxlexer.moc"
@@ -0,0 +1,142 @@
+#include "contenthash.h"
+#include <QChar>
+#include <QtEndian>
+#include <cstring>
+
+static const quint64 Prime1 = Q_UINT64_C(0x9E3779B185EBCA87);
+static const quint64 Prime2 = Q_UINT64_C(0xC2B2AE3D27D4EB4F);
+static const quint64 Prime3 = Q_UINT64_C(0x165667B19E3779F9);
+static const quint64 Prime4 = Q_UINT64_C(0x85EBCA77C2B2AE63);
+static const quint64 Prime5 = Q_UINT64_C(0x27D4EB2F165667C5);
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 read64(const unsigned char *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+static inline quint64 read32(const unsigned char *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+static inline quint64 accumulate(quint64 accumulator, quint64 input)
+{
+    accumulator += input * Prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 hash, quint64 accumulator)
+{
+    hash ^= accumulate(0, accumulator);
+    return hash * Prime1 + Prime4;
+}
+
+ContentHash::ContentHash(quint64 seed)
+    : m_seed(seed)
+{
+    reset();
+}
+
+void ContentHash::reset()
+{
+    m_accumulators[0] = m_seed + Prime1 + Prime2;
+    m_accumulators[1] = m_seed + Prime2;
+    m_accumulators[2] = m_seed;
+    m_accumulators[3] = m_seed - Prime1;
+    m_totalLength = 0;
+    m_pendingLength = 0;
+}
+
+void ContentHash::addData(const char *data, qint64 length)
+{
+    if (length <= 0) {
+        return;
+    }
+
+    const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = input + length;
+    m_totalLength += quint64(length);
+
+    // Not enough for a stripe yet, keep it for the next call
+    if (m_pendingLength + length < StripeSize) {
+        std::memcpy(m_pending + m_pendingLength, input, size_t(length));
+        m_pendingLength += int(length);
+        return;
+    }
+
+    // Complete the pending stripe first
+    if (m_pendingLength > 0) {
+        const int fill = StripeSize - m_pendingLength;
+        std::memcpy(m_pending + m_pendingLength, input, size_t(fill));
+        for (int lane = 0; lane < 4; ++lane) {
+            m_accumulators[lane] = accumulate(m_accumulators[lane], read64(m_pending + lane * 8));
+        }
+        input += fill;
+        m_pendingLength = 0;
+    }
+
+    // Whole stripes straight from the input
+    while (end - input >= StripeSize) {
+        for (int lane = 0; lane < 4; ++lane) {
+            m_accumulators[lane] = accumulate(m_accumulators[lane], read64(input + lane * 8));
+        }
+        input += StripeSize;
+    }
+
+    m_pendingLength = int(end - input);
+    std::memcpy(m_pending, input, size_t(m_pendingLength));
+}
+
+void ContentHash::addData(const QChar *data, int length)
+{
+    addData(reinterpret_cast<const char *>(data), qint64(length) * qint64(sizeof(QChar)));
+}
+
+quint64 ContentHash::result() const
+{
+    quint64 hash;
+    if (m_totalLength >= quint64(StripeSize)) {
+        hash = rotateLeft(m_accumulators[0], 1) + rotateLeft(m_accumulators[1], 7)
+             + rotateLeft(m_accumulators[2], 12) + rotateLeft(m_accumulators[3], 18);
+        for (int lane = 0; lane < 4; ++lane) {
+            hash = mergeRound(hash, m_accumulators[lane]);
+        }
+    } else {
+        hash = m_seed + Prime5;
+    }
+
+    hash += m_totalLength;
+
+    // Tail that did not make up a whole stripe
+    const unsigned char *input = m_pending;
+    const unsigned char *end = m_pending + m_pendingLength;
+    while (end - input >= 8) {
+        hash ^= accumulate(0, read64(input));
+        hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+        input += 8;
+    }
+    if (end - input >= 4) {
+        hash ^= read32(input) * Prime1;
+        hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+        input += 4;
+    }
+    while (input < end) {
+        hash ^= quint64(*input) * Prime5;
+        hash = rotateLeft(hash, 11) * Prime1;
+        ++input;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,34 @@
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <QtGlobal>
+
+class QChar;
+
+// Streaming 64-bit content hash (XXH64).
+//
+// Used to tell whether a buffer still matches what is on disk without
+// keeping a copy of the saved text. Data can be fed in any number of pieces,
+// the result only depends on the concatenated bytes.
+class ContentHash
+{
+public:
+    explicit ContentHash(quint64 seed = 0);
+
+    void reset();
+    void addData(const char *data, qint64 length);
+    void addData(const QChar *data, int length);
+    quint64 result() const;
+
+private:
+    static const int StripeSize = 32;
+
+    quint64 m_seed;
+    quint64 m_accumulators[4];
+    quint64 m_totalLength;
+    // Bytes that did not fill a whole stripe yet
+    unsigned char m_pending[StripeSize];
+    int m_pendingLength;
+};
+
+#endif // CONTENTHASH_H
@@ -0,0 +1,535 @@
+#include "documenthighlighter.h"
+#include <QAtomicInt>
+#include <QColor>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+// Lines lexed between two batches posted to the GUI thread
+static const int BatchLines = 2000;
+
+struct HighlightJob
+{
+    int generation;
+    QSharedPointer<const SyntaxLexer> lexer;
+    PieceTable::Snapshot snapshot;
+
+    // Lines in view, lexed first from the state of the line above them;
+    // aheadFirst is -1 when the pass starts close enough to them
+    int aheadFirst;
+    int aheadLast;
+    int aheadOffset;
+    int aheadState;
+
+    // The pass, from the first line out of date and the state it starts in
+    int firstLine;
+    int offset;
+    int state;
+    // End states before the pass; lines before dirtyEnd are lexed again
+    // even when their incoming state did not change
+    QVector<int> states;
+    int dirtyEnd;
+};
+
+struct HighlightBatch
+{
+    int generation;
+    int firstLine;
+    QVector<int> states;
+    QVector<QVector<SyntaxLexer::Token>> tokens;
+    // Lexed ahead of the pass, only the tokens are kept
+    bool provisional;
+    // Every line after the batch is up to date
+    bool finished;
+};
+
+// Lexes the snapshot of a job on a worker thread; a new job replaces one
+// that was not started, and a pass is dropped between lines as soon as its
+// generation is not the latest
+class HighlightWorker : public QThread
+{
+public:
+    explicit HighlightWorker(DocumentHighlighter *highlighter)
+        : m_highlighter(highlighter)
+        , m_hasJob(false)
+        , m_stopping(false)
+    {
+    }
+
+    ~HighlightWorker()
+    {
+        // Never destroy a running thread
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+            m_generation.fetchAndAddRelaxed(1);
+            m_condition.wakeAll();
+        }
+        wait();
+    }
+
+    void highlight(const HighlightJob &job)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_generation.storeRelaxed(job.generation);
+        m_job = job;
+        m_hasJob = true;
+        m_condition.wakeOne();
+    }
+
+    void cancel(int generation)
+    {
+        m_generation.storeRelaxed(generation);
+    }
+
+protected:
+    void run() override
+    {
+        QMutexLocker locker(&m_mutex);
+        while (true) {
+            while (!m_hasJob && !m_stopping) {
+                m_condition.wait(&m_mutex);
+            }
+            if (m_stopping) {
+                break;
+            }
+
+            const HighlightJob job = m_job;
+            m_job = HighlightJob();
+            m_hasJob = false;
+
+            locker.unlock();
+            lex(job);
+            locker.relock();
+        }
+    }
+
+private:
+    bool isCurrent(const HighlightJob &job) const
+    {
+        return m_generation.loadRelaxed() == job.generation;
+    }
+
+    // Calls fn(const QChar *text, int length) for every line from offset,
+    // which starts a line, until it returns false
+    template<typename Fn>
+    static void forEachLine(const PieceTable::Snapshot &snapshot, int offset, Fn fn)
+    {
+        // Lines spanning pieces are gathered in pending
+        QString pending;
+        int position = 0;
+        bool stopped = false;
+        snapshot.forEachChunk([&](const QChar *data, int length) {
+            const int begin = qMax(0, offset - position);
+            position += length;
+            if (stopped || begin >= length) {
+                return;
+            }
+
+            const QChar *end = data + length;
+            const QChar *lineStart = data + begin;
+            for (const QChar *c = lineStart; c != end; ++c) {
+                if (*c != QLatin1Char('\n')) {
+                    continue;
+                }
+                if (pending.isEmpty()) {
+                    stopped = !fn(lineStart, int(c - lineStart));
+                } else {
+                    pending.append(lineStart, int(c - lineStart));
+                    stopped = !fn(pending.constData(), pending.length());
+                    pending.clear();
+                }
+                if (stopped) {
+                    return;
+                }
+                lineStart = c + 1;
+            }
+            pending.append(lineStart, int(end - lineStart));
+        });
+
+        // The last line has no line break
+        if (!stopped) {
+            fn(pending.constData(), pending.length());
+        }
+    }
+
+    void post(const HighlightBatch &batch)
+    {
+        DocumentHighlighter *target = m_highlighter;
+        QMetaObject::invokeMethod(m_highlighter, [target, batch]() {
+            target->applyBatch(batch);
+        }, Qt::QueuedConnection);
+    }
+
+    static HighlightBatch startBatch(const HighlightJob &job, int firstLine, bool provisional)
+    {
+        HighlightBatch batch;
+        batch.generation = job.generation;
+        batch.firstLine = firstLine;
+        batch.provisional = provisional;
+        batch.finished = false;
+        return batch;
+    }
+
+    void lex(const HighlightJob &job)
+    {
+        if (!isCurrent(job)) {
+            return;
+        }
+        const SyntaxLexer &lexer = *job.lexer;
+
+        if (job.aheadFirst >= 0) {
+            HighlightBatch batch = startBatch(job, job.aheadFirst, true);
+            int line = job.aheadFirst;
+            int state = job.aheadState;
+            forEachLine(job.snapshot, job.aheadOffset, [&](const QChar *text, int length) {
+                batch.tokens.append(QVector<SyntaxLexer::Token>());
+                state = lexer.lexLine(text, length, state, batch.tokens.last());
+                return ++line <= job.aheadLast;
+            });
+            if (!isCurrent(job)) {
+                return;
+            }
+            post(batch);
+        }
+
+        HighlightBatch batch = startBatch(job, job.firstLine, false);
+        int line = job.firstLine;
+        int state = job.state;
+        bool cancelled = false;
+        forEachLine(job.snapshot, job.offset, [&](const QChar *text, int length) {
+            batch.tokens.append(QVector<SyntaxLexer::Token>());
+            state = lexer.lexLine(text, length, state, batch.tokens.last());
+            batch.states.append(state);
+
+            // A line ending in the same state as before leaves the lines
+            // after it as they were
+            if (line + 1 >= job.dirtyEnd && line < job.states.size() && state == job.states.at(line)) {
+                return false;
+            }
+            ++line;
+
+            if (batch.states.size() == BatchLines) {
+                if (!isCurrent(job)) {
+                    cancelled = true;
+                    return false;
+                }
+                post(batch);
+                batch = startBatch(job, line, false);
+            }
+            return true;
+        });
+
+        if (cancelled || !isCurrent(job)) {
+            return;
+        }
+        batch.finished = true;
+        post(batch);
+    }
+
+    DocumentHighlighter *m_highlighter;
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    HighlightJob m_job;
+    bool m_hasJob;
+    bool m_stopping;
+    // Generation of the latest job; a pass of another one stops
+    QAtomicInt m_generation;
+};
+
+DocumentHighlighter::DocumentHighlighter(const PieceTable *buffer, QObject *parent)
+    : QObject(parent)
+    , m_buffer(buffer)
+    , m_lexer(SyntaxLexer::forLanguage("generic"))
+    , m_firstDirty(Clean)
+    , m_dirtyEnd(0)
+    , m_viewportFirst(0)
+    , m_viewportLast(-1)
+    , m_aheadFirst(0)
+    , m_aheadLast(-1)
+    , m_generation(0)
+    , m_worker(new HighlightWorker(this))
+{
+    m_startTimer.setSingleShot(true);
+    m_startTimer.setInterval(0);
+    connect(&m_startTimer, &QTimer::timeout, this, &DocumentHighlighter::startPass);
+
+    m_worker->start(QThread::LowPriority);
+    reset();
+}
+
+DocumentHighlighter::~DocumentHighlighter()
+{
+    delete m_worker;
+}
+
+void DocumentHighlighter::setLanguage(const QString &fileExtension)
+{
+    const QSharedPointer<const SyntaxLexer> lexer =
+        SyntaxLexer::forLanguage(SyntaxLexer::languageForExtension(fileExtension));
+    if (lexer == m_lexer) {
+        return;
+    }
+    m_lexer = lexer;
+    reset();
+}
+
+void DocumentHighlighter::reset()
+{
+    cancelPass();
+
+    const int count = m_buffer->lineCount();
+    m_states.fill(-1, count);
+    m_tokens = QVector<QVector<SyntaxLexer::Token>>(count);
+    m_aheadFirst = 0;
+    m_aheadLast = -1;
+    // No line is known, so no line can end the pass early
+    m_firstDirty = 0;
+    m_dirtyEnd = count;
+    schedule();
+
+    emit highlightingChanged(0, count - 1);
+}
+
+void DocumentHighlighter::applyEdit(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    // Lines [first, first + removedLines] were replaced by [first, lastNew]
+    const int count = m_buffer->lineCount();
+    const int first = m_buffer->lineAt(position);
+    const int lastNew = m_buffer->lineAt(position + charsAdded);
+    const int addedLines = lastNew - first;
+    const int delta = count - m_states.size();
+    const int removedLines = addedLines - delta;
+    if (removedLines < 0 || first + removedLines >= m_states.size()) {
+        reset();
+        return;
+    }
+
+    cancelPass();
+
+    // The last new line takes the end state of the last line replaced, so
+    // a pass can tell whether the lines after it are affected
+    const int oldEnd = m_states.at(first + removedLines);
+    m_states.remove(first, removedLines + 1);
+    m_states.insert(first, addedLines + 1, -1);
+    m_states[lastNew] = oldEnd;
+    m_tokens.remove(first, removedLines + 1);
+    m_tokens.insert(first, addedLines + 1, QVector<SyntaxLexer::Token>());
+
+    if (m_firstDirty != Clean && m_firstDirty > first) {
+        m_firstDirty = qMax(first, m_firstDirty + delta);
+    }
+    if (m_dirtyEnd > first) {
+        m_dirtyEnd = qMax(first + 1, m_dirtyEnd + delta);
+    }
+    if (m_aheadLast >= first) {
+        if (m_aheadFirst > first) {
+            m_aheadFirst = qMax(first, m_aheadFirst + delta);
+        }
+        m_aheadLast = qMax(first, m_aheadLast + delta);
+    }
+
+    const int incoming = first > 0 ? m_states.at(first - 1) : 0;
+    if (addedLines < SynchronousLines && incoming >= 0) {
+        // Small edits are lexed right away; the views repaint these lines
+        // for the edit itself, the worker only has to follow up when the
+        // state carried into the next line changed
+        const int state = lexLines(first, lastNew, incoming);
+        // The next line has to be lexed again even when a pass further up
+        // settles before reaching it
+        if (state != oldEnd && lastNew + 1 < count) {
+            m_firstDirty = qMin(m_firstDirty, lastNew + 1);
+            m_dirtyEnd = qMax(m_dirtyEnd, lastNew + 2);
+        }
+    } else {
+        m_firstDirty = qMin(m_firstDirty, first);
+        m_dirtyEnd = qMax(m_dirtyEnd, lastNew + 1);
+    }
+
+    if (m_firstDirty != Clean) {
+        schedule();
+    }
+}
+
+void DocumentHighlighter::setViewport(int firstLine, int lastLine)
+{
+    if (firstLine == m_viewportFirst && lastLine == m_viewportLast) {
+        return;
+    }
+    m_viewportFirst = firstLine;
+    m_viewportLast = lastLine;
+
+    // A pass far above the view starts over to lex the view first, unless
+    // it already did
+    if (m_firstDirty == Clean || firstLine <= m_firstDirty + ViewportLead) {
+        return;
+    }
+    if (firstLine >= m_aheadFirst && lastLine <= m_aheadLast) {
+        return;
+    }
+    schedule();
+}
+
+QVector<QTextLayout::FormatRange> DocumentHighlighter::lineFormats(int line) const
+{
+    QVector<QTextLayout::FormatRange> formats;
+    if (line < 0 || line >= m_tokens.size()) {
+        return formats;
+    }
+
+    const QVector<SyntaxLexer::Token> &tokens = m_tokens.at(line);
+    formats.reserve(tokens.size());
+    for (const SyntaxLexer::Token &token : tokens) {
+        QTextLayout::FormatRange range;
+        range.start = token.start;
+        range.length = token.length;
+        range.format = formatFor(token.type);
+        formats.append(range);
+    }
+    return formats;
+}
+
+const QTextCharFormat &DocumentHighlighter::formatFor(SyntaxLexer::TokenType type)
+{
+    // Different formatting styles, by token type
+    static const QVector<QTextCharFormat> formats = []() {
+        QVector<QTextCharFormat> formats(SyntaxLexer::TokenTypeCount);
+
+        // Keywords format (orange-brown)
+        formats[SyntaxLexer::Keyword].setForeground(QColor("#CC7832"));
+        formats[SyntaxLexer::Keyword].setFontWeight(QFont::Bold);
+
+        // Class name format (light blue)
+        formats[SyntaxLexer::Type].setForeground(QColor("#A9B7C6"));
+        formats[SyntaxLexer::Type].setFontWeight(QFont::Bold);
+
+        // Function format (light orange)
+        formats[SyntaxLexer::Function].setForeground(QColor("#FFC66D"));
+
+        // Number format (blue)
+        formats[SyntaxLexer::Number].setForeground(QColor("#6897BB"));
+
+        // String format (green)
+        formats[SyntaxLexer::String].setForeground(QColor("#6A8759"));
+
+        // Comment format (grey)
+        formats[SyntaxLexer::Comment].setForeground(QColor("#808080"));
+        formats[SyntaxLexer::Comment].setFontItalic(true);
+
+        // Preprocessor format (yellow)
+        formats[SyntaxLexer::Preprocessor].setForeground(QColor("#BBB529"));
+
+        return formats;
+    }();
+
+    return formats.at(qBound(0, int(type), int(SyntaxLexer::Preprocessor)));
+}
+
+void DocumentHighlighter::schedule()
+{
+    // Edits in a row start a single pass
+    if (!m_startTimer.isActive()) {
+        m_startTimer.start();
+    }
+}
+
+void DocumentHighlighter::startPass()
+{
+    if (m_firstDirty == Clean) {
+        return;
+    }
+    cancelPass();
+
+    const int count = m_states.size();
+    HighlightJob job;
+    job.generation = m_generation;
+    job.lexer = m_lexer;
+    job.snapshot = m_buffer->snapshot();
+
+    job.aheadFirst = -1;
+    if (m_viewportFirst > m_firstDirty + ViewportLead && m_viewportFirst < count) {
+        job.aheadFirst = m_viewportFirst;
+        job.aheadLast = qMin(m_viewportLast, count - 1);
+        job.aheadOffset = m_buffer->lineStart(job.aheadFirst);
+        job.aheadState = qMax(0, m_states.at(job.aheadFirst - 1));
+    }
+
+    job.firstLine = m_firstDirty;
+    job.offset = m_buffer->lineStart(m_firstDirty);
+    job.state = m_firstDirty > 0 ? qMax(0, m_states.at(m_firstDirty - 1)) : 0;
+    job.states = m_states;
+    job.dirtyEnd = m_dirtyEnd;
+
+    m_worker->highlight(job);
+}
+
+void DocumentHighlighter::cancelPass()
+{
+    ++m_generation;
+    m_worker->cancel(m_generation);
+}
+
+void DocumentHighlighter::applyBatch(const HighlightBatch &batch)
+{
+    // Batches of a pass that was cancelled are of another text
+    if (batch.generation != m_generation) {
+        return;
+    }
+
+    const int count = batch.tokens.size();
+    const int lastLine = batch.firstLine + count - 1;
+    for (int i = 0; i < count; ++i) {
+        m_tokens[batch.firstLine + i] = batch.tokens.at(i);
+    }
+
+    if (batch.provisional) {
+        if (m_aheadFirst > m_aheadLast) {
+            m_aheadFirst = batch.firstLine;
+            m_aheadLast = lastLine;
+        } else {
+            m_aheadFirst = qMin(m_aheadFirst, batch.firstLine);
+            m_aheadLast = qMax(m_aheadLast, lastLine);
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            m_states[batch.firstLine + i] = batch.states.at(i);
+        }
+        m_firstDirty = lastLine + 1;
+        if (batch.finished || m_firstDirty == m_states.size()) {
+            m_firstDirty = Clean;
+            m_dirtyEnd = 0;
+        }
+    }
+
+    if (count > 0) {
+        emit highlightingChanged(batch.firstLine, lastLine);
+    }
+
+    // Every state is right now, which the lines lexed ahead past the end of
+    // the pass may not have started from
+    if (m_firstDirty == Clean && m_aheadFirst <= m_aheadLast) {
+        const int first = qMax(m_aheadFirst, lastLine + 1);
+        const int last = qMin(m_aheadLast, m_states.size() - 1);
+        m_aheadFirst = 0;
+        m_aheadLast = -1;
+        if (first <= last) {
+            lexLines(first, last, first > 0 ? m_states.at(first - 1) : 0);
+            emit highlightingChanged(first, last);
+        }
+    }
+}
+
+int DocumentHighlighter::lexLines(int firstLine, int lastLine, int state)
+{
+    for (int line = firstLine; line <= lastLine; ++line) {
+        const QString text = m_buffer->line(line);
+        QVector<SyntaxLexer::Token> &tokens = m_tokens[line];
+        tokens.clear();
+        state = m_lexer->lexLine(text.constData(), text.length(), state, tokens);
+        m_states[line] = state;
+    }
+    return state;
+}
@@ -0,0 +1,97 @@
+#ifndef DOCUMENTHIGHLIGHTER_H
+#define DOCUMENTHIGHLIGHTER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QTextLayout>
+#include <QTimer>
+#include <QVector>
+#include "piecetable.h"
+#include "syntaxlexer.h"
+
+class HighlightWorker;
+struct HighlightBatch;
+
+// Syntax highlighting of a buffer, computed on a worker thread.
+//
+// The tokens and end state of every line are kept here, on the GUI thread.
+// Lexing runs over a snapshot of the buffer; the worker posts its results
+// back in batches of lines, and highlightingChanged() tells the views which
+// lines to repaint. A pass starts at the first line that is out of date and
+// stops as soon as a line ends in the same state as before, since the lines
+// after it cannot have changed.
+//
+// The lines in view come first. When a pass has to start far above them,
+// they are lexed beforehand from the nearest known state and shown until
+// the pass reaches them. The lines of a small edit are lexed on the spot,
+// so typing never waits for the worker, which only takes over when the
+// edit changed the state carried into the next line.
+class DocumentHighlighter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DocumentHighlighter(const PieceTable *buffer, QObject *parent = nullptr);
+    ~DocumentHighlighter();
+
+    void setLanguage(const QString &fileExtension);
+
+    // The buffer was replaced as a whole
+    void reset();
+    // The buffer changed, called right after the change
+    void applyEdit(int position, int charsRemoved, int charsAdded);
+
+    // Lines an editor shows, highlighted first
+    void setViewport(int firstLine, int lastLine);
+
+    QVector<QTextLayout::FormatRange> lineFormats(int line) const;
+
+    // Format a token is drawn with
+    static const QTextCharFormat &formatFor(SyntaxLexer::TokenType type);
+
+signals:
+    void highlightingChanged(int firstLine, int lastLine);
+
+private:
+    friend class HighlightWorker;
+
+    // Lines above the view a pass may start at before the view is lexed
+    // on its own first
+    static const int ViewportLead = 1000;
+    // Edits of up to this many lines are lexed on the GUI thread
+    static const int SynchronousLines = 64;
+    // No line is out of date
+    static const int Clean = 0x7fffffff;
+
+    void schedule();
+    void startPass();
+    void cancelPass();
+    void applyBatch(const HighlightBatch &batch);
+    // Lexes lines on the calling thread, returns the state the last ends in
+    int lexLines(int firstLine, int lastLine, int state);
+
+    const PieceTable *m_buffer;
+    QSharedPointer<const SyntaxLexer> m_lexer;
+
+    // End state of every line, -1 while unknown, and its tokens
+    QVector<int> m_states;
+    QVector<QVector<SyntaxLexer::Token>> m_tokens;
+    // Lines from m_firstDirty on may be out of date; those before
+    // m_dirtyEnd have to be lexed again whatever the state they start in
+    int m_firstDirty;
+    int m_dirtyEnd;
+
+    int m_viewportFirst;
+    int m_viewportLast;
+    // Lines lexed ahead of the pass from a state that may be wrong; those
+    // a pass settles before are lexed again once it is done
+    int m_aheadFirst;
+    int m_aheadLast;
+
+    // Bumped whenever the running pass is out of date
+    int m_generation;
+    QTimer m_startTimer;
+    HighlightWorker *m_worker;
+};
+
+#endif // DOCUMENTHIGHLIGHTER_H
@@ -0,0 +1,149 @@
+#include "documentloader.h"
+#include <QFile>
+#include <QByteArray>
+
+DocumentLoader::DocumentLoader(const QString &filePath, QObject *parent)
+    : QThread(parent)
+    , m_filePath(filePath)
+    , m_cancelled(0)
+    , m_lossy(false)
+    , m_bytesRead(0)
+{
+}
+
+DocumentLoader::~DocumentLoader()
+{
+    // Never destroy a running thread
+    cancel();
+    wait();
+}
+
+QString DocumentLoader::filePath() const
+{
+    return m_filePath;
+}
+
+void DocumentLoader::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+}
+
+TextFormat DocumentLoader::format() const
+{
+    return m_format;
+}
+
+bool DocumentLoader::isLossy() const
+{
+    return m_lossy;
+}
+
+qint64 DocumentLoader::bytesRead() const
+{
+    return m_bytesRead;
+}
+
+bool DocumentLoader::isCancelled() const
+{
+    return m_cancelled.loadRelaxed() != 0;
+}
+
+// Whether a later chunk can still prove the encoding wrong
+static bool isGuess(const TextDecoder &decoder)
+{
+    const TextFormat format = decoder.format();
+    return format.encoding == TextFormat::Utf8 && !format.hasBom;
+}
+
+// Invalid bytes in a file only guessed to be UTF-8
+static bool isWrongGuess(const TextDecoder &decoder)
+{
+    return decoder.isLossy() && isGuess(decoder);
+}
+
+void DocumentLoader::run()
+{
+    // Read in binary mode, the decoder takes care of line endings
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit loadFailed(file.errorString());
+        return;
+    }
+
+    // The decoder keeps state between chunks, so multi-byte sequences split
+    // across a chunk boundary are decoded correctly. The encoding is
+    // detected from the first chunk and corrected if later ones disagree.
+    TextDecoder decoder;
+
+    const qint64 totalBytes = file.size();
+    qint64 bytesRead = 0;
+    qint64 chunkSize = FirstChunkSize;
+    bool settled = false;
+
+    while (true) {
+        bool restart = false;
+        while (!file.atEnd()) {
+            if (isCancelled()) {
+                emit loadFinished(false);
+                return;
+            }
+
+            QByteArray bytes = file.read(chunkSize);
+            if (bytes.isEmpty()) {
+                if (file.error() != QFileDevice::NoError) {
+                    emit loadFailed(file.errorString());
+                    return;
+                }
+                break;
+            }
+
+            QString text = decoder.decode(bytes.constData(), bytes.size());
+            bytesRead += bytes.size();
+            chunkSize = ChunkSize;
+
+            restart = isWrongGuess(decoder);
+            if (restart) {
+                break;
+            }
+            if (!text.isEmpty()) {
+                emit chunkLoaded(text);
+            }
+            if (!settled && !isGuess(decoder)) {
+                settled = true;
+                emit formatSettled();
+            }
+            emit progressChanged(bytesRead, totalBytes);
+        }
+
+        if (!restart) {
+            const QString text = decoder.finish();
+            restart = isWrongGuess(decoder);
+            if (!restart) {
+                if (!text.isEmpty()) {
+                    emit chunkLoaded(text);
+                }
+                if (!settled) {
+                    emit formatSettled();
+                }
+                break;
+            }
+        }
+
+        // Not UTF-8 after all, and too late for the decoder to switch;
+        // Latin-1 cannot fail, so this happens once at most
+        TextFormat latin1;
+        latin1.encoding = TextFormat::Latin1;
+        decoder = TextDecoder(latin1);
+        bytesRead = 0;
+        if (!file.seek(0)) {
+            emit loadFailed(file.errorString());
+            return;
+        }
+        emit restarted();
+    }
+
+    m_format = decoder.format();
+    m_lossy = decoder.isLossy() || decoder.hasMixedLineEndings();
+    m_bytesRead = bytesRead;
+    emit loadFinished(true);
+}
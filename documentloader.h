@@ -0,0 +1,66 @@
+#ifndef DOCUMENTLOADER_H
+#define DOCUMENTLOADER_H
+
+#include <QThread>
+#include <QString>
+#include <QAtomicInt>
+#include "textformat.h"
+
+// Reads and decodes a file on a worker thread.
+//
+// The file is read in chunks and every decoded chunk is handed over through
+// chunkLoaded(), so the receiver can fill its buffer progressively. The first
+// chunk is kept small so the beginning of the file shows up right away.
+// cancel() can be called from any thread; the loader stops at the next chunk
+// boundary and emits finished(false).
+//
+// A file guessed to be UTF-8 that turns out not to be, past text that was
+// already decoded as such, is read again from the start as Latin-1, which
+// saves back every byte as it was. restarted() tells the receiver to drop
+// the chunks it got so far. Until formatSettled() the text received can
+// still be dropped that way, so it should not be edited.
+class DocumentLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit DocumentLoader(const QString &filePath, QObject *parent = nullptr);
+    ~DocumentLoader();
+
+    QString filePath() const;
+    void cancel();
+    bool isCancelled() const;
+
+    // Encoding and line endings of the file, valid once loadFinished(true)
+    // was emitted
+    TextFormat format() const;
+    // Whether invalid bytes were replaced or line endings were mixed, so the
+    // text cannot be saved back as it was; valid with format()
+    bool isLossy() const;
+    // Bytes of the file the text was decoded from
+    qint64 bytesRead() const;
+
+signals:
+    void chunkLoaded(const QString &text);
+    void restarted();
+    // The encoding is known for sure and the loader will not restart
+    void formatSettled();
+    void progressChanged(qint64 bytesRead, qint64 totalBytes);
+    void loadFinished(bool completed);
+    void loadFailed(const QString &error);
+
+protected:
+    void run() override;
+
+private:
+    static const qint64 FirstChunkSize = 64 * 1024;
+    static const qint64 ChunkSize = 1024 * 1024;
+
+    QString m_filePath;
+    QAtomicInt m_cancelled;
+    TextFormat m_format;
+    bool m_lossy;
+    qint64 m_bytesRead;
+};
+
+#endif // DOCUMENTLOADER_H
@@ -0,0 +1,98 @@
+#include "documentsaver.h"
+#include "contenthash.h"
+#include <QSaveFile>
+#include <QByteArray>
+
+DocumentSaver::DocumentSaver(const PieceTable::Snapshot &snapshot, const TextFormat &format, const QString &filePath,
+                             QObject *parent)
+    : QThread(parent)
+    , m_snapshot(snapshot)
+    , m_format(format)
+    , m_filePath(filePath)
+    , m_savedHash(0)
+    , m_savedSize(0)
+{
+}
+
+DocumentSaver::~DocumentSaver()
+{
+    // Let a running save complete, the file must not be left half written
+    wait();
+}
+
+QString DocumentSaver::filePath() const
+{
+    return m_filePath;
+}
+
+int DocumentSaver::savedLength() const
+{
+    return m_snapshot.length();
+}
+
+quint64 DocumentSaver::savedHash() const
+{
+    return m_savedHash;
+}
+
+qint64 DocumentSaver::savedSize() const
+{
+    return m_savedSize;
+}
+
+void DocumentSaver::run()
+{
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit saveFailed(file.errorString());
+        return;
+    }
+
+    // Line breaks are expanded while encoding, there is no separate pass
+    TextEncoder encoder(m_format);
+
+    // Encode the pieces into a bounded buffer and write it out whenever it fills up
+    QByteArray pending = encoder.header();
+    pending.reserve(WriteBufferSize);
+    bool writeError = false;
+    qint64 size = 0;
+    ContentHash hash;
+
+    m_snapshot.forEachChunk([&](const QChar *data, int length) {
+        if (writeError) {
+            return;
+        }
+
+        hash.addData(data, length);
+
+        encoder.encode(data, length, pending);
+
+        if (pending.size() >= WriteBufferSize) {
+            writeError = file.write(pending) != pending.size();
+            size += pending.size();
+            pending.truncate(0);
+        }
+    });
+
+    encoder.finish(pending);
+    if (!writeError && !pending.isEmpty()) {
+        writeError = file.write(pending) != pending.size();
+        size += pending.size();
+    }
+
+    // Returning without commit() discards the temporary file
+    if (writeError) {
+        emit saveFailed(file.errorString());
+        return;
+    }
+
+    // Flushes, syncs and atomically renames the temporary file over the target
+    if (!file.commit()) {
+        emit saveFailed(file.errorString());
+        return;
+    }
+
+    m_savedHash = hash.result();
+    m_savedSize = size;
+    emit saveFinished();
+}
@@ -0,0 +1,51 @@
+#ifndef DOCUMENTSAVER_H
+#define DOCUMENTSAVER_H
+
+#include <QThread>
+#include <QString>
+#include "piecetable.h"
+#include "textformat.h"
+
+// Writes a buffer snapshot to disk on a worker thread.
+//
+// The snapshot is encoded piece by piece, in the encoding and line ending
+// style the file was loaded with, into a QSaveFile, which writes to a
+// temporary file next to the target and, on commit, flushes it to disk and
+// renames it over the target. A crash or error halfway through leaves the
+// original file untouched.
+class DocumentSaver : public QThread
+{
+    Q_OBJECT
+
+public:
+    DocumentSaver(const PieceTable::Snapshot &snapshot, const TextFormat &format, const QString &filePath,
+                  QObject *parent = nullptr);
+    ~DocumentSaver();
+
+    QString filePath() const;
+
+    // Length and content hash of the text that was written, valid once
+    // saveFinished() was emitted
+    int savedLength() const;
+    quint64 savedHash() const;
+    // Bytes written to the file
+    qint64 savedSize() const;
+
+signals:
+    void saveFinished();
+    void saveFailed(const QString &error);
+
+protected:
+    void run() override;
+
+private:
+    static const int WriteBufferSize = 1024 * 1024;
+
+    PieceTable::Snapshot m_snapshot;
+    TextFormat m_format;
+    QString m_filePath;
+    quint64 m_savedHash;
+    qint64 m_savedSize;
+};
+
+#endif // DOCUMENTSAVER_H
@@ -0,0 +1,332 @@
+#include "documentsearch.h"
+#include <QStringView>
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DOCUMENTSEARCH_SSE2
+#endif
+
+// Folds ASCII letters to lower case, the only case folding done by the
+// vectorized filter
+static inline ushort foldBit(ushort unit)
+{
+    return ((unit | 0x20) >= 'a' && (unit | 0x20) <= 'z') ? 0x20 : 0;
+}
+
+static inline bool isAsciiUnit(ushort unit)
+{
+    return unit < 0x80;
+}
+
+static inline bool matchesAt(const QChar *text, const QString &pattern, bool caseSensitive)
+{
+    if (caseSensitive) {
+        return std::memcmp(text, pattern.constData(), size_t(pattern.length()) * sizeof(QChar)) == 0;
+    }
+    return QStringView(text, pattern.length()).compare(pattern, Qt::CaseInsensitive) == 0;
+}
+
+DocumentSearch::DocumentSearch(const PieceTable::Snapshot &snapshot, const QString &pattern,
+                               bool caseSensitive, bool regularExpression, QObject *parent)
+    : QThread(parent)
+    , m_snapshot(snapshot)
+    , m_pattern(pattern)
+    , m_caseSensitive(caseSensitive)
+    , m_regularExpression(regularExpression)
+    , m_cancelled(0)
+    , m_replacing(false)
+{
+}
+
+DocumentSearch::~DocumentSearch()
+{
+    // Never destroy a running thread
+    cancel();
+    wait();
+}
+
+void DocumentSearch::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+}
+
+bool DocumentSearch::isCancelled() const
+{
+    return m_cancelled.loadRelaxed() != 0;
+}
+
+void DocumentSearch::setReplacement(const QString &replacement)
+{
+    m_replacing = true;
+    m_replacement = replacement;
+}
+
+QVector<DocumentSearch::Replacement> DocumentSearch::replacements() const
+{
+    return m_replacements;
+}
+
+int DocumentSearch::indexOf(const QChar *text, int length, const QString &pattern, int from, bool caseSensitive)
+{
+    const int patternLength = pattern.length();
+    if (patternLength == 0 || from < 0 || length - from < patternLength) {
+        return -1;
+    }
+
+    const ushort first = pattern.at(0).unicode();
+    const ushort last = pattern.at(patternLength - 1).unicode();
+
+    // Case folding beyond ASCII cannot be done by the filter below
+    if (!caseSensitive && (!isAsciiUnit(first) || !isAsciiUnit(last))) {
+        return int(QStringView(text, length).indexOf(pattern, from, Qt::CaseInsensitive));
+    }
+
+    const ushort firstFold = caseSensitive ? 0 : foldBit(first);
+    const ushort lastFold = caseSensitive ? 0 : foldBit(last);
+    const ushort firstValue = first | firstFold;
+    const ushort lastValue = last | lastFold;
+    const int lastStart = length - patternLength;
+    int position = from;
+
+#ifdef DOCUMENTSEARCH_SSE2
+    // Candidates have both the first and the last character in place
+    const __m128i firstMask = _mm_set1_epi16(short(firstFold));
+    const __m128i lastMask = _mm_set1_epi16(short(lastFold));
+    const __m128i firstVector = _mm_set1_epi16(short(firstValue));
+    const __m128i lastVector = _mm_set1_epi16(short(lastValue));
+    const ushort *units = reinterpret_cast<const ushort *>(text);
+
+    while (position + 8 <= lastStart + 1) {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(units + position));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(units + position + patternLength - 1));
+        const __m128i both = _mm_and_si128(_mm_cmpeq_epi16(_mm_or_si128(head, firstMask), firstVector),
+                                           _mm_cmpeq_epi16(_mm_or_si128(tail, lastMask), lastVector));
+
+        // Two mask bits per character, keep one
+        quint32 candidates = quint32(_mm_movemask_epi8(both)) & 0x5555;
+        while (candidates) {
+            const int candidate = position + int(qCountTrailingZeroBits(candidates)) / 2;
+            if (matchesAt(text + candidate, pattern, caseSensitive)) {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+        position += 8;
+    }
+#endif
+
+    for (; position <= lastStart; ++position) {
+        if ((text[position].unicode() | firstFold) == firstValue
+            && (text[position + patternLength - 1].unicode() | lastFold) == lastValue
+            && matchesAt(text + position, pattern, caseSensitive)) {
+            return position;
+        }
+    }
+
+    return -1;
+}
+
+// Calls fn(position) for every non-overlapping match at or after from until
+// it returns false
+template<typename Fn>
+void DocumentSearch::forEachLiteralMatch(const PieceTable::Snapshot &snapshot, const QString &pattern, int from,
+                                         bool caseSensitive, Fn fn)
+{
+    const int patternLength = pattern.length();
+    if (patternLength == 0) {
+        return;
+    }
+
+    // Document offset of window[0]
+    const int windowSize = qMax(int(WindowSize), patternLength * 2);
+    QString window;
+    window.reserve(windowSize + patternLength);
+    int windowStart = 0;
+    int offset = 0;
+    bool stopped = false;
+
+    auto searchWindow = [&](bool last) {
+        int position = qMax(0, from - windowStart);
+        int matchEnd = 0;
+        while ((position = indexOf(window.constData(), window.length(), pattern, position, caseSensitive)) >= 0) {
+            if (!fn(windowStart + position)) {
+                stopped = true;
+                return;
+            }
+            position += patternLength;
+            matchEnd = position;
+        }
+
+        if (last) {
+            return;
+        }
+
+        // Keep enough of the tail for a match across the window boundary,
+        // but nothing a match was already reported in
+        const int keep = qMax(matchEnd, window.length() - (patternLength - 1));
+        window.remove(0, keep);
+        windowStart += keep;
+    };
+
+    snapshot.forEachChunk([&](const QChar *data, int length) {
+        const int chunkStart = offset;
+        offset += length;
+        if (stopped || offset <= from) {
+            windowStart = offset;
+            return;
+        }
+
+        // Pieces are appended until the window is full
+        int consumed = 0;
+        if (window.isEmpty() && chunkStart < from) {
+            consumed = from - chunkStart;
+            windowStart = from;
+        }
+
+        while (consumed < length && !stopped) {
+            const int count = qMin(length - consumed, windowSize - window.length());
+            window.append(data + consumed, count);
+            consumed += count;
+            if (window.length() >= windowSize) {
+                searchWindow(false);
+            }
+        }
+    });
+
+    if (!stopped) {
+        searchWindow(true);
+    }
+}
+
+QRegularExpression DocumentSearch::compile(const QString &pattern, bool caseSensitive)
+{
+    QRegularExpression regex(pattern, caseSensitive ? QRegularExpression::NoPatternOption
+                                                    : QRegularExpression::CaseInsensitiveOption);
+    // Compile, and JIT where available, now rather than on the first match
+    regex.optimize();
+    return regex;
+}
+
+// Expands \0 to \99, \n, \t and \\ in a regular expression replacement
+static QString expandReplacement(const QString &replacement, const QRegularExpressionMatch &match)
+{
+    QString result;
+    result.reserve(replacement.length());
+
+    for (int i = 0; i < replacement.length(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c != QLatin1Char('\\') || i + 1 == replacement.length()) {
+            result.append(c);
+            continue;
+        }
+
+        const QChar next = replacement.at(++i);
+        if (next.isDigit()) {
+            int group = next.digitValue();
+            if (i + 1 < replacement.length() && replacement.at(i + 1).isDigit()
+                && group * 10 + replacement.at(i + 1).digitValue() <= match.lastCapturedIndex()) {
+                group = group * 10 + replacement.at(++i).digitValue();
+            }
+            result.append(match.captured(group));
+        } else if (next == QLatin1Char('n')) {
+            result.append(QLatin1Char('\n'));
+        } else if (next == QLatin1Char('t')) {
+            result.append(QLatin1Char('\t'));
+        } else {
+            result.append(next);
+        }
+    }
+
+    return result;
+}
+
+// Over one copy of the text, which the replaced strings are taken from
+void DocumentSearch::findReplacements()
+{
+    const QString text = m_snapshot.text();
+
+    if (m_regularExpression) {
+        const QRegularExpression regex = compile(m_pattern, m_caseSensitive);
+        if (!regex.isValid()) {
+            return;
+        }
+
+        QRegularExpressionMatchIterator it = regex.globalMatch(text);
+        while (it.hasNext() && !isCancelled()) {
+            const QRegularExpressionMatch match = it.next();
+            m_replacements.append({ int(match.capturedStart()), match.captured(0),
+                                    expandReplacement(m_replacement, match) });
+        }
+    } else {
+        int position = 0;
+        while (!isCancelled()
+               && (position = indexOf(text.constData(), text.length(), m_pattern, position, m_caseSensitive)) >= 0) {
+            m_replacements.append({ position, text.mid(position, m_pattern.length()), m_replacement });
+            position += m_pattern.length();
+        }
+    }
+}
+
+void DocumentSearch::run()
+{
+    if (m_replacing) {
+        findReplacements();
+        emit searchFinished(m_replacements.size(), !isCancelled());
+        return;
+    }
+
+    QVector<int> positions;
+    QVector<int> lengths;
+    int matchCount = 0;
+
+    auto flush = [&]() {
+        if (!positions.isEmpty()) {
+            emit matchesFound(positions, lengths);
+            positions.clear();
+            lengths.clear();
+        }
+    };
+
+    if (m_regularExpression) {
+        const QRegularExpression regex = compile(m_pattern, m_caseSensitive);
+        if (!regex.isValid()) {
+            emit searchFinished(0, true);
+            return;
+        }
+
+        const QString text = m_snapshot.text();
+        QRegularExpressionMatchIterator it = regex.globalMatch(text);
+        while (it.hasNext() && !isCancelled()) {
+            const QRegularExpressionMatch match = it.next();
+            positions.append(int(match.capturedStart()));
+            lengths.append(int(match.capturedLength()));
+            ++matchCount;
+
+            if (positions.size() >= BatchSize) {
+                flush();
+            }
+        }
+    } else {
+        const int patternLength = m_pattern.length();
+        forEachLiteralMatch(m_snapshot, m_pattern, 0, m_caseSensitive, [&](int match) {
+            positions.append(match);
+            lengths.append(patternLength);
+            ++matchCount;
+
+            if (positions.size() >= BatchSize) {
+                flush();
+            }
+            return !isCancelled();
+        });
+    }
+
+    if (isCancelled()) {
+        emit searchFinished(matchCount, false);
+        return;
+    }
+
+    flush();
+    emit searchFinished(matchCount, true);
+}
@@ -0,0 +1,85 @@
+#ifndef DOCUMENTSEARCH_H
+#define DOCUMENTSEARCH_H
+
+#include <QThread>
+#include <QString>
+#include <QVector>
+#include <QAtomicInt>
+#include <QRegularExpression>
+#include "piecetable.h"
+
+// Finds every match of a pattern in a buffer snapshot on a worker thread.
+//
+// Literal patterns are searched window by window over the snapshot's pieces,
+// so the text is never copied as a whole. Candidate positions are found 8
+// characters at a time by comparing the first and last character of the
+// pattern, then verified. Regular expressions are JIT compiled up front and
+// run over the full text. Matches are reported in batches through
+// matchesFound() while the search runs; cancel() stops it at the next
+// window or batch.
+//
+// With setReplacement(), the search finds what replacing every match would
+// do instead: the matches are not reported, and replacements() holds the
+// text before and after each one once searchFinished() reported the search
+// completed.
+class DocumentSearch : public QThread
+{
+    Q_OBJECT
+
+public:
+    DocumentSearch(const PieceTable::Snapshot &snapshot, const QString &pattern,
+                   bool caseSensitive, bool regularExpression, QObject *parent = nullptr);
+    ~DocumentSearch();
+
+    struct Replacement
+    {
+        // Position in the text before any replacement
+        int position;
+        QString before;
+        QString after;
+    };
+
+    void cancel();
+    bool isCancelled() const;
+
+    // Set before start(); \0 to \99, \n, \t and \\ are expanded in the
+    // replacement of a regular expression
+    void setReplacement(const QString &replacement);
+    QVector<Replacement> replacements() const;
+
+    // Position of the next literal match in a contiguous text, or -1
+    static int indexOf(const QChar *text, int length, const QString &pattern, int from, bool caseSensitive);
+
+    // Optimized expression for a pattern, invalid if the pattern is
+    static QRegularExpression compile(const QString &pattern, bool caseSensitive);
+
+signals:
+    void matchesFound(const QVector<int> &positions, const QVector<int> &lengths);
+    void searchFinished(int matchCount, bool completed);
+
+protected:
+    void run() override;
+
+private:
+    // Characters searched at once; matches across windows are found through
+    // an overlap of the pattern length
+    static const int WindowSize = 256 * 1024;
+    static const int BatchSize = 1000;
+
+    template<typename Fn>
+    static void forEachLiteralMatch(const PieceTable::Snapshot &snapshot, const QString &pattern, int from,
+                                    bool caseSensitive, Fn fn);
+
+    void findReplacements();
+
+    PieceTable::Snapshot m_snapshot;
+    QString m_pattern;
+    bool m_caseSensitive;
+    bool m_regularExpression;
+    QAtomicInt m_cancelled;
+    bool m_replacing;
+    QString m_replacement;
+    QVector<Replacement> m_replacements;
+};
+
+#endif // DOCUMENTSEARCH_H
@@ -0,0 +1,213 @@
+#include "editjournal.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+
+static const QDataStream::Version StreamVersion = QDataStream::Qt_5_0;
+
+EditJournal::EditJournal(const QString &journalPath, QObject *parent)
+    : QThread(parent)
+    , m_journalPath(journalPath)
+    , m_truncate(false)
+    , m_stopping(false)
+{
+}
+
+EditJournal::~EditJournal()
+{
+    // Pending records are written before the thread exits
+    stop();
+}
+
+QString EditJournal::journalPath() const
+{
+    return m_journalPath;
+}
+
+void EditJournal::beginFromFile(const QString &filePath, int savedLength, quint64 savedHash)
+{
+    QMutexLocker locker(&m_mutex);
+    beginRecords(filePath);
+
+    QDataStream stream(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(StreamVersion);
+    stream << quint8(FileBaseRecord) << qint32(savedLength) << savedHash;
+
+    m_condition.wakeOne();
+}
+
+void EditJournal::beginFromText(const QString &filePath, const QString &text)
+{
+    QMutexLocker locker(&m_mutex);
+    beginRecords(filePath);
+
+    QDataStream stream(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(StreamVersion);
+    stream << quint8(TextBaseRecord) << text;
+
+    m_condition.wakeOne();
+}
+
+void EditJournal::appendEdit(int position, int removeLength, const QString &text)
+{
+    QMutexLocker locker(&m_mutex);
+    const bool wasEmpty = m_pending.isEmpty();
+
+    QDataStream stream(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(StreamVersion);
+    stream << quint8(EditRecord) << qint32(position) << qint32(removeLength) << text;
+
+    // The writer is already collecting otherwise
+    if (wasEmpty) {
+        m_condition.wakeOne();
+    }
+}
+
+void EditJournal::discard()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.clear();
+        m_truncate = false;
+    }
+
+    stop();
+    QFile::remove(m_journalPath);
+}
+
+QString EditJournal::journalPathFor(const QString &filePath)
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal";
+    QDir().mkpath(directory);
+
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(filePath).absoluteFilePath().toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return directory + "/" + QString::fromLatin1(key) + ".journal";
+}
+
+QStringList EditJournal::existingJournals()
+{
+    const QDir directory(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal");
+
+    QStringList journals;
+    const QStringList names = directory.entryList(QStringList() << "*.journal", QDir::Files);
+    for (const QString &name : names) {
+        journals.append(directory.filePath(name));
+    }
+    return journals;
+}
+
+bool EditJournal::read(const QString &journalPath, Contents &contents)
+{
+    QFile file(journalPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(StreamVersion);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version >> contents.filePath;
+    if (stream.status() != QDataStream::Ok || magic != Magic || version != Version) {
+        return false;
+    }
+
+    quint8 type;
+    stream >> type;
+    if (type == FileBaseRecord) {
+        qint32 savedLength;
+        stream >> savedLength >> contents.savedHash;
+        contents.savedLength = savedLength;
+        contents.hasText = false;
+    } else if (type == TextBaseRecord) {
+        stream >> contents.text;
+        contents.hasText = true;
+    } else {
+        return false;
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // Stop at the first incomplete record, the rest never reached the disk
+    while (!stream.atEnd()) {
+        qint32 position, removeLength;
+        QString text;
+        stream >> type >> position >> removeLength >> text;
+        if (stream.status() != QDataStream::Ok || type != EditRecord) {
+            break;
+        }
+        contents.edits.append({ position, removeLength, text });
+    }
+
+    return true;
+}
+
+void EditJournal::run()
+{
+    // Without a journal file the records are still consumed, just not kept
+    QFile file(m_journalPath);
+    const bool opened = file.open(QIODevice::WriteOnly | QIODevice::Append);
+
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        while (m_pending.isEmpty() && !m_truncate && !m_stopping) {
+            m_condition.wait(&m_mutex);
+        }
+
+        // Group commit: let the records of a typing burst pile up
+        if (!m_stopping) {
+            m_condition.wait(&m_mutex, GroupCommitInterval);
+        }
+
+        QByteArray records;
+        records.swap(m_pending);
+        const bool truncate = m_truncate;
+        const bool stopping = m_stopping;
+        m_truncate = false;
+
+        // Write without holding the lock so appends never wait for the disk
+        locker.unlock();
+        if (opened && truncate) {
+            file.resize(0);
+        }
+        if (opened && !records.isEmpty()) {
+            file.write(records);
+            file.flush();
+        }
+        locker.relock();
+
+        if (stopping && m_pending.isEmpty()) {
+            break;
+        }
+    }
+}
+
+void EditJournal::beginRecords(const QString &filePath)
+{
+    // Everything not written yet belongs to the old base
+    m_pending.clear();
+    m_truncate = true;
+
+    QDataStream stream(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setVersion(StreamVersion);
+    stream << Magic << Version << filePath;
+}
+
+void EditJournal::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_condition.wakeAll();
+    }
+
+    wait();
+}
@@ -0,0 +1,89 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QThread>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+// Append-only log of the edits made to a document, for crash recovery.
+//
+// A journal starts from a base, either the file as it is on disk (identified
+// by its length and content hash) or a full copy of the text, followed by
+// every edit applied since. Appending only serializes the record into a
+// memory buffer; a worker thread wakes up on the first pending record,
+// waits for more to accumulate and writes them out together, so typing does
+// not touch the disk. Records cut short by a crash are ignored on replay.
+class EditJournal : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct Edit
+    {
+        int position;
+        int removeLength;
+        QString text;
+    };
+
+    // What a journal file holds
+    struct Contents
+    {
+        QString filePath;
+        // Base: the text itself, or the length and hash of the file on disk
+        bool hasText = false;
+        QString text;
+        int savedLength = 0;
+        quint64 savedHash = 0;
+        QVector<Edit> edits;
+    };
+
+    EditJournal(const QString &journalPath, QObject *parent = nullptr);
+    ~EditJournal();
+
+    QString journalPath() const;
+
+    // Restart the journal from a new base, dropping what was logged before
+    void beginFromFile(const QString &filePath, int savedLength, quint64 savedHash);
+    void beginFromText(const QString &filePath, const QString &text);
+    void appendEdit(int position, int removeLength, const QString &text);
+
+    // Stops writing and deletes the journal file
+    void discard();
+
+    // Journal location for a file, and the journals left by a previous run
+    static QString journalPathFor(const QString &filePath);
+    static QStringList existingJournals();
+    static bool read(const QString &journalPath, Contents &contents);
+
+protected:
+    void run() override;
+
+private:
+    enum RecordType {
+        FileBaseRecord = 1,
+        TextBaseRecord = 2,
+        EditRecord = 3
+    };
+
+    static const quint32 Magic = 0x574A524E; // "WJRN"
+    static const quint16 Version = 1;
+    // How long the writer lets records accumulate before writing them
+    static const int GroupCommitInterval = 200;
+
+    void beginRecords(const QString &filePath);
+    void stop();
+
+    QString m_journalPath;
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    // Serialized records not written yet, guarded by m_mutex
+    QByteArray m_pending;
+    bool m_truncate;
+    bool m_stopping;
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,1105 @@
+#include "editorview.h"
+#include "contenthash.h"
+#include "sceneitem.h"
+#include <QClipboard>
+#include <QFontMetricsF>
+#include <QGuiApplication>
+#include <QInputMethod>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QQuickWindow>
+#include <QSGSimpleRectNode>
+#include <QSGTransformNode>
+#include <QTextLayout>
+#include <QtMath>
+
+// Everything is laid out in content coordinates under one transform, so
+// scrolling only changes its matrix. Selection is drawn below the text and
+// the cursor above it.
+class EditorRootNode : public QSGTransformNode
+{
+public:
+    EditorRootNode()
+        : selection(new QSGNode)
+        , cursor(new QSGSimpleRectNode)
+    {
+        appendChildNode(selection);
+        appendChildNode(cursor);
+    }
+
+    QSGNode *selection;
+    QSGSimpleRectNode *cursor;
+    QHash<int, ImageTextureNode *> lines;
+};
+
+static bool isWordCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+EditorView::EditorView(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_color(Qt::black)
+    , m_selectionColor(Qt::lightGray)
+    , m_leftPadding(0)
+    , m_topPadding(0)
+    , m_lineHeight(0)
+    , m_charWidth(0)
+    , m_cursor(0)
+    , m_anchor(0)
+    , m_preferredX(0)
+    , m_cursorVisible(true)
+    , m_editing(false)
+    , m_undoing(false)
+    , m_editSeen(false)
+    , m_contentX(0)
+    , m_contentY(0)
+    , m_contentWidth(0)
+    , m_lineCount(0)
+    , m_nextVersion(0)
+    , m_layoutCache(LayoutCacheSize)
+{
+    setFlag(ItemHasContents);
+    setFlag(ItemAcceptsInputMethod);
+    setAcceptedMouseButtons(Qt::LeftButton);
+#if QT_CONFIG(cursor)
+    setCursor(Qt::IBeamCursor);
+#endif
+
+    m_blinkTimer.setInterval(CursorBlinkInterval);
+    connect(&m_blinkTimer, &QTimer::timeout, this, [this]() {
+        m_cursorVisible = !m_cursorVisible;
+        update();
+    });
+
+    setFont(QFont());
+}
+
+EditorView::~EditorView()
+{
+}
+
+TextDocument *EditorView::document() const
+{
+    return m_document;
+}
+
+void EditorView::setDocument(TextDocument *document)
+{
+    if (m_document == document) {
+        return;
+    }
+
+    if (m_document) {
+        disconnect(m_document, nullptr, this, nullptr);
+    }
+
+    m_document = document;
+    m_cursor = 0;
+    m_anchor = 0;
+    m_contentX = 0;
+    m_contentY = 0;
+    m_contentWidth = 0;
+
+    if (m_document) {
+        connect(m_document, &TextDocument::textEdited, this, &EditorView::handleTextEdited);
+        connect(m_document, &TextDocument::contentChanged, this, &EditorView::handleContentChanged);
+        connect(m_document, &TextDocument::highlightingChanged, this, &EditorView::invalidateLines);
+    }
+
+    m_lineCount = lineCount();
+    invalidateAll();
+    updateContentSize();
+    updateCursorRectangle();
+
+    emit documentChanged();
+    emit textChanged();
+    emit contentXChanged();
+    emit contentYChanged();
+    emit cursorPositionChanged();
+    emit selectionChanged();
+}
+
+QFont EditorView::font() const
+{
+    return m_font;
+}
+
+void EditorView::setFont(const QFont &font)
+{
+    if (m_font == font && m_lineHeight > 0) {
+        return;
+    }
+
+    m_font = font;
+    const QFontMetricsF metrics(m_font);
+    m_lineHeight = qCeil(metrics.height());
+    m_atlas = GlyphAtlas::forFont(m_font);
+    m_charWidth = m_atlas->isMonospace() ? m_atlas->advance() : metrics.horizontalAdvance(QLatin1Char(' '));
+
+    m_layoutCache.clear();
+    invalidateAll();
+    updateContentSize();
+    updateCursorRectangle();
+    emit fontChanged();
+}
+
+QColor EditorView::color() const
+{
+    return m_color;
+}
+
+void EditorView::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+
+    m_color = color;
+    m_layoutCache.clear();
+    invalidateAll();
+    emit colorChanged();
+}
+
+QColor EditorView::selectionColor() const
+{
+    return m_selectionColor;
+}
+
+void EditorView::setSelectionColor(const QColor &color)
+{
+    if (m_selectionColor == color) {
+        return;
+    }
+
+    m_selectionColor = color;
+    update();
+    emit selectionColorChanged();
+}
+
+qreal EditorView::leftPadding() const
+{
+    return m_leftPadding;
+}
+
+void EditorView::setLeftPadding(qreal padding)
+{
+    if (m_leftPadding == padding) {
+        return;
+    }
+
+    m_leftPadding = padding;
+    invalidateAll();
+    updateContentSize();
+    updateCursorRectangle();
+    emit paddingChanged();
+}
+
+qreal EditorView::topPadding() const
+{
+    return m_topPadding;
+}
+
+void EditorView::setTopPadding(qreal padding)
+{
+    if (m_topPadding == padding) {
+        return;
+    }
+
+    m_topPadding = padding;
+    invalidateAll();
+    updateContentSize();
+    updateCursorRectangle();
+    emit paddingChanged();
+}
+
+qreal EditorView::lineHeight() const
+{
+    return m_lineHeight;
+}
+
+int EditorView::length() const
+{
+    return m_document ? m_document->length() : 0;
+}
+
+int EditorView::cursorPosition() const
+{
+    return m_cursor;
+}
+
+void EditorView::setCursorPosition(int position)
+{
+    moveCursor(position, false);
+    m_preferredX = m_cursorRect.x();
+}
+
+QRectF EditorView::cursorRectangle() const
+{
+    return m_cursorRect;
+}
+
+int EditorView::selectionStart() const
+{
+    return qMin(m_cursor, m_anchor);
+}
+
+int EditorView::selectionEnd() const
+{
+    return qMax(m_cursor, m_anchor);
+}
+
+QString EditorView::selectedText() const
+{
+    if (!m_document || m_cursor == m_anchor) {
+        return QString();
+    }
+
+    return m_document->text(selectionStart(), selectionEnd() - selectionStart());
+}
+
+qreal EditorView::contentX() const
+{
+    return m_contentX;
+}
+
+void EditorView::setContentX(qreal contentX)
+{
+    contentX = qBound(qreal(0), contentX, qMax(qreal(0), contentWidth() - width()));
+    if (m_contentX == contentX) {
+        return;
+    }
+
+    m_contentX = contentX;
+    update();
+    emit contentXChanged();
+}
+
+qreal EditorView::contentY() const
+{
+    return m_contentY;
+}
+
+void EditorView::setContentY(qreal contentY)
+{
+    contentY = qBound(qreal(0), contentY, qMax(qreal(0), contentHeight() - height()));
+    if (m_contentY == contentY) {
+        return;
+    }
+
+    // Lines that scroll in are laid out before the next frame
+    m_contentY = contentY;
+    polish();
+    emit contentYChanged();
+}
+
+qreal EditorView::contentWidth() const
+{
+    return m_contentWidth + 2 * m_leftPadding + m_charWidth;
+}
+
+qreal EditorView::contentHeight() const
+{
+    return m_lineCount * m_lineHeight + 2 * m_topPadding;
+}
+
+void EditorView::select(int start, int end)
+{
+    const int length = this->length();
+    m_anchor = qBound(0, start, length);
+    moveCursor(end, true);
+    m_preferredX = m_cursorRect.x();
+}
+
+void EditorView::selectAll()
+{
+    m_anchor = 0;
+    moveCursor(length(), true);
+}
+
+void EditorView::insert(int position, const QString &text)
+{
+    if (!m_document || text.isEmpty()) {
+        return;
+    }
+
+    position = qBound(0, position, length());
+    const int cursor = m_cursor >= position ? m_cursor + text.length() : m_cursor;
+
+    m_editing = true;
+    m_document->insertText(position, text);
+    m_editing = false;
+
+    moveCursor(cursor, false);
+    m_preferredX = m_cursorRect.x();
+}
+
+void EditorView::copy()
+{
+    if (m_cursor != m_anchor) {
+        QGuiApplication::clipboard()->setText(selectedText());
+    }
+}
+
+void EditorView::cut()
+{
+    if (m_cursor != m_anchor) {
+        copy();
+        replaceSelection(QString());
+    }
+}
+
+void EditorView::paste()
+{
+    // The buffer only has '\n' line breaks
+    QString text = QGuiApplication::clipboard()->text();
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    text.replace(QLatin1Char('\r'), QLatin1Char('\n'));
+    replaceSelection(text);
+}
+
+int EditorView::positionAt(qreal x, qreal y) const
+{
+    if (!m_document || m_lineHeight <= 0) {
+        return 0;
+    }
+
+    const int line = qBound(0, int(qFloor((y + m_contentY - m_topPadding) / m_lineHeight)), lineCount() - 1);
+    return lineStart(line) + xToColumn(lineText(line), x + m_contentX - m_leftPadding);
+}
+
+QVariant EditorView::inputMethodQuery(Qt::InputMethodQuery query) const
+{
+    switch (query) {
+    case Qt::ImEnabled:
+        return m_document != nullptr;
+    case Qt::ImHints:
+        return int(Qt::ImhMultiLine | Qt::ImhNoPredictiveText);
+    case Qt::ImFont:
+        return m_font;
+    case Qt::ImCursorRectangle:
+        return m_cursorRect.translated(-m_contentX, -m_contentY);
+    case Qt::ImCursorPosition:
+        return m_cursor - lineStart(lineAt(m_cursor));
+    case Qt::ImAnchorPosition:
+        return qBound(0, m_anchor - lineStart(lineAt(m_cursor)), lineText(lineAt(m_cursor)).length());
+    case Qt::ImSurroundingText:
+        return lineText(lineAt(m_cursor));
+    case Qt::ImCurrentSelection:
+        return selectedText();
+    default:
+        return QQuickItem::inputMethodQuery(query);
+    }
+}
+
+void EditorView::updatePolish()
+{
+    m_selectionRects.clear();
+    if (!m_document || m_lineHeight <= 0) {
+        m_lines.clear();
+        update();
+        return;
+    }
+
+    const int count = lineCount();
+    const int firstVisible = qMax(0, int(qFloor((m_contentY - m_topPadding) / m_lineHeight)));
+    const int lastVisible = qMin(count - 1, int(qFloor((m_contentY + height() - m_topPadding) / m_lineHeight)));
+    const int first = qMax(0, firstVisible - OverscanLines);
+    const int last = qMin(count - 1, lastVisible + OverscanLines);
+    m_document->setViewportLines(first, last);
+
+    // Lines that left the range drop their images, their nodes go to the
+    // lines that came in
+    for (auto it = m_lines.begin(); it != m_lines.end();) {
+        if (it.key() < first || it.key() > last) {
+            it = m_lines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const qreal contentWidth = this->contentWidth();
+    for (int line = first; line <= last; ++line) {
+        if (!m_lines.contains(line)) {
+            const VisualLine visual = renderLine(line);
+            m_contentWidth = qMax(m_contentWidth, visual.width);
+            m_lines.insert(line, visual);
+        }
+    }
+    if (this->contentWidth() != contentWidth) {
+        emit contentWidthChanged();
+    }
+
+    // Selected part of every line in view; a selected line break shows as
+    // one space past the end of its line
+    const int start = selectionStart();
+    const int end = selectionEnd();
+    if (start != end) {
+        const int firstSelected = qMax(firstVisible, lineAt(start));
+        const int lastSelected = qMin(lastVisible, lineAt(end));
+        for (int line = firstSelected; line <= lastSelected; ++line) {
+            const QString text = lineText(line);
+            const int lineBegin = lineStart(line);
+            const int from = qMax(start - lineBegin, 0);
+            const int to = qMin(end - lineBegin, text.length());
+            const qreal left = columnToX(text, from);
+            qreal right = columnToX(text, to);
+            if (end > lineBegin + text.length()) {
+                right += m_charWidth;
+            }
+            if (right > left) {
+                m_selectionRects.append(QRectF(m_leftPadding + left, m_topPadding + line * m_lineHeight,
+                                               right - left, m_lineHeight));
+            }
+        }
+    }
+
+    update();
+}
+
+QSGNode *EditorView::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    EditorRootNode *root = static_cast<EditorRootNode *>(oldNode);
+    if (!root) {
+        root = new EditorRootNode;
+    }
+
+    QMatrix4x4 matrix;
+    matrix.translate(-m_contentX, -m_contentY);
+    root->setMatrix(matrix);
+
+    // Nodes of lines that left the range or were painted again are reused
+    QVector<ImageTextureNode *> spare;
+    for (auto it = root->lines.begin(); it != root->lines.end();) {
+        const auto visual = m_lines.constFind(it.key());
+        if (visual == m_lines.constEnd() || visual->version != it.value()->version) {
+            spare.append(it.value());
+            it = root->lines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = m_lines.constBegin(); it != m_lines.constEnd(); ++it) {
+        const VisualLine &visual = it.value();
+        if (visual.image.isNull()) {
+            continue;
+        }
+
+        ImageTextureNode *node = root->lines.value(it.key());
+        if (!node) {
+            if (!spare.isEmpty()) {
+                node = spare.takeLast();
+            } else {
+                node = new ImageTextureNode;
+                root->insertChildNodeBefore(node, root->cursor);
+            }
+            node->version = visual.version;
+            node->setImage(window(), visual.image);
+            root->lines.insert(it.key(), node);
+        }
+
+        // Padding may have changed since the node was placed
+        const QSizeF size = QSizeF(visual.image.size()) / visual.image.devicePixelRatio();
+        node->setRect(QRectF(QPointF(m_leftPadding, m_topPadding + it.key() * m_lineHeight), size));
+    }
+
+    for (ImageTextureNode *node : spare) {
+        root->removeChildNode(node);
+        delete node;
+    }
+
+    while (QSGNode *child = root->selection->firstChild()) {
+        root->selection->removeChildNode(child);
+        delete child;
+    }
+    for (const QRectF &rect : m_selectionRects) {
+        root->selection->appendChildNode(new QSGSimpleRectNode(rect, m_selectionColor));
+    }
+
+    root->cursor->setColor(m_color);
+    root->cursor->setRect(m_cursorVisible && hasActiveFocus() ? m_cursorRect : QRectF());
+
+    return root;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+void EditorView::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+#else
+void EditorView::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+#endif
+    // Keep the scroll position in range and fill the new height
+    setContentX(m_contentX);
+    setContentY(m_contentY);
+    polish();
+}
+
+void EditorView::itemChange(ItemChange change, const ItemChangeData &value)
+{
+    // Lines are painted for the screen's pixel density
+    if (change == ItemSceneChange || change == ItemDevicePixelRatioHasChanged) {
+        m_layoutCache.clear();
+        invalidateAll();
+    }
+    QQuickItem::itemChange(change, value);
+}
+
+void EditorView::keyPressEvent(QKeyEvent *event)
+{
+    if (!m_document) {
+        event->ignore();
+        return;
+    }
+
+    if (event->matches(QKeySequence::Copy)) {
+        copy();
+        return;
+    }
+    if (event->matches(QKeySequence::Cut)) {
+        cut();
+        return;
+    }
+    if (event->matches(QKeySequence::Paste)) {
+        paste();
+        return;
+    }
+    if (event->matches(QKeySequence::SelectAll)) {
+        selectAll();
+        return;
+    }
+    if (event->matches(QKeySequence::Undo) || event->matches(QKeySequence::Redo)) {
+        // The cursor goes to where the change happened
+        m_undoing = true;
+        if (event->matches(QKeySequence::Undo)) {
+            m_document->undo();
+        } else {
+            m_document->redo();
+        }
+        m_undoing = false;
+        moveCursor(m_cursor, false);
+        m_preferredX = m_cursorRect.x();
+        return;
+    }
+
+    const bool select = event->modifiers() & Qt::ShiftModifier;
+    const bool word = event->modifiers() & Qt::ControlModifier;
+    const int line = lineAt(m_cursor);
+    const int pageLines = qMax(1, int(height() / m_lineHeight) - 1);
+
+    // Up and down keep the horizontal position the cursor started from
+    auto moveLines = [&](int lines) {
+        const int target = qBound(0, line + lines, lineCount() - 1);
+        moveCursor(lineStart(target) + xToColumn(lineText(target), m_preferredX - m_leftPadding), select);
+    };
+
+    switch (event->key()) {
+    case Qt::Key_Left:
+        if (m_cursor != m_anchor && !select) {
+            moveCursor(selectionStart(), false);
+        } else {
+            moveCursor(word ? wordStart(m_cursor) : m_cursor - 1, select);
+        }
+        break;
+    case Qt::Key_Right:
+        if (m_cursor != m_anchor && !select) {
+            moveCursor(selectionEnd(), false);
+        } else {
+            moveCursor(word ? wordEnd(m_cursor) : m_cursor + 1, select);
+        }
+        break;
+    case Qt::Key_Up:
+        moveLines(-1);
+        return;
+    case Qt::Key_Down:
+        moveLines(1);
+        return;
+    case Qt::Key_PageUp:
+        setContentY(m_contentY - pageLines * m_lineHeight);
+        moveLines(-pageLines);
+        return;
+    case Qt::Key_PageDown:
+        setContentY(m_contentY + pageLines * m_lineHeight);
+        moveLines(pageLines);
+        return;
+    case Qt::Key_Home:
+        moveCursor(word ? 0 : lineStart(line), select);
+        break;
+    case Qt::Key_End:
+        moveCursor(word ? length() : lineStart(line) + lineText(line).length(), select);
+        break;
+    case Qt::Key_Backspace:
+        if (m_cursor == m_anchor) {
+            m_anchor = word ? wordStart(m_cursor) : m_cursor - 1;
+            // Never split a surrogate pair
+            if (!word && m_anchor > 0 && m_document->text(m_anchor - 1, 2).at(1).isLowSurrogate()) {
+                --m_anchor;
+            }
+            m_anchor = qMax(0, m_anchor);
+        }
+        replaceSelection(QString());
+        break;
+    case Qt::Key_Delete:
+        if (m_cursor == m_anchor) {
+            m_anchor = word ? wordEnd(m_cursor) : m_cursor + 1;
+            if (!word && m_cursor < length() && m_document->text(m_cursor, 1).at(0).isHighSurrogate()) {
+                ++m_anchor;
+            }
+            m_anchor = qMin(length(), m_anchor);
+        }
+        replaceSelection(QString());
+        break;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        replaceSelection(QStringLiteral("\n"));
+        break;
+    default: {
+        const QString text = event->text();
+        if (text.isEmpty() || (event->modifiers() & (Qt::ControlModifier | Qt::MetaModifier))
+                || (!text.at(0).isPrint() && text.at(0) != QLatin1Char('\t'))) {
+            event->ignore();
+            return;
+        }
+        replaceSelection(text);
+        break;
+    }
+    }
+
+    m_preferredX = m_cursorRect.x();
+}
+
+void EditorView::inputMethodEvent(QInputMethodEvent *event)
+{
+    // Composition is left to the input method's own window
+    if (!event->commitString().isEmpty()) {
+        replaceSelection(event->commitString());
+    }
+    event->accept();
+}
+
+void EditorView::mousePressEvent(QMouseEvent *event)
+{
+    forceActiveFocus(Qt::MouseFocusReason);
+    const QPointF point = eventPosition(event);
+    moveCursor(positionAt(point.x(), point.y()), event->modifiers() & Qt::ShiftModifier);
+    m_preferredX = m_cursorRect.x();
+    event->accept();
+}
+
+void EditorView::mouseMoveEvent(QMouseEvent *event)
+{
+    // Dragging past an edge scrolls, since the cursor is kept in view
+    const QPointF point = eventPosition(event);
+    moveCursor(positionAt(point.x(), point.y()), true);
+    m_preferredX = m_cursorRect.x();
+    event->accept();
+}
+
+void EditorView::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    const QPointF point = eventPosition(event);
+    const int position = positionAt(point.x(), point.y());
+    const QString character = m_document ? m_document->text(position, 1) : QString();
+    if (!character.isEmpty() && isWordCharacter(character.at(0))) {
+        m_anchor = wordStart(position + 1);
+        moveCursor(wordEnd(position), true);
+        m_preferredX = m_cursorRect.x();
+    }
+    event->accept();
+}
+
+void EditorView::wheelEvent(QWheelEvent *event)
+{
+    // Three lines per notch, or the exact distance from a touchpad
+    QPointF delta = event->pixelDelta();
+    if (delta.isNull()) {
+        delta = QPointF(event->angleDelta()) / 120.0 * 3 * m_lineHeight;
+    }
+    if (event->modifiers() & Qt::ShiftModifier && delta.x() == 0) {
+        delta = QPointF(delta.y(), 0);
+    }
+
+    setContentX(m_contentX - delta.x());
+    setContentY(m_contentY - delta.y());
+    event->accept();
+}
+
+void EditorView::focusInEvent(QFocusEvent *event)
+{
+    QQuickItem::focusInEvent(event);
+    resetCursorBlink();
+}
+
+void EditorView::focusOutEvent(QFocusEvent *event)
+{
+    QQuickItem::focusOutEvent(event);
+    m_blinkTimer.stop();
+    update();
+}
+
+void EditorView::handleTextEdited(int position, int charsRemoved, int charsAdded)
+{
+    m_editSeen = true;
+
+    // Lines below a change of the line count moved; only those near the
+    // view are cached, and they are all laid out again
+    const int count = lineCount();
+    const int first = lineAt(position);
+    if (count != m_lineCount) {
+        m_lineCount = count;
+        invalidateLines(first, count);
+        updateContentSize();
+    } else {
+        invalidateLines(first, lineAt(position + charsAdded));
+    }
+
+    if (m_undoing) {
+        m_cursor = position + charsAdded;
+        m_anchor = m_cursor;
+    } else if (!m_editing) {
+        // Changes made elsewhere move the cursor along with the text
+        auto shift = [position, charsRemoved, charsAdded](int offset) {
+            if (offset >= position + charsRemoved) {
+                return offset - charsRemoved + charsAdded;
+            }
+            return qMin(offset, position);
+        };
+        m_cursor = shift(m_cursor);
+        m_anchor = shift(m_anchor);
+    }
+
+    const int length = this->length();
+    m_cursor = qBound(0, m_cursor, length);
+    m_anchor = qBound(0, m_anchor, length);
+
+    updateCursorRectangle();
+    emit textChanged();
+    emit cursorPositionChanged();
+    emit selectionChanged();
+}
+
+void EditorView::handleContentChanged()
+{
+    if (m_editSeen) {
+        m_editSeen = false;
+        return;
+    }
+
+    // The whole text was replaced, as when a file starts loading
+    m_lineCount = lineCount();
+    m_cursor = qMin(m_cursor, length());
+    m_anchor = m_cursor;
+    m_contentWidth = 0;
+    invalidateAll();
+    updateContentSize();
+    updateCursorRectangle();
+    emit textChanged();
+    emit cursorPositionChanged();
+    emit selectionChanged();
+}
+
+void EditorView::invalidateLines(int first, int last)
+{
+    for (auto it = m_lines.begin(); it != m_lines.end();) {
+        if (it.key() >= first && it.key() <= last) {
+            it = m_lines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    polish();
+}
+
+void EditorView::invalidateAll()
+{
+    m_lines.clear();
+    polish();
+}
+
+EditorView::VisualLine EditorView::renderLine(int line)
+{
+    VisualLine visual;
+    visual.width = 0;
+    visual.version = 0;
+
+    // Characters past the widest line drawn are never seen
+    QString text = lineText(line);
+    if (m_charWidth > 0 && text.length() > MaxLineWidth / m_charWidth) {
+        text.truncate(int(MaxLineWidth / m_charWidth) + 1);
+    }
+    if (text.isEmpty()) {
+        return visual;
+    }
+
+    // Lines that scroll back in, move, or are highlighted the same way
+    // again are found by their text and formats instead of laid out again
+    const QVector<QTextLayout::FormatRange> formats = m_document->lineFormats(line);
+    ContentHash hash;
+    hash.addData(text.constData(), text.length());
+    for (const QTextLayout::FormatRange &range : formats) {
+        const qint64 run[] = { range.start, range.length, qint64(range.format.foreground().color().rgba()),
+                               range.format.fontWeight(), range.format.fontItalic() };
+        hash.addData(reinterpret_cast<const char *>(run), sizeof(run));
+    }
+    const quint64 key = hash.result();
+    if (const VisualLine *cached = m_layoutCache.object(key)) {
+        return *cached;
+    }
+
+    QVector<GlyphAtlas::Run> runs;
+    const bool simple = m_atlas->isMonospace() && GlyphAtlas::isSimple(text) && GlyphAtlas::toRuns(formats, runs);
+
+    QTextLayout layout(text, m_font);
+    QTextLine textLine;
+    if (simple) {
+        visual.width = GlyphAtlas::visualColumn(text, text.length(), TabColumns) * m_charWidth;
+    } else {
+        QTextOption option;
+        option.setWrapMode(QTextOption::NoWrap);
+        option.setTabStopDistance(TabColumns * m_charWidth);
+        layout.setTextOption(option);
+        layout.setFormats(formats);
+        layout.beginLayout();
+        textLine = layout.createLine();
+        layout.endLayout();
+        visual.width = textLine.naturalTextWidth();
+    }
+
+    visual.version = ++m_nextVersion;
+    const qreal width = qMin(visual.width, qreal(MaxLineWidth));
+    if (width > 0) {
+        const qreal ratio = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+        visual.image = QImage(qCeil(width * ratio), qCeil(m_lineHeight * ratio), QImage::Format_ARGB32_Premultiplied);
+        visual.image.setDevicePixelRatio(ratio);
+        visual.image.fill(Qt::transparent);
+
+        QPainter painter(&visual.image);
+        if (simple) {
+            const qreal top = (m_lineHeight - m_atlas->ascent() - m_atlas->descent()) / 2;
+            m_atlas->draw(&painter, QPointF(0, top), text, runs, m_color, TabColumns);
+        } else {
+            painter.setPen(m_color);
+            layout.draw(&painter, QPointF(0, (m_lineHeight - textLine.height()) / 2));
+        }
+    }
+
+    // Cost in kilobytes
+    m_layoutCache.insert(key, new VisualLine(visual), int(visual.image.sizeInBytes() / 1024) + 1);
+    return visual;
+}
+
+void EditorView::updateCursorRectangle()
+{
+    QRectF rect;
+    if (m_document && m_lineHeight > 0) {
+        const int line = lineAt(m_cursor);
+        const qreal x = columnToX(lineText(line), m_cursor - lineStart(line));
+        rect = QRectF(m_leftPadding + x, m_topPadding + line * m_lineHeight, 1, m_lineHeight);
+    }
+
+    if (rect != m_cursorRect) {
+        m_cursorRect = rect;
+        update();
+        emit cursorRectangleChanged();
+        if (hasActiveFocus()) {
+            QGuiApplication::inputMethod()->update(Qt::ImCursorRectangle | Qt::ImCursorPosition);
+        }
+    }
+}
+
+void EditorView::updateContentSize()
+{
+    emit contentWidthChanged();
+    emit contentHeightChanged();
+    setContentX(m_contentX);
+    setContentY(m_contentY);
+}
+
+void EditorView::ensureCursorVisible()
+{
+    if (m_cursorRect.top() < m_contentY) {
+        setContentY(m_cursorRect.top() - m_topPadding);
+    } else if (m_cursorRect.bottom() > m_contentY + height()) {
+        setContentY(m_cursorRect.bottom() + m_topPadding - height());
+    }
+
+    // The cursor can be past the widest line laid out so far
+    if (m_cursorRect.right() - m_leftPadding > m_contentWidth) {
+        m_contentWidth = m_cursorRect.right() - m_leftPadding;
+        emit contentWidthChanged();
+    }
+    if (m_cursorRect.left() < m_contentX + m_leftPadding) {
+        setContentX(m_cursorRect.left() - m_leftPadding);
+    } else if (m_cursorRect.right() > m_contentX + width() - m_leftPadding) {
+        setContentX(m_cursorRect.right() + m_leftPadding - width());
+    }
+}
+
+void EditorView::moveCursor(int position, bool keepAnchor)
+{
+    const int oldStart = selectionStart();
+    const int oldEnd = selectionEnd();
+    const int oldCursor = m_cursor;
+
+    m_cursor = qBound(0, position, length());
+    if (!keepAnchor) {
+        m_anchor = m_cursor;
+    }
+
+    updateCursorRectangle();
+    ensureCursorVisible();
+    resetCursorBlink();
+
+    if (m_cursor != oldCursor) {
+        emit cursorPositionChanged();
+    }
+    if (selectionStart() != oldStart || selectionEnd() != oldEnd) {
+        emit selectionChanged();
+        polish();
+    }
+}
+
+void EditorView::replaceSelection(const QString &text)
+{
+    if (!m_document || m_document->isReadOnly()) {
+        return;
+    }
+
+    const int start = selectionStart();
+    const int end = selectionEnd();
+    if (start == end && text.isEmpty()) {
+        return;
+    }
+
+    m_editing = true;
+    m_document->replaceText(start, end - start, text);
+    m_editing = false;
+
+    moveCursor(start + text.length(), false);
+}
+
+void EditorView::resetCursorBlink()
+{
+    m_cursorVisible = true;
+    if (hasActiveFocus()) {
+        m_blinkTimer.start();
+    }
+    update();
+}
+
+int EditorView::lineCount() const
+{
+    return m_document ? m_document->lineCount() : 0;
+}
+
+int EditorView::lineAt(int position) const
+{
+    return m_document ? qMax(0, m_document->getLineNumber(position)) : 0;
+}
+
+int EditorView::lineStart(int line) const
+{
+    return m_document ? int(qMax(qint64(0), m_document->getLineStart(line))) : 0;
+}
+
+QString EditorView::lineText(int line) const
+{
+    return m_document ? m_document->getLine(line) : QString();
+}
+
+qreal EditorView::columnToX(const QString &text, int column) const
+{
+    if (column <= 0 || text.isEmpty()) {
+        return 0;
+    }
+
+    // Monospaced ASCII is plain column arithmetic
+    if (m_atlas->isMonospace() && GlyphAtlas::isSimple(text)) {
+        return GlyphAtlas::visualColumn(text, column, TabColumns) * m_charWidth;
+    }
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    option.setTabStopDistance(TabColumns * m_charWidth);
+    QTextLayout layout(text, m_font);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    QTextLine textLine = layout.createLine();
+    layout.endLayout();
+    return textLine.cursorToX(qMin(column, text.length()));
+}
+
+int EditorView::xToColumn(const QString &text, qreal x) const
+{
+    if (x <= 0 || text.isEmpty()) {
+        return 0;
+    }
+
+    // The nearest character boundary, a tab counting as its whole width
+    if (m_atlas->isMonospace() && GlyphAtlas::isSimple(text)) {
+        const qreal target = x / m_charWidth;
+        int visual = 0;
+        for (int i = 0; i < text.length(); ++i) {
+            const int next = text.at(i) == QLatin1Char('\t') ? (visual / TabColumns + 1) * TabColumns : visual + 1;
+            if (target < (visual + next) / 2.0) {
+                return i;
+            }
+            visual = next;
+        }
+        return text.length();
+    }
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    option.setTabStopDistance(TabColumns * m_charWidth);
+    QTextLayout layout(text, m_font);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    QTextLine textLine = layout.createLine();
+    layout.endLayout();
+    return textLine.xToCursor(x);
+}
+
+int EditorView::wordStart(int position) const
+{
+    // At the start of a line, the previous word is the line break before it
+    const int line = lineAt(position);
+    const int start = lineStart(line);
+    if (position <= start) {
+        return qMax(0, position - 1);
+    }
+
+    const QString text = lineText(line);
+    int column = qMin(position - start, text.length());
+    while (column > 0 && text.at(column - 1).isSpace()) {
+        --column;
+    }
+    const bool inWord = column > 0 && isWordCharacter(text.at(column - 1));
+    while (column > 0 && !text.at(column - 1).isSpace() && isWordCharacter(text.at(column - 1)) == inWord) {
+        --column;
+    }
+    return start + column;
+}
+
+int EditorView::wordEnd(int position) const
+{
+    const int line = lineAt(position);
+    const int start = lineStart(line);
+    const QString text = lineText(line);
+    int column = position - start;
+    if (column >= text.length()) {
+        return qMin(length(), position + 1);
+    }
+
+    while (column < text.length() && text.at(column).isSpace()) {
+        ++column;
+    }
+    const bool inWord = column < text.length() && isWordCharacter(text.at(column));
+    while (column < text.length() && !text.at(column).isSpace() && isWordCharacter(text.at(column)) == inWord) {
+        ++column;
+    }
+    return start + column;
+}
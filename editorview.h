@@ -0,0 +1,211 @@
+#ifndef EDITORVIEW_H
+#define EDITORVIEW_H
+
+#include <QQuickItem>
+#include <QCache>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QTimer>
+#include <QVector>
+#include "glyphatlas.h"
+#include "textdocument.h"
+
+// Editor surface drawn straight from a TextDocument's buffer.
+//
+// Only the lines in view, plus a margin above and below, are laid out.
+// Each is painted once into an image that becomes the texture of its own
+// scene graph node. Scrolling moves a single transform; lines that scroll
+// in reuse the nodes of lines that scrolled out, and an edit repaints only
+// the lines it touched. Memory and the cost of a keystroke depend on the
+// height of the view, not on the length of the file. Painted lines are
+// also cached by their text and formats, so a line scrolled back into view
+// or highlighted the same way again is not laid out twice, and lines of
+// plain ASCII in a monospaced font skip QTextLayout (see GlyphAtlas).
+//
+// Edits go through the document, so undo, journaling and other views of
+// the same file see them like any other change. Properties are named
+// after TextArea's where they mean the same.
+class EditorView : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(TextDocument *document READ document WRITE setDocument NOTIFY documentChanged)
+    Q_PROPERTY(QFont font READ font WRITE setFont NOTIFY fontChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor selectionColor READ selectionColor WRITE setSelectionColor NOTIFY selectionColorChanged)
+    Q_PROPERTY(qreal leftPadding READ leftPadding WRITE setLeftPadding NOTIFY paddingChanged)
+    Q_PROPERTY(qreal topPadding READ topPadding WRITE setTopPadding NOTIFY paddingChanged)
+    Q_PROPERTY(qreal lineHeight READ lineHeight NOTIFY fontChanged)
+    Q_PROPERTY(int length READ length NOTIFY textChanged)
+    Q_PROPERTY(int cursorPosition READ cursorPosition WRITE setCursorPosition NOTIFY cursorPositionChanged)
+    Q_PROPERTY(QRectF cursorRectangle READ cursorRectangle NOTIFY cursorRectangleChanged)
+    Q_PROPERTY(int selectionStart READ selectionStart NOTIFY selectionChanged)
+    Q_PROPERTY(int selectionEnd READ selectionEnd NOTIFY selectionChanged)
+    Q_PROPERTY(QString selectedText READ selectedText NOTIFY selectionChanged)
+    Q_PROPERTY(qreal contentX READ contentX WRITE setContentX NOTIFY contentXChanged)
+    Q_PROPERTY(qreal contentY READ contentY WRITE setContentY NOTIFY contentYChanged)
+    Q_PROPERTY(qreal contentWidth READ contentWidth NOTIFY contentWidthChanged)
+    Q_PROPERTY(qreal contentHeight READ contentHeight NOTIFY contentHeightChanged)
+
+public:
+    explicit EditorView(QQuickItem *parent = nullptr);
+    ~EditorView();
+
+    TextDocument *document() const;
+    void setDocument(TextDocument *document);
+    QFont font() const;
+    void setFont(const QFont &font);
+    QColor color() const;
+    void setColor(const QColor &color);
+    QColor selectionColor() const;
+    void setSelectionColor(const QColor &color);
+    qreal leftPadding() const;
+    void setLeftPadding(qreal padding);
+    qreal topPadding() const;
+    void setTopPadding(qreal padding);
+    qreal lineHeight() const;
+    int length() const;
+
+    // Positions are offsets into the document, rectangles are in content
+    // coordinates like those of a TextArea inside a Flickable
+    int cursorPosition() const;
+    void setCursorPosition(int position);
+    QRectF cursorRectangle() const;
+    int selectionStart() const;
+    int selectionEnd() const;
+    QString selectedText() const;
+
+    qreal contentX() const;
+    void setContentX(qreal contentX);
+    qreal contentY() const;
+    void setContentY(qreal contentY);
+    qreal contentWidth() const;
+    qreal contentHeight() const;
+
+    Q_INVOKABLE void select(int start, int end);
+    Q_INVOKABLE void selectAll();
+    Q_INVOKABLE void insert(int position, const QString &text);
+    Q_INVOKABLE void copy();
+    Q_INVOKABLE void cut();
+    Q_INVOKABLE void paste();
+    Q_INVOKABLE int positionAt(qreal x, qreal y) const;
+
+    QVariant inputMethodQuery(Qt::InputMethodQuery query) const override;
+
+signals:
+    void documentChanged();
+    void fontChanged();
+    void colorChanged();
+    void selectionColorChanged();
+    void paddingChanged();
+    void textChanged();
+    void cursorPositionChanged();
+    void cursorRectangleChanged();
+    void selectionChanged();
+    void contentXChanged();
+    void contentYChanged();
+    void contentWidthChanged();
+    void contentHeightChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void updatePolish() override;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+#else
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+#endif
+    void keyPressEvent(QKeyEvent *event) override;
+    void inputMethodEvent(QInputMethodEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void focusInEvent(QFocusEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+    void itemChange(ItemChange change, const ItemChangeData &value) override;
+
+private:
+    // A line laid out and painted. The image is kept after it is uploaded,
+    // in case the scene graph is rebuilt; only lines near the view have one.
+    struct VisualLine
+    {
+        QImage image;
+        qreal width;
+        quint64 version;
+    };
+
+    // Lines kept laid out above and below the view
+    static const int OverscanLines = 20;
+    // Lines wider than this are cut off
+    static const int MaxLineWidth = 8192;
+    static const int CursorBlinkInterval = 500;
+    static const int TabColumns = 4;
+    // Painted lines kept by text and formats, in kilobytes
+    static const int LayoutCacheSize = 16 * 1024;
+
+    void handleTextEdited(int position, int charsRemoved, int charsAdded);
+    void handleContentChanged();
+    void invalidateLines(int first, int last);
+    void invalidateAll();
+    VisualLine renderLine(int line);
+    void updateCursorRectangle();
+    void updateContentSize();
+    void ensureCursorVisible();
+    void moveCursor(int position, bool keepAnchor);
+    void replaceSelection(const QString &text);
+    void resetCursorBlink();
+
+    // Line and column helpers
+    int lineCount() const;
+    int lineAt(int position) const;
+    int lineStart(int line) const;
+    QString lineText(int line) const;
+    qreal columnToX(const QString &text, int column) const;
+    int xToColumn(const QString &text, qreal x) const;
+    int wordStart(int position) const;
+    int wordEnd(int position) const;
+
+    QPointer<TextDocument> m_document;
+    QFont m_font;
+    QColor m_color;
+    QColor m_selectionColor;
+    qreal m_leftPadding;
+    qreal m_topPadding;
+    qreal m_lineHeight;
+    qreal m_charWidth;
+    QSharedPointer<const GlyphAtlas> m_atlas;
+
+    int m_cursor;
+    int m_anchor;
+    // Horizontal position kept while moving up and down
+    qreal m_preferredX;
+    QRectF m_cursorRect;
+    bool m_cursorVisible;
+    QTimer m_blinkTimer;
+    // Set while this view makes an edit, which places the cursor itself
+    bool m_editing;
+    // Set while undoing, the cursor follows the change
+    bool m_undoing;
+    // Set by textEdited(); a content change without one replaced the text
+    bool m_editSeen;
+
+    qreal m_contentX;
+    qreal m_contentY;
+    // Widest line laid out so far; the full width is never computed
+    qreal m_contentWidth;
+    int m_lineCount;
+
+    // Lines in and around the view by line number, and the version each
+    // was painted at; nodes repaint when their version is out of date
+    QHash<int, VisualLine> m_lines;
+    quint64 m_nextVersion;
+    QCache<quint64, VisualLine> m_layoutCache;
+    // Selection rectangles of the lines in view, in content coordinates
+    QVector<QRectF> m_selectionRects;
+};
+
+#endif // EDITORVIEW_H
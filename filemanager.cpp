@@ -4,8 +4,10 @@
 #include <QDir>
 #include <QTextStream>
 #include <QDebug>
-#include <QQuickTextDocument>
-#include "syntaxhighlighter.h"
+#include <QRegularExpression>
+
+// Files at least this large are opened read-only through a memory mapping
+static const qint64 MappedFileThreshold = Q_INT64_C(512) * 1024 * 1024;
 
 FileManager::FileManager(QObject *parent)
     : QObject(parent)
@@ -14,6 +16,7 @@ FileManager::FileManager(QObject *parent)
     , m_currentFolder("")
 {
     // Connect signals for automatic updates
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &FileManager::handleFileChangedOnDisk);
 }
 
 FileManager::~FileManager()
@@ -38,7 +41,11 @@ bool FileManager::openFile(const QString &filePath)
 
     // Create a new TextDocument
     QSharedPointer<TextDocument> document = QSharedPointer<TextDocument>::create(this);
-    if (!document->loadFile(filePath)) {
+    // Everything else is read and decoded on a worker thread
+    bool loaded = QFileInfo(filePath).size() >= MappedFileThreshold
+        ? document->loadFileMapped(filePath)
+        : document->loadFileAsync(filePath);
+    if (!loaded) {
         emit errorOccurred(tr("Failed to load file: %1").arg(filePath));
         return false;
     }
@@ -58,10 +65,118 @@ bool FileManager::openFile(const QString &filePath)
         }
     });
 
+    TextDocument *doc = document.data();
+
+    // Feeds the line number gutter without going through the text
+    connect(doc, &TextDocument::lineCountChanged, this, [this, doc](int lineCount) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileLineCountChanged(index, lineCount);
+        }
+    });
+
+    connect(doc, &TextDocument::loadProgressChanged, this, [this, doc](qreal progress) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileLoadProgressChanged(index, progress);
+        }
+    });
+
+    connect(doc, &TextDocument::loadingChanged, this, [this, doc](bool loading) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileLoadingChanged(index, loading);
+        }
+    });
+
+    // A cancelled or failed load leaves a partial buffer, drop the tab
+    connect(doc, &TextDocument::loadFinished, this, [this, doc](bool completed) {
+        int index = findDocumentIndex(doc);
+        if (index != -1 && !completed) {
+            removeFile(index);
+        } else if (index != -1 && m_pendingReveals.contains(doc)) {
+            reveal(index, m_pendingReveals.take(doc));
+        }
+    });
+
+    connect(doc, &TextDocument::loadFailed, this, [this, doc](const QString &error) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit errorOccurred(tr("Failed to load file: %1 (%2)").arg(m_filePaths[index], error));
+            removeFile(index);
+        }
+    });
+
+    // Saves run in the background, failures are reported when they happen
+    connect(doc, &TextDocument::saveFinished, this, [this, doc](const QString &filePath) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            // A file saved under a new name did not exist to be watched
+            watchFile(filePath);
+            emit fileSaved(index);
+        }
+    });
+
+    connect(doc, &TextDocument::saveFailed, this, [this](const QString &filePath, const QString &error) {
+        emit errorOccurred(tr("Failed to save file: %1 (%2)").arg(filePath, error));
+    });
+
+    // Changes made by other programs
+    connect(doc, &TextDocument::changedOnDisk, this, [this, doc]() {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileChangedOnDisk(index);
+        }
+    });
+
+    connect(doc, &TextDocument::reloaded, this, [this, doc]() {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileReloaded(index);
+        }
+    });
+
+    connect(doc, &TextDocument::followingChanged, this, [this, doc](bool following) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileFollowingChanged(index, following);
+        }
+    });
+
+    connect(doc, &TextDocument::followAppended, this, [this, doc](int position, int length) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileFollowAppended(index, position, length);
+        }
+    });
+
+    // Search results stream in while the search runs
+    connect(doc, &TextDocument::searchMatchesFound, this, [this, doc](int matchCount) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileSearchMatchesFound(index, matchCount);
+        }
+    });
+
+    connect(doc, &TextDocument::searchFinished, this, [this, doc](int matchCount) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileSearchFinished(index, matchCount);
+        }
+    });
+
+    connect(doc, &TextDocument::replaceAllFinished, this, [this, doc](int replacementCount) {
+        int index = findDocumentIndex(doc);
+        if (index != -1) {
+            emit fileReplaceAllFinished(index, replacementCount);
+        }
+    });
+
     // Add to our collections
     m_documents.append(document);
     m_filePaths.append(filePath);
     m_fileNames.append(extractFileName(filePath));
+    watchFile(filePath);
 
     // Apply syntax highlighting based on file extension
     QString fileExtension = extractFileExtension(filePath);
@@ -92,6 +207,127 @@ bool FileManager::closeFile(int index)
         return false;
     }
 
+    removeFile(index);
+
+    return true;
+}
+
+bool FileManager::openFileAt(const QString &filePath, int line, int column, int length)
+{
+    if (!openFile(filePath)) {
+        return false;
+    }
+
+    int index = findFileIndex(filePath);
+    if (index == -1) {
+        return false;
+    }
+
+    Reveal target = { line, column, length };
+    if (m_documents[index]->isLoading()) {
+        m_pendingReveals.insert(m_documents[index].data(), target);
+    } else {
+        reveal(index, target);
+    }
+    return true;
+}
+
+void FileManager::reveal(int index, const Reveal &reveal)
+{
+    const TextDocument *document = m_documents[index].data();
+    int line = qBound(0, reveal.line, qMax(0, document->lineCount() - 1));
+    int position = -1;
+    if (!document->isReadOnly()) {
+        position = int(document->getLineStart(line)) + qMin(reveal.column, document->getLineLength(line));
+    }
+    emit fileRevealRequested(index, line, position, reveal.length);
+}
+
+void FileManager::reloadFile(int index)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        emit errorOccurred(tr("Invalid file index: %1").arg(index));
+        return;
+    }
+
+    m_documents[index]->reloadFromDisk(true);
+}
+
+bool FileManager::isFileFollowing(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return false;
+    }
+
+    return m_documents[index]->isFollowing();
+}
+
+void FileManager::setFileFollowing(int index, bool following)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        emit errorOccurred(tr("Invalid file index: %1").arg(index));
+        return;
+    }
+
+    TextDocument *document = m_documents[index].data();
+    document->setFollowing(following);
+    if (following && !document->isFollowing()) {
+        emit errorOccurred(tr("Cannot follow file: %1").arg(m_filePaths[index]));
+    }
+}
+
+int FileManager::getFollowLineLimit(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return 0;
+    }
+
+    return m_documents[index]->followLineLimit();
+}
+
+void FileManager::setFollowLineLimit(int index, int lines)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        emit errorOccurred(tr("Invalid file index: %1").arg(index));
+        return;
+    }
+
+    m_documents[index]->setFollowLineLimit(lines);
+}
+
+void FileManager::watchFile(const QString &filePath)
+{
+    if (QFileInfo::exists(filePath) && !m_fileWatcher.files().contains(filePath)) {
+        m_fileWatcher.addPath(filePath);
+    }
+}
+
+void FileManager::handleFileChangedOnDisk(const QString &filePath)
+{
+    int index = findFileIndex(filePath);
+    if (index == -1) {
+        return;
+    }
+
+    // Editors that save by replacing the file drop it from the watcher
+    watchFile(filePath);
+    m_documents[index]->reloadFromDisk();
+}
+
+void FileManager::removeFile(int index)
+{
+    m_fileWatcher.removePath(m_filePaths[index]);
+    m_pendingReveals.remove(m_documents[index].data());
+
+    // Stop a background load of a file that is going away
+    m_documents[index]->cancelLoading();
+    m_documents[index]->discardJournal();
+
     // Update active index if needed
     if (m_activeFileIndex == index) {
         if (m_documents.size() > 1) {
@@ -115,8 +351,6 @@ bool FileManager::closeFile(int index)
 
     // Notify of changes
     emit openFilesChanged();
-
-    return true;
 }
 
 QString FileManager::getFileContent(int index) const
@@ -137,6 +371,19 @@ bool FileManager::saveFile(int index)
         return false;
     }
 
+    if (m_documents[index]->isLoading()) {
+        emit errorOccurred(tr("File is still loading: %1").arg(m_filePaths[index]));
+        return false;
+    }
+
+    // Saving would write the replacement characters over the original bytes,
+    // or one line ending style over all lines
+    if (m_documents[index]->isLossy()) {
+        emit errorOccurred(tr("File contains invalid bytes or mixed line endings, save it under another name: %1")
+                           .arg(m_filePaths[index]));
+        return false;
+    }
+
     // Save the file
     if (!m_documents[index]->saveFile(m_filePaths[index])) {
         emit errorOccurred(tr("Failed to save file: %1").arg(m_filePaths[index]));
@@ -154,13 +401,21 @@ bool FileManager::saveFileAs(int index, const QString &filePath)
         return false;
     }
 
+    if (m_documents[index]->isLoading()) {
+        emit errorOccurred(tr("File is still loading: %1").arg(m_filePaths[index]));
+        return false;
+    }
+
     // Save the file
     if (!m_documents[index]->saveFile(filePath)) {
         emit errorOccurred(tr("Failed to save file: %1").arg(filePath));
         return false;
     }
 
-    // Update file path and name
+    // Update file path and name; the new path is watched once it is written
+    if (m_filePaths[index] != filePath) {
+        m_fileWatcher.removePath(m_filePaths[index]);
+    }
     m_filePaths[index] = filePath;
     m_fileNames[index] = extractFileName(filePath);
 
@@ -214,6 +469,147 @@ void FileManager::setFileContent(int index, const QString &content)
     m_documents[index]->setContent(content);
 }
 
+void FileManager::findAllInFile(int index, const QString &pattern, bool caseSensitive, bool regularExpression)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        emit errorOccurred(tr("Invalid file index: %1").arg(index));
+        return;
+    }
+
+    if (!isValidSearch(pattern, regularExpression)) {
+        m_documents[index]->cancelSearch();
+        emit fileSearchFinished(index, 0);
+        return;
+    }
+
+    m_documents[index]->findAll(pattern, caseSensitive, regularExpression);
+}
+
+void FileManager::cancelFileSearch(int index)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return;
+    }
+
+    m_documents[index]->cancelSearch();
+}
+
+int FileManager::getSearchMatchPosition(int index, int match) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return -1;
+    }
+
+    return m_documents[index]->searchMatchPosition(match);
+}
+
+int FileManager::getSearchMatchLength(int index, int match) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return 0;
+    }
+
+    return m_documents[index]->searchMatchLength(match);
+}
+
+int FileManager::getSearchMatchAfter(int index, int position) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return 0;
+    }
+
+    return m_documents[index]->searchMatchAfter(position);
+}
+
+void FileManager::replaceAllInFile(int index, const QString &pattern, const QString &replacement,
+                                   bool caseSensitive, bool regularExpression)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        emit errorOccurred(tr("Invalid file index: %1").arg(index));
+        return;
+    }
+
+    if (!isValidSearch(pattern, regularExpression)) {
+        emit fileReplaceAllFinished(index, 0);
+        return;
+    }
+
+    m_documents[index]->replaceAll(pattern, replacement, caseSensitive, regularExpression);
+}
+
+void FileManager::undo(int index)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return;
+    }
+
+    m_documents[index]->undo();
+}
+
+void FileManager::redo(int index)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return;
+    }
+
+    m_documents[index]->redo();
+}
+
+void FileManager::recoverJournals()
+{
+    const QStringList journals = EditJournal::existingJournals();
+    for (const QString &journalPath : journals) {
+        EditJournal::Contents contents;
+        if (!EditJournal::read(journalPath, contents) || !fileExists(contents.filePath)) {
+            QFile::remove(journalPath);
+            continue;
+        }
+
+        // The journal stays until the edits are replayed; the reopened
+        // document then journals them again at the same path
+        if (!openFile(contents.filePath)) {
+            continue;
+        }
+
+        TextDocument *doc = m_documents[findFileIndex(contents.filePath)].data();
+        if (!doc->isLoading()) {
+            recoverDocument(doc, contents, journalPath);
+            continue;
+        }
+
+        QSharedPointer<QMetaObject::Connection> connection(new QMetaObject::Connection);
+        *connection = connect(doc, &TextDocument::loadFinished, this,
+                              [this, doc, contents, journalPath, connection](bool completed) {
+            disconnect(*connection);
+            if (completed) {
+                recoverDocument(doc, contents, journalPath);
+            }
+        });
+    }
+}
+
+void FileManager::recoverDocument(TextDocument *document, const EditJournal::Contents &contents, const QString &journalPath)
+{
+    if (!document->recoverJournal(contents)) {
+        emit errorOccurred(tr("Could not recover unsaved changes, the file changed on disk: %1").arg(contents.filePath));
+        QFile::remove(journalPath);
+        return;
+    }
+
+    // Nothing was replayed, so no new journal took its place
+    if (!document->isDirty()) {
+        QFile::remove(journalPath);
+    }
+}
+
 bool FileManager::createNewFile(const QString &fileName)
 {
     // Create a full path
@@ -237,6 +633,66 @@ bool FileManager::createNewFile(const QString &fileName)
     return openFile(filePath);
 }
 
+bool FileManager::isFileReadOnly(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return false;
+    }
+
+    return m_documents[index]->isReadOnly();
+}
+
+int FileManager::getLineCount(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return 0;
+    }
+
+    return m_documents[index]->lineCount();
+}
+
+QString FileManager::getLine(int index, int lineNumber) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return "";
+    }
+
+    return m_documents[index]->getLine(lineNumber);
+}
+
+bool FileManager::isFileLoading(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return false;
+    }
+
+    return m_documents[index]->isLoading();
+}
+
+qreal FileManager::getLoadProgress(int index) const
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return 1.0;
+    }
+
+    return m_documents[index]->loadProgress();
+}
+
+void FileManager::cancelLoading(int index)
+{
+    // Validate index
+    if (index < 0 || index >= m_documents.size()) {
+        return;
+    }
+
+    m_documents[index]->cancelLoading();
+}
+
 QStringList FileManager::openFiles() const
 {
     return m_fileNames;
@@ -296,6 +752,16 @@ int FileManager::findFileIndex(const QString &filePath) const
     return m_filePaths.indexOf(filePath);
 }
 
+int FileManager::findDocumentIndex(const TextDocument *document) const
+{
+    for (int i = 0; i < m_documents.size(); ++i) {
+        if (m_documents[i].data() == document) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 bool FileManager::handleDocumentChange(int index)
 {
     if (index >= 0 && index < m_documents.size()) {
@@ -305,41 +771,34 @@ bool FileManager::handleDocumentChange(int index)
     return false;
 }
 
+bool FileManager::isValidSearch(const QString &pattern, bool regularExpression)
+{
+    if (!regularExpression) {
+        return true;
+    }
+
+    QRegularExpression regex(pattern);
+    if (!regex.isValid()) {
+        emit errorOccurred(tr("Invalid regular expression: %1").arg(regex.errorString()));
+        return false;
+    }
+    return true;
+}
+
 QString FileManager::extractFileExtension(const QString &filePath) const
 {
     return QFileInfo(filePath).suffix();
 }
 
-// New methods for syntax highlighting integration
-
-QTextDocument* FileManager::getTextDocument(int index) const
+TextDocument *FileManager::getDocument(int index) const
 {
     // Validate index
     if (index < 0 || index >= m_documents.size()) {
         return nullptr;
     }
 
-    return m_documents[index]->document();
-}
-
-void FileManager::createSyntaxHighlighter(QObject* textDocument, const QString &fileExtension)
-{
-    // Convert QML's QQuickTextDocument to QTextDocument
-    QQuickTextDocument *qmlTextDoc = qobject_cast<QQuickTextDocument*>(textDocument);
-    if (!qmlTextDoc) {
-        emit errorOccurred(tr("Invalid text document object"));
-        return;
-    }
-
-    QTextDocument *document = qmlTextDoc->textDocument();
-    if (!document) {
-        emit errorOccurred(tr("Failed to get QTextDocument"));
-        return;
-    }
-
-    // Create syntax highlighter directly on the QML TextArea's document
-    SyntaxHighlighter *highlighter = new SyntaxHighlighter(document);
-    highlighter->setLanguage(fileExtension);
+    // Parented to this manager, so QML never takes ownership
+    return m_documents[index].data();
 }
 
 void FileManager::applySyntaxHighlighting(int index, const QString &fileExtension)
@@ -4,6 +4,8 @@
 #include <QStringList>
 #include <QSharedPointer>
 #include <QMap>
+#include <QHash>
+#include <QFileSystemWatcher>
 #include "textdocument.h"
 
 class FileManager : public QObject
@@ -29,11 +31,49 @@ public:
     Q_INVOKABLE QString getFilePath(int index) const;
     Q_INVOKABLE void setFileContent(int index, const QString &content);
     Q_INVOKABLE bool createNewFile(const QString &fileName);
+    // Opens a file and selects a range once its content is there
+    Q_INVOKABLE bool openFileAt(const QString &filePath, int line, int column, int length);
 
-    // New methods for syntax highlighting integration
-    Q_INVOKABLE QTextDocument* getTextDocument(int index) const;
+    // Reopens files with edits left unsaved by a crash
+    void recoverJournals();
+
+    // Document behind an EditorView
+    Q_INVOKABLE TextDocument *getDocument(int index) const;
+    Q_INVOKABLE void undo(int index);
+    Q_INVOKABLE void redo(int index);
+
+    // Line access, used by the read-only view of mapped files
+    Q_INVOKABLE bool isFileReadOnly(int index) const;
+    Q_INVOKABLE int getLineCount(int index) const;
+    Q_INVOKABLE QString getLine(int index, int lineNumber) const;
+
+    // Background loading
+    Q_INVOKABLE bool isFileLoading(int index) const;
+    Q_INVOKABLE qreal getLoadProgress(int index) const;
+    Q_INVOKABLE void cancelLoading(int index);
+
+    // Takes the file's text from disk, discarding unsaved changes
+    Q_INVOKABLE void reloadFile(int index);
+
+    // Follow mode for growing files such as logs
+    Q_INVOKABLE bool isFileFollowing(int index) const;
+    Q_INVOKABLE void setFileFollowing(int index, bool following);
+    Q_INVOKABLE int getFollowLineLimit(int index) const;
+    Q_INVOKABLE void setFollowLineLimit(int index, int lines);
+
+    // Find and replace within a file
+    Q_INVOKABLE void findAllInFile(int index, const QString &pattern, bool caseSensitive, bool regularExpression);
+    Q_INVOKABLE void cancelFileSearch(int index);
+    // Matches of the last search, by number in order of position
+    Q_INVOKABLE int getSearchMatchPosition(int index, int match) const;
+    Q_INVOKABLE int getSearchMatchLength(int index, int match) const;
+    Q_INVOKABLE int getSearchMatchAfter(int index, int position) const;
+    // Reported by fileReplaceAllFinished()
+    Q_INVOKABLE void replaceAllInFile(int index, const QString &pattern, const QString &replacement,
+                                      bool caseSensitive, bool regularExpression);
+
+    // Syntax highlighting, computed by the document for its views
     Q_INVOKABLE void applySyntaxHighlighting(int index, const QString &fileExtension);
-    Q_INVOKABLE void createSyntaxHighlighter(QObject* textDocument, const QString &fileExtension);
     Q_INVOKABLE QString getFileExtension(int index) const;
 
     // Property accessors
@@ -52,6 +92,18 @@ signals:
     void currentFolderChanged();
     void fileContentChanged(int index);
     void fileDirtyChanged(int index, bool isDirty);
+    void fileLineCountChanged(int index, int lineCount);
+    void fileLoadingChanged(int index, bool loading);
+    void fileLoadProgressChanged(int index, qreal progress);
+    void fileSaved(int index);
+    void fileChangedOnDisk(int index);
+    void fileReloaded(int index);
+    void fileFollowingChanged(int index, bool following);
+    void fileFollowAppended(int index, int position, int length);
+    void fileRevealRequested(int index, int line, int position, int length);
+    void fileSearchMatchesFound(int index, int matchCount);
+    void fileSearchFinished(int index, int matchCount);
+    void fileReplaceAllFinished(int index, int replacementCount);
     void errorOccurred(const QString &error);
 
 private:
@@ -61,12 +113,30 @@ private:
     int m_activeFileIndex;
     bool m_explorerVisible;
     QString m_currentFolder;
+    // Open files, to notice changes made by other programs
+    QFileSystemWatcher m_fileWatcher;
+
+    // Selection to show when a file opened by openFileAt() finishes loading
+    struct Reveal
+    {
+        int line;
+        int column;
+        int length;
+    };
+    QHash<const TextDocument *, Reveal> m_pendingReveals;
 
     // Helper methods
     QString extractFileName(const QString &filePath) const;
     bool fileExists(const QString &filePath) const;
     int findFileIndex(const QString &filePath) const;
+    int findDocumentIndex(const TextDocument *document) const;
+    void removeFile(int index);
+    void reveal(int index, const Reveal &reveal);
+    void watchFile(const QString &filePath);
+    void handleFileChangedOnDisk(const QString &filePath);
+    void recoverDocument(TextDocument *document, const EditJournal::Contents &contents, const QString &journalPath);
     bool handleDocumentChange(int index);
+    bool isValidSearch(const QString &pattern, bool regularExpression);
     QString extractFileExtension(const QString &filePath) const;
 };
 #endif // FILEMANAGER_H
@@ -0,0 +1,188 @@
+#include "glyphatlas.h"
+#include <QGlyphRun>
+#include <QHash>
+#include <QPainter>
+#include <QWeakPointer>
+#include <QtMath>
+
+GlyphAtlas::GlyphAtlas(const QFont &font)
+    : m_advance(0)
+    , m_ascent(0)
+    , m_descent(0)
+    , m_monospace(false)
+{
+    QString characters;
+    for (int i = 0; i < CharacterCount; ++i) {
+        characters.append(QChar(ushort(FirstCharacter + i)));
+    }
+
+    QPointF advances[CharacterCount];
+    for (int style = 0; style < StyleCount; ++style) {
+        QFont styled(font);
+        styled.setBold(style & Bold);
+        styled.setItalic(style & Italic);
+        m_fonts[style] = QRawFont::fromFont(styled);
+
+        int count = CharacterCount;
+        if (!m_fonts[style].isValid()
+                || !m_fonts[style].glyphIndexesForChars(characters.constData(), CharacterCount, m_glyphs[style], &count)
+                || count != CharacterCount) {
+            return;
+        }
+
+        // Every glyph of every style has to take the same room
+        if (!m_fonts[style].advancesForGlyphIndexes(m_glyphs[style], advances, CharacterCount)) {
+            return;
+        }
+        if (style == Regular) {
+            m_advance = advances[0].x();
+        }
+        for (int i = 0; i < CharacterCount; ++i) {
+            if (m_glyphs[style][i] == 0 || qAbs(advances[i].x() - m_advance) > 0.01) {
+                return;
+            }
+        }
+    }
+
+    m_ascent = m_fonts[Regular].ascent();
+    m_descent = m_fonts[Regular].descent();
+    m_monospace = m_advance > 0;
+}
+
+QSharedPointer<const GlyphAtlas> GlyphAtlas::forFont(const QFont &font)
+{
+    // One per font while any view uses it; views all live on the GUI thread
+    static QHash<QString, QWeakPointer<const GlyphAtlas>> atlases;
+
+    const QString key = font.key();
+    QSharedPointer<const GlyphAtlas> atlas = atlases.value(key).toStrongRef();
+    if (!atlas) {
+        atlas = QSharedPointer<const GlyphAtlas>(new GlyphAtlas(font));
+        atlases.insert(key, atlas);
+    }
+    return atlas;
+}
+
+bool GlyphAtlas::isMonospace() const
+{
+    return m_monospace;
+}
+
+qreal GlyphAtlas::advance() const
+{
+    return m_advance;
+}
+
+qreal GlyphAtlas::ascent() const
+{
+    return m_ascent;
+}
+
+qreal GlyphAtlas::descent() const
+{
+    return m_descent;
+}
+
+bool GlyphAtlas::isSimple(const QString &text)
+{
+    const QChar *data = text.constData();
+    const int length = text.length();
+    for (int i = 0; i < length; ++i) {
+        const ushort c = data[i].unicode();
+        if ((c < FirstCharacter || c >= FirstCharacter + CharacterCount) && c != '\t') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GlyphAtlas::toRuns(const QVector<QTextLayout::FormatRange> &formats, QVector<Run> &runs)
+{
+    runs.clear();
+    runs.reserve(formats.size());
+    for (const QTextLayout::FormatRange &range : formats) {
+        const QMap<int, QVariant> properties = range.format.properties();
+        for (auto it = properties.constBegin(); it != properties.constEnd(); ++it) {
+            if (it.key() != QTextFormat::ForegroundBrush && it.key() != QTextFormat::FontWeight
+                    && it.key() != QTextFormat::FontItalic) {
+                return false;
+            }
+        }
+
+        int style = Regular;
+        if (range.format.fontWeight() > QFont::Normal) {
+            style |= Bold;
+        }
+        if (range.format.fontItalic()) {
+            style |= Italic;
+        }
+        const QColor color = range.format.hasProperty(QTextFormat::ForegroundBrush)
+            ? range.format.foreground().color() : QColor();
+        runs.append({ range.start, range.length, color, style });
+    }
+    return true;
+}
+
+int GlyphAtlas::visualColumn(const QString &text, int length, int tabColumns)
+{
+    const QChar *data = text.constData();
+    length = qMin(length, text.length());
+    int column = 0;
+    for (int i = 0; i < length; ++i) {
+        column = data[i] == QLatin1Char('\t') ? (column / tabColumns + 1) * tabColumns : column + 1;
+    }
+    return column;
+}
+
+void GlyphAtlas::draw(QPainter *painter, const QPointF &origin, const QString &text, const QVector<Run> &runs,
+                      const QColor &color, int tabColumns) const
+{
+    // Run of every character; the highlighter's ranges do not overlap,
+    // a later one wins if they do
+    const int length = text.length();
+    QVector<int> runOf(length, -1);
+    for (int i = 0; i < runs.size(); ++i) {
+        const Run &run = runs.at(i);
+        const int end = qMin(length, run.start + run.length);
+        for (int c = qMax(0, run.start); c < end; ++c) {
+            runOf[c] = i;
+        }
+    }
+
+    const QChar *data = text.constData();
+    QVector<quint32> glyphs;
+    QVector<QPointF> positions;
+    int column = 0;
+    int start = 0;
+    while (start < length) {
+        // One glyph run per stretch of characters of the same run
+        const int run = runOf.at(start);
+        const int style = run >= 0 ? runs.at(run).style : Regular;
+        glyphs.clear();
+        positions.clear();
+
+        int end = start;
+        for (; end < length && runOf.at(end) == run; ++end) {
+            const ushort c = data[end].unicode();
+            if (c == '\t') {
+                column = (column / tabColumns + 1) * tabColumns;
+                continue;
+            }
+            if (c != ' ') {
+                glyphs.append(m_glyphs[style][c - FirstCharacter]);
+                positions.append(QPointF(column * m_advance, m_ascent));
+            }
+            ++column;
+        }
+
+        if (!glyphs.isEmpty()) {
+            QGlyphRun glyphRun;
+            glyphRun.setRawFont(m_fonts[style]);
+            glyphRun.setGlyphIndexes(glyphs);
+            glyphRun.setPositions(positions);
+            painter->setPen(run >= 0 && runs.at(run).color.isValid() ? runs.at(run).color : color);
+            painter->drawGlyphRun(origin, glyphRun);
+        }
+        start = end;
+    }
+}
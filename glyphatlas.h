@@ -0,0 +1,77 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include <QColor>
+#include <QFont>
+#include <QRawFont>
+#include <QSharedPointer>
+#include <QString>
+#include <QTextLayout>
+#include <QVector>
+
+class QPainter;
+
+// Printable ASCII glyphs of a monospaced font, in its four styles.
+//
+// Glyph indices and the advance are looked up once per font and shared by
+// every editor using it. Lines made only of these characters are drawn as
+// glyph runs placed by column arithmetic, skipping the itemizing and
+// shaping QTextLayout does for every line; the rasterized glyphs come from
+// the paint engine's glyph cache, which is itself one atlas per font shared
+// by all painters. Other lines, and fonts that turn out not to be
+// monospaced, go through QTextLayout.
+class GlyphAtlas
+{
+public:
+    enum Style {
+        Regular = 0,
+        Bold = 1,
+        Italic = 2,
+        BoldItalic = Bold | Italic
+    };
+
+    // Characters [start, start + length) in one colour and style; an
+    // invalid colour is the view's text colour
+    struct Run
+    {
+        int start;
+        int length;
+        QColor color;
+        int style;
+    };
+
+    static QSharedPointer<const GlyphAtlas> forFont(const QFont &font);
+
+    bool isMonospace() const;
+    qreal advance() const;
+    qreal ascent() const;
+    qreal descent() const;
+
+    // Whether every character is in the atlas; tabs are, as tab stops
+    static bool isSimple(const QString &text);
+    // Converts highlighter formats, false if they set more than colour,
+    // weight and slant
+    static bool toRuns(const QVector<QTextLayout::FormatRange> &formats, QVector<Run> &runs);
+    // Column reached after the first length characters, tabs included
+    static int visualColumn(const QString &text, int length, int tabColumns);
+
+    // Draws a simple line with the top of its glyph box at origin
+    void draw(QPainter *painter, const QPointF &origin, const QString &text, const QVector<Run> &runs,
+              const QColor &color, int tabColumns) const;
+
+private:
+    explicit GlyphAtlas(const QFont &font);
+
+    static const ushort FirstCharacter = 0x20;
+    static const int CharacterCount = 0x7f - 0x20;
+    static const int StyleCount = 4;
+
+    QRawFont m_fonts[StyleCount];
+    quint32 m_glyphs[StyleCount][CharacterCount];
+    qreal m_advance;
+    qreal m_ascent;
+    qreal m_descent;
+    bool m_monospace;
+};
+
+#endif // GLYPHATLAS_H
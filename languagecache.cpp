@@ -0,0 +1,403 @@
+#include "languagecache.h"
+#include "contenthash.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QVector>
+#include <algorithm>
+
+static const QDataStream::Version StreamVersion = QDataStream::Qt_5_0;
+
+static QStringList stringList(const QJsonValue &value)
+{
+    QStringList list;
+    const QJsonArray array = value.toArray();
+    for (const QJsonValue &item : array) {
+        if (item.isString()) {
+            list.append(item.toString());
+        }
+    }
+    return list;
+}
+
+static void addData(ContentHash &hash, qint64 value)
+{
+    hash.addData(reinterpret_cast<const char *>(&value), qint64(sizeof(value)));
+}
+
+bool LanguageCache::View::open(const uchar *data, qint64 size)
+{
+    *this = View();
+    if (size < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    const Header *candidate = reinterpret_cast<const Header *>(data);
+    if (candidate->magic != Magic || candidate->version != Version) {
+        return false;
+    }
+
+    const qint64 languagesSize = qint64(candidate->languageCount) * qint64(sizeof(LanguageEntry));
+    const qint64 extensionsSize = qint64(candidate->extensionCount) * qint64(sizeof(ExtensionEntry));
+    if (qint64(sizeof(Header)) + languagesSize + extensionsSize + candidate->tablesSize + candidate->stringsSize
+        != size) {
+        return false;
+    }
+
+    const LanguageEntry *languageEntries = reinterpret_cast<const LanguageEntry *>(data + sizeof(Header));
+    const ExtensionEntry *extensionEntries =
+        reinterpret_cast<const ExtensionEntry *>(data + sizeof(Header) + languagesSize);
+    for (quint32 i = 0; i < candidate->languageCount; ++i) {
+        const LanguageEntry &entry = languageEntries[i];
+        if (quint64(entry.nameOffset) + entry.nameLength > candidate->stringsSize
+            || quint64(entry.tablesOffset) + entry.tablesSize > candidate->tablesSize) {
+            return false;
+        }
+    }
+    for (quint32 i = 0; i < candidate->extensionCount; ++i) {
+        const ExtensionEntry &entry = extensionEntries[i];
+        if (quint64(entry.extensionOffset) + entry.extensionLength > candidate->stringsSize
+            || entry.language >= candidate->languageCount) {
+            return false;
+        }
+    }
+
+    header = candidate;
+    languages = languageEntries;
+    extensions = extensionEntries;
+    tables = data + sizeof(Header) + languagesSize + extensionsSize;
+    strings = reinterpret_cast<const char *>(tables + header->tablesSize);
+    return true;
+}
+
+QByteArray LanguageCache::View::string(quint32 offset, quint32 length) const
+{
+    return QByteArray::fromRawData(strings + offset, int(length));
+}
+
+const LanguageCache::LanguageEntry *LanguageCache::View::findLanguage(const QByteArray &name) const
+{
+    const LanguageEntry *end = languages + header->languageCount;
+    const LanguageEntry *entry = std::lower_bound(languages, end, name, [this](const LanguageEntry &e, const QByteArray &n) {
+        return string(e.nameOffset, e.nameLength) < n;
+    });
+    return (entry != end && string(entry->nameOffset, entry->nameLength) == name) ? entry : nullptr;
+}
+
+const LanguageCache::ExtensionEntry *LanguageCache::View::findExtension(const QByteArray &extension) const
+{
+    const ExtensionEntry *end = extensions + header->extensionCount;
+    const ExtensionEntry *entry = std::lower_bound(extensions, end, extension,
+                                                   [this](const ExtensionEntry &e, const QByteArray &x) {
+        return string(e.extensionOffset, e.extensionLength) < x;
+    });
+    return (entry != end && string(entry->extensionOffset, entry->extensionLength) == extension) ? entry : nullptr;
+}
+
+LanguageCache::LanguageCache()
+    : m_data(nullptr)
+{
+    const QStringList files = definitionFiles();
+    const quint64 stamp = stampOf(files);
+    if (mapCache(stamp)) {
+        return;
+    }
+
+    // Missing or stale, built again from every definition
+    const QByteArray cache = build(files, stamp);
+    const QString path = cachePath();
+    QFile file(path + ".new");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(cache) == cache.size()) {
+        file.close();
+        QFile::remove(path);
+        if (QFile::rename(file.fileName(), path) && mapCache(stamp)) {
+            return;
+        }
+    }
+    file.remove();
+
+    m_built = cache;
+    m_view.open(reinterpret_cast<const uchar *>(m_built.constData()), m_built.size());
+}
+
+LanguageCache::~LanguageCache()
+{
+    unmapCache();
+}
+
+LanguageCache &LanguageCache::instance()
+{
+    static LanguageCache cache;
+    return cache;
+}
+
+QSharedPointer<const SyntaxLexer> LanguageCache::loadLexer(const QString &name)
+{
+    LanguageCache &cache = instance();
+    QMutexLocker locker(&cache.m_mutex);
+
+    const LanguageEntry *entry = cache.m_view.isValid() ? cache.m_view.findLanguage(name.toUtf8()) : nullptr;
+    if (!entry) {
+        return QSharedPointer<const SyntaxLexer>();
+    }
+
+    // Only the tables are copied out of the cache, nothing is compiled
+    const QByteArray tables = QByteArray::fromRawData(
+        reinterpret_cast<const char *>(cache.m_view.tables + entry->tablesOffset), int(entry->tablesSize));
+    QDataStream stream(tables);
+    stream.setVersion(StreamVersion);
+
+    QSharedPointer<SyntaxLexer> lexer(new SyntaxLexer(SyntaxLexer::Definition()));
+    if (!lexer->readTables(stream)) {
+        return QSharedPointer<const SyntaxLexer>();
+    }
+    return lexer;
+}
+
+QString LanguageCache::languageForExtension(const QString &extension)
+{
+    LanguageCache &cache = instance();
+    QMutexLocker locker(&cache.m_mutex);
+
+    const ExtensionEntry *entry = cache.m_view.isValid() ? cache.m_view.findExtension(extension.toUtf8()) : nullptr;
+    if (!entry) {
+        return QString();
+    }
+    const LanguageEntry &language = cache.m_view.languages[entry->language];
+    return QString::fromUtf8(cache.m_view.string(language.nameOffset, language.nameLength));
+}
+
+QStringList LanguageCache::languages()
+{
+    LanguageCache &cache = instance();
+    QMutexLocker locker(&cache.m_mutex);
+
+    QStringList names;
+    if (!cache.m_view.isValid()) {
+        return names;
+    }
+    for (quint32 i = 0; i < cache.m_view.header->languageCount; ++i) {
+        const LanguageEntry &language = cache.m_view.languages[i];
+        names.append(QString::fromUtf8(cache.m_view.string(language.nameOffset, language.nameLength)));
+    }
+    return names;
+}
+
+bool LanguageCache::parseDefinition(const QByteArray &json, SyntaxLexer::Definition &definition, QString &error)
+{
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(json, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        error = parseError.errorString();
+        return false;
+    }
+    if (!document.isObject()) {
+        error = "not a JSON object";
+        return false;
+    }
+
+    const QJsonObject object = document.object();
+    definition = SyntaxLexer::Definition();
+    definition.name = object.value("name").toString();
+    if (definition.name.isEmpty()) {
+        error = "no name";
+        return false;
+    }
+
+    for (const QString &extension : stringList(object.value("extensions"))) {
+        definition.extensions.append(extension.toLower());
+    }
+    definition.lineComment = object.value("lineComment").toString();
+    const QStringList blockComment = stringList(object.value("blockComment"));
+    if (blockComment.size() == 2) {
+        definition.blockCommentStart = blockComment.at(0);
+        definition.blockCommentEnd = blockComment.at(1);
+    }
+
+    const QJsonArray strings = object.value("strings").toArray();
+    for (const QJsonValue &value : strings) {
+        const QJsonObject string = value.toObject();
+        SyntaxLexer::StringRule rule;
+        rule.open = string.value("open").toString();
+        if (rule.open.isEmpty()) {
+            error = "string without \"open\"";
+            return false;
+        }
+        rule.close = string.value("close").toString(rule.open);
+        const QString escape = string.value("escape").toString();
+        rule.escape = escape.isEmpty() ? QChar() : escape.at(0);
+        rule.multiLine = string.value("multiLine").toBool();
+        definition.strings.append(rule);
+    }
+
+    definition.preprocessor = object.value("preprocessor").toString();
+    definition.keywords = stringList(object.value("keywords"));
+    definition.typeIntroducers = stringList(object.value("typeIntroducers"));
+    definition.functionIntroducers = stringList(object.value("functionIntroducers"));
+    definition.highlightCalls = object.value("highlightCalls").toBool();
+    return true;
+}
+
+QString LanguageCache::cachePath()
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(directory);
+    return directory + "/languages.cache";
+}
+
+QString LanguageCache::userDefinitionsPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/languages";
+}
+
+QStringList LanguageCache::definitionFiles()
+{
+    // Built-in first, so user definitions of the same name replace them
+    QStringList files;
+    const QStringList directories = QStringList() << ":/languages" << userDefinitionsPath();
+    for (const QString &path : directories) {
+        const QDir directory(path);
+        const QStringList names = directory.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
+        for (const QString &name : names) {
+            files.append(directory.filePath(name));
+        }
+    }
+    return files;
+}
+
+quint64 LanguageCache::stampOf(const QStringList &files)
+{
+    // Built-in definitions are in memory and hashed whole; the others are
+    // only looked at when their size or modification time changed
+    ContentHash hash(Version);
+    for (const QString &path : files) {
+        hash.addData(path.constData(), path.length());
+        if (path.startsWith(":/")) {
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly)) {
+                const QByteArray contents = file.readAll();
+                hash.addData(contents.constData(), contents.size());
+            }
+        } else {
+            const QFileInfo info(path);
+            addData(hash, info.size());
+            addData(hash, info.lastModified().toMSecsSinceEpoch());
+        }
+    }
+    return hash.result();
+}
+
+QByteArray LanguageCache::build(const QStringList &files, quint64 stamp)
+{
+    // By UTF-8 name and extension, the order lookups search in
+    QMap<QByteArray, SyntaxLexer::Definition> definitions;
+    QMap<QByteArray, QByteArray> extensions;
+    for (const QString &path : files) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        SyntaxLexer::Definition definition;
+        QString error;
+        if (!parseDefinition(file.readAll(), definition, error)) {
+            qWarning() << "Skipping language definition" << path << ":" << error;
+            continue;
+        }
+
+        const QByteArray name = definition.name.toUtf8();
+        for (const QString &extension : std::as_const(definition.extensions)) {
+            extensions.insert(extension.toUtf8(), name);
+        }
+        definitions.insert(name, definition);
+    }
+
+    QByteArray strings;
+    auto addString = [&strings](const QByteArray &text, quint32 &offset, quint32 &length) {
+        offset = quint32(strings.size());
+        length = quint32(text.size());
+        strings.append(text);
+    };
+
+    QByteArray tables;
+    QVector<LanguageEntry> languageEntries;
+    QHash<QByteArray, quint32> languageNumbers;
+    for (auto it = definitions.cbegin(); it != definitions.cend(); ++it) {
+        LanguageEntry entry;
+        addString(it.key(), entry.nameOffset, entry.nameLength);
+
+        const SyntaxLexer lexer(it.value());
+        QDataStream stream(&tables, QIODevice::WriteOnly | QIODevice::Append);
+        stream.setVersion(StreamVersion);
+        entry.tablesOffset = quint32(tables.size());
+        lexer.writeTables(stream);
+        entry.tablesSize = quint32(tables.size()) - entry.tablesOffset;
+
+        languageNumbers.insert(it.key(), quint32(languageEntries.size()));
+        languageEntries.append(entry);
+    }
+
+    QVector<ExtensionEntry> extensionEntries;
+    for (auto it = extensions.cbegin(); it != extensions.cend(); ++it) {
+        ExtensionEntry entry;
+        addString(it.key(), entry.extensionOffset, entry.extensionLength);
+        entry.language = languageNumbers.value(it.value());
+        extensionEntries.append(entry);
+    }
+
+    Header header;
+    header.magic = Magic;
+    header.version = Version;
+    header.stamp = stamp;
+    header.languageCount = quint32(languageEntries.size());
+    header.extensionCount = quint32(extensionEntries.size());
+    header.tablesSize = quint32(tables.size());
+    header.stringsSize = quint32(strings.size());
+
+    QByteArray cache;
+    cache.append(reinterpret_cast<const char *>(&header), int(sizeof(header)));
+    cache.append(reinterpret_cast<const char *>(languageEntries.constData()),
+                 int(languageEntries.size() * sizeof(LanguageEntry)));
+    cache.append(reinterpret_cast<const char *>(extensionEntries.constData()),
+                 int(extensionEntries.size() * sizeof(ExtensionEntry)));
+    cache.append(tables);
+    cache.append(strings);
+    return cache;
+}
+
+bool LanguageCache::mapCache(quint64 stamp)
+{
+    m_file.setFileName(cachePath());
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    m_data = size > 0 ? m_file.map(0, size) : nullptr;
+    if (!m_data || !m_view.open(m_data, size) || m_view.header->stamp != stamp) {
+        unmapCache();
+        return false;
+    }
+    return true;
+}
+
+void LanguageCache::unmapCache()
+{
+    m_view = View();
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
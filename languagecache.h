@@ -0,0 +1,128 @@
+#ifndef LANGUAGECACHE_H
+#define LANGUAGECACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include "syntaxlexer.h"
+
+// Language definitions, compiled once into a memory mapped cache.
+//
+// A language is a JSON file describing a SyntaxLexer::Definition. The
+// built-in ones are resources under :/languages; files in the "languages"
+// folder of the application data replace them by name or add new ones.
+// Every definition is compiled into its lexer tables, which are written to
+// one cache file together with an index of languages and file extensions.
+//
+// Starting up only maps the cache and compares its stamp, a hash of the
+// built-in definitions and of the size and modification time of the user
+// ones. Nothing is parsed or compiled until a language is used, and then
+// only its tables are read from the mapping. When a definition changed, the
+// cache is built again from all of them. It is kept in memory if it cannot be
+// written.
+//
+// A definition file looks like:
+//
+//   {
+//       "name": "cpp",
+//       "extensions": ["cpp", "h"],
+//       "lineComment": "//",
+//       "blockComment": ["/*", "*/"],
+//       "strings": [{ "open": "\"", "close": "\"", "escape": "\\", "multiLine": false }],
+//       "preprocessor": "#",
+//       "keywords": ["class", "return"],
+//       "typeIntroducers": ["class"],
+//       "functionIntroducers": [],
+//       "highlightCalls": true
+//   }
+//
+// Only "name" is required; "close" defaults to "open".
+class LanguageCache
+{
+public:
+    // Lexer of a language from the cache, null if no definition has its name
+    static QSharedPointer<const SyntaxLexer> loadLexer(const QString &name);
+    // Language claiming a lower-case file extension, empty if none does
+    static QString languageForExtension(const QString &extension);
+    static QStringList languages();
+
+    // Reads a definition file; false with the reason in error if it is not one
+    static bool parseDefinition(const QByteArray &json, SyntaxLexer::Definition &definition, QString &error);
+
+    static QString cachePath();
+    static QString userDefinitionsPath();
+
+private:
+    // Layout of the cache file, all in host byte order
+    static const quint32 Magic = 0x574c4e47; // "WLNG"
+    // Also to be bumped when the tables of SyntaxLexer change
+    static const quint32 Version = 1;
+
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint64 stamp;
+        quint32 languageCount;
+        quint32 extensionCount;
+        quint32 tablesSize;
+        quint32 stringsSize;
+    };
+
+    // Sorted by name; the tables are written by SyntaxLexer::writeTables()
+    struct LanguageEntry
+    {
+        quint32 nameOffset;
+        quint32 nameLength;
+        quint32 tablesOffset;
+        quint32 tablesSize;
+    };
+
+    // Sorted by extension
+    struct ExtensionEntry
+    {
+        quint32 extensionOffset;
+        quint32 extensionLength;
+        quint32 language;
+    };
+
+    // Read-only view of a cache, mapped or in memory
+    struct View
+    {
+        const Header *header = nullptr;
+        const LanguageEntry *languages = nullptr;
+        const ExtensionEntry *extensions = nullptr;
+        const uchar *tables = nullptr;
+        const char *strings = nullptr;
+
+        bool isValid() const { return header != nullptr; }
+        bool open(const uchar *data, qint64 size);
+        QByteArray string(quint32 offset, quint32 length) const;
+        const LanguageEntry *findLanguage(const QByteArray &name) const;
+        const ExtensionEntry *findExtension(const QByteArray &extension) const;
+    };
+
+    LanguageCache();
+    ~LanguageCache();
+
+    static LanguageCache &instance();
+
+    static QStringList definitionFiles();
+    static quint64 stampOf(const QStringList &files);
+    static QByteArray build(const QStringList &files, quint64 stamp);
+
+    bool mapCache(quint64 stamp);
+    void unmapCache();
+
+    QMutex m_mutex;
+    QFile m_file;
+    uchar *m_data;
+    // The cache when it could not be written
+    QByteArray m_built;
+    View m_view;
+};
+
+#endif // LANGUAGECACHE_H
@@ -0,0 +1,150 @@
+#include "linediff.h"
+#include <QHash>
+#include <QStringView>
+
+QVector<int> LineDiff::lineOffsets(const QString &text)
+{
+    QVector<int> offsets;
+    offsets.append(0);
+
+    const QChar *data = text.constData();
+    const int length = text.length();
+    for (int i = 0; i < length; ++i) {
+        if (data[i] == QLatin1Char('\n') && i + 1 < length) {
+            offsets.append(i + 1);
+        }
+    }
+
+    if (length > 0) {
+        offsets.append(length);
+    }
+    return offsets;
+}
+
+QVector<LineDiff::Hunk> LineDiff::compute(const QString &oldText, const QVector<int> &oldOffsets,
+                                          const QString &newText, const QVector<int> &newOffsets)
+{
+    // Equal lines get equal numbers
+    QHash<QStringView, int> numbers;
+    auto intern = [&numbers](const QString &text, const QVector<int> &offsets) {
+        QVector<int> lines;
+        lines.reserve(offsets.size() - 1);
+        for (int i = 0; i + 1 < offsets.size(); ++i) {
+            const QStringView line = QStringView(text).mid(offsets.at(i), offsets.at(i + 1) - offsets.at(i));
+            lines.append(numbers.insert(line, numbers.value(line, numbers.size())).value());
+        }
+        return lines;
+    };
+    const QVector<int> oldLines = intern(oldText, oldOffsets);
+    const QVector<int> newLines = intern(newText, newOffsets);
+
+    // Only the middle needs the full comparison
+    int head = 0;
+    while (head < oldLines.size() && head < newLines.size() && oldLines.at(head) == newLines.at(head)) {
+        ++head;
+    }
+    int tail = 0;
+    while (tail < oldLines.size() - head && tail < newLines.size() - head
+           && oldLines.at(oldLines.size() - 1 - tail) == newLines.at(newLines.size() - 1 - tail)) {
+        ++tail;
+    }
+
+    return diff(oldLines.mid(head, oldLines.size() - head - tail),
+                newLines.mid(head, newLines.size() - head - tail), head);
+}
+
+QVector<LineDiff::Hunk> LineDiff::diff(const QVector<int> &a, const QVector<int> &b, int offset)
+{
+    const int n = a.size();
+    const int m = b.size();
+    QVector<Hunk> hunks;
+    if (n == 0 && m == 0) {
+        return hunks;
+    }
+
+    const Hunk whole = { offset, n, offset, m };
+    if (n == 0 || m == 0) {
+        hunks.append(whole);
+        return hunks;
+    }
+
+    // v[k + maxD] is the furthest x reached on diagonal k; trace[d] keeps
+    // diagonals -d..d after step d for walking back
+    const int maxD = qMin(n + m, int(MaxEditDistance));
+    QVector<int> v(2 * maxD + 3, 0);
+    QVector<QVector<int>> trace;
+    int distance = -1;
+
+    for (int d = 0; d <= maxD && distance < 0; ++d) {
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v.at(maxD + k - 1) < v.at(maxD + k + 1))) {
+                x = v.at(maxD + k + 1);
+            } else {
+                x = v.at(maxD + k - 1) + 1;
+            }
+            int y = x - k;
+            while (x < n && y < m && a.at(x) == b.at(y)) {
+                ++x;
+                ++y;
+            }
+            v[maxD + k] = x;
+            if (x >= n && y >= m) {
+                distance = d;
+                break;
+            }
+        }
+        trace.append(v.mid(maxD - d, 2 * d + 1));
+    }
+
+    if (distance < 0) {
+        hunks.append(whole);
+        return hunks;
+    }
+
+    // Walk back collecting the runs of equal lines, last first
+    struct Run
+    {
+        int x;
+        int y;
+        int length;
+    };
+    QVector<Run> runs;
+    int x = n;
+    int y = m;
+    for (int d = distance; d > 0; --d) {
+        const QVector<int> &previous = trace.at(d - 1);
+        const int k = x - y;
+        const bool inserted = k == -d || (k != d && previous.at(k - 1 + d - 1) < previous.at(k + 1 + d - 1));
+        const int previousK = inserted ? k + 1 : k - 1;
+        const int previousX = previous.at(previousK + d - 1);
+        const int previousY = previousX - previousK;
+
+        // The edit itself, then the run of equal lines up to (x, y)
+        const int startX = inserted ? previousX : previousX + 1;
+        if (x > startX) {
+            runs.append({ startX, y - (x - startX), x - startX });
+        }
+        x = previousX;
+        y = previousY;
+    }
+    if (x > 0) {
+        runs.append({ 0, 0, x });
+    }
+
+    // Everything between two runs changed
+    int oldPosition = 0;
+    int newPosition = 0;
+    for (int i = runs.size() - 1; i >= -1; --i) {
+        const int runX = i >= 0 ? runs.at(i).x : n;
+        const int runY = i >= 0 ? runs.at(i).y : m;
+        if (runX > oldPosition || runY > newPosition) {
+            hunks.append({ offset + oldPosition, runX - oldPosition, offset + newPosition, runY - newPosition });
+        }
+        if (i >= 0) {
+            oldPosition = runX + runs.at(i).length;
+            newPosition = runY + runs.at(i).length;
+        }
+    }
+    return hunks;
+}
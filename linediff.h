@@ -0,0 +1,39 @@
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include <QString>
+#include <QVector>
+
+// Line-based difference of two texts.
+//
+// Lines are interned to numbers, the common head and tail are cut off, and
+// the rest is compared with Myers' O(ND) algorithm. Very different texts,
+// beyond MaxEditDistance inserted and deleted lines, come back as a single
+// hunk instead of spending quadratic time and memory on them.
+class LineDiff
+{
+public:
+    // Lines [oldStart, oldStart + oldCount) of the old text are replaced by
+    // lines [newStart, newStart + newCount) of the new one
+    struct Hunk
+    {
+        int oldStart;
+        int oldCount;
+        int newStart;
+        int newCount;
+    };
+
+    // Start of every line, each keeping its '\n', plus the text length
+    static QVector<int> lineOffsets(const QString &text);
+
+    // Hunks in increasing order
+    static QVector<Hunk> compute(const QString &oldText, const QVector<int> &oldOffsets,
+                                 const QString &newText, const QVector<int> &newOffsets);
+
+private:
+    static const int MaxEditDistance = 4096;
+
+    static QVector<Hunk> diff(const QVector<int> &a, const QVector<int> &b, int offset);
+};
+
+#endif // LINEDIFF_H
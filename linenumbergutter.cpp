@@ -0,0 +1,207 @@
+#include "linenumbergutter.h"
+#include <QFontMetricsF>
+#include <QPainter>
+#include <cmath>
+
+LineNumberGutter::LineNumberGutter(QQuickItem *parent)
+    : QQuickPaintedItem(parent)
+    , m_lineCount(1)
+    , m_currentLine(-1)
+    , m_lineHeight(0)
+    , m_contentY(0)
+    , m_topPadding(0)
+    , m_horizontalPadding(5)
+    , m_color(Qt::gray)
+    , m_currentLineColor(Qt::white)
+    , m_digits(0)
+{
+    updateImplicitWidth();
+}
+
+int LineNumberGutter::lineCount() const
+{
+    return m_lineCount;
+}
+
+void LineNumberGutter::setLineCount(int lineCount)
+{
+    lineCount = qMax(0, lineCount);
+    if (m_lineCount == lineCount) {
+        return;
+    }
+
+    m_lineCount = lineCount;
+    updateImplicitWidth();
+    update();
+    emit lineCountChanged();
+}
+
+int LineNumberGutter::currentLine() const
+{
+    return m_currentLine;
+}
+
+void LineNumberGutter::setCurrentLine(int line)
+{
+    if (m_currentLine == line) {
+        return;
+    }
+
+    m_currentLine = line;
+    update();
+    emit currentLineChanged();
+}
+
+qreal LineNumberGutter::lineHeight() const
+{
+    return m_lineHeight;
+}
+
+void LineNumberGutter::setLineHeight(qreal height)
+{
+    if (qFuzzyCompare(m_lineHeight, height)) {
+        return;
+    }
+
+    m_lineHeight = height;
+    update();
+    emit lineHeightChanged();
+}
+
+qreal LineNumberGutter::contentY() const
+{
+    return m_contentY;
+}
+
+void LineNumberGutter::setContentY(qreal contentY)
+{
+    if (qFuzzyCompare(m_contentY, contentY)) {
+        return;
+    }
+
+    // Scrolling repaints the numbers in view, nothing else
+    m_contentY = contentY;
+    update();
+    emit contentYChanged();
+}
+
+qreal LineNumberGutter::topPadding() const
+{
+    return m_topPadding;
+}
+
+void LineNumberGutter::setTopPadding(qreal padding)
+{
+    if (qFuzzyCompare(m_topPadding, padding)) {
+        return;
+    }
+
+    m_topPadding = padding;
+    update();
+    emit topPaddingChanged();
+}
+
+qreal LineNumberGutter::horizontalPadding() const
+{
+    return m_horizontalPadding;
+}
+
+void LineNumberGutter::setHorizontalPadding(qreal padding)
+{
+    if (qFuzzyCompare(m_horizontalPadding, padding)) {
+        return;
+    }
+
+    m_horizontalPadding = padding;
+    m_digits = 0;
+    updateImplicitWidth();
+    update();
+    emit horizontalPaddingChanged();
+}
+
+QFont LineNumberGutter::font() const
+{
+    return m_font;
+}
+
+void LineNumberGutter::setFont(const QFont &font)
+{
+    if (m_font == font) {
+        return;
+    }
+
+    m_font = font;
+    m_digits = 0;
+    updateImplicitWidth();
+    update();
+    emit fontChanged();
+}
+
+QColor LineNumberGutter::color() const
+{
+    return m_color;
+}
+
+void LineNumberGutter::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+
+    m_color = color;
+    update();
+    emit colorChanged();
+}
+
+QColor LineNumberGutter::currentLineColor() const
+{
+    return m_currentLineColor;
+}
+
+void LineNumberGutter::setCurrentLineColor(const QColor &color)
+{
+    if (m_currentLineColor == color) {
+        return;
+    }
+
+    m_currentLineColor = color;
+    update();
+    emit currentLineColorChanged();
+}
+
+void LineNumberGutter::paint(QPainter *painter)
+{
+    if (m_lineCount <= 0 || m_lineHeight <= 0) {
+        return;
+    }
+
+    // Lines crossing the visible part of the editor
+    const qreal top = m_contentY - m_topPadding;
+    const int first = qMax(0, int(std::floor(top / m_lineHeight)));
+    const int last = qMin(m_lineCount - 1, int(std::floor((top + height()) / m_lineHeight)));
+
+    painter->setFont(m_font);
+    const qreal textWidth = width() - m_horizontalPadding;
+    for (int line = first; line <= last; ++line) {
+        const QRectF rect(0, line * m_lineHeight - top, textWidth, m_lineHeight);
+        painter->setPen(line == m_currentLine ? m_currentLineColor : m_color);
+        painter->drawText(rect, Qt::AlignRight | Qt::AlignVCenter, QString::number(line + 1));
+    }
+}
+
+void LineNumberGutter::updateImplicitWidth()
+{
+    // Room for two digits at least, so short files do not change width
+    int digits = 2;
+    for (int count = m_lineCount; count >= 100; count /= 10) {
+        ++digits;
+    }
+
+    if (digits == m_digits) {
+        return;
+    }
+
+    m_digits = digits;
+    const QFontMetricsF metrics(m_font);
+    setImplicitWidth(metrics.horizontalAdvance(QString(digits, QLatin1Char('9'))) + 2 * m_horizontalPadding);
+}
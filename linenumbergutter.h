@@ -0,0 +1,81 @@
+#ifndef LINENUMBERGUTTER_H
+#define LINENUMBERGUTTER_H
+
+#include <QQuickPaintedItem>
+#include <QColor>
+#include <QFont>
+
+// Line numbers beside an editor.
+//
+// Only the lines in view are painted, worked out from the line count, the
+// line height and the scroll position, so typing and scrolling neither
+// create items nor look at the text. Lines are taken to be of equal height,
+// which holds for the unwrapped monospaced editor. The implicit width
+// follows the number of digits of the last line.
+class LineNumberGutter : public QQuickPaintedItem
+{
+    Q_OBJECT
+    Q_PROPERTY(int lineCount READ lineCount WRITE setLineCount NOTIFY lineCountChanged)
+    Q_PROPERTY(int currentLine READ currentLine WRITE setCurrentLine NOTIFY currentLineChanged)
+    Q_PROPERTY(qreal lineHeight READ lineHeight WRITE setLineHeight NOTIFY lineHeightChanged)
+    Q_PROPERTY(qreal contentY READ contentY WRITE setContentY NOTIFY contentYChanged)
+    Q_PROPERTY(qreal topPadding READ topPadding WRITE setTopPadding NOTIFY topPaddingChanged)
+    Q_PROPERTY(qreal horizontalPadding READ horizontalPadding WRITE setHorizontalPadding NOTIFY horizontalPaddingChanged)
+    Q_PROPERTY(QFont font READ font WRITE setFont NOTIFY fontChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor currentLineColor READ currentLineColor WRITE setCurrentLineColor NOTIFY currentLineColorChanged)
+
+public:
+    explicit LineNumberGutter(QQuickItem *parent = nullptr);
+
+    int lineCount() const;
+    void setLineCount(int lineCount);
+    // Zero-based line of the cursor, -1 for none
+    int currentLine() const;
+    void setCurrentLine(int line);
+    qreal lineHeight() const;
+    void setLineHeight(qreal height);
+    // Scroll position of the editor, and the space above its first line
+    qreal contentY() const;
+    void setContentY(qreal contentY);
+    qreal topPadding() const;
+    void setTopPadding(qreal padding);
+    qreal horizontalPadding() const;
+    void setHorizontalPadding(qreal padding);
+    QFont font() const;
+    void setFont(const QFont &font);
+    QColor color() const;
+    void setColor(const QColor &color);
+    QColor currentLineColor() const;
+    void setCurrentLineColor(const QColor &color);
+
+    void paint(QPainter *painter) override;
+
+signals:
+    void lineCountChanged();
+    void currentLineChanged();
+    void lineHeightChanged();
+    void contentYChanged();
+    void topPaddingChanged();
+    void horizontalPaddingChanged();
+    void fontChanged();
+    void colorChanged();
+    void currentLineColorChanged();
+
+private:
+    void updateImplicitWidth();
+
+    int m_lineCount;
+    int m_currentLine;
+    qreal m_lineHeight;
+    qreal m_contentY;
+    qreal m_topPadding;
+    qreal m_horizontalPadding;
+    QFont m_font;
+    QColor m_color;
+    QColor m_currentLineColor;
+    // Digits the implicit width was computed for
+    int m_digits;
+};
+
+#endif // LINENUMBERGUTTER_H
@@ -6,7 +6,12 @@
 #include <QTextDocument>
 #include "filemanager.h"
 #include "theme.h"
+#include "editorview.h"
 #include "filetreemodel.h"
+#include "linenumbergutter.h"
+#include "minimap.h"
+#include "quickopenmodel.h"
+#include "workspacesearch.h"
 
 int main(int argc, char *argv[])
 {
@@ -30,6 +35,18 @@ int main(int argc, char *argv[])
     // Create the FileTreeModel instance
     FileTreeModel fileTreeModel;
 
+    // Create the project-wide search, rooted at the open folder
+    WorkspaceSearch workspaceSearch;
+    QObject::connect(&fileManager, &FileManager::currentFolderChanged, &workspaceSearch, [&]() {
+        workspaceSearch.setRootPath(fileManager.currentFolder());
+    });
+
+    // Create the quick-open file finder over the same folder
+    QuickOpenModel quickOpen;
+    QObject::connect(&fileManager, &FileManager::currentFolderChanged, &quickOpen, [&]() {
+        quickOpen.setRootPath(fileManager.currentFolder());
+    });
+
     QQmlApplicationEngine engine;
 
     // Add the application's QML directory to the import path
@@ -39,11 +56,17 @@ int main(int argc, char *argv[])
     // qmlRegisterType<Theme>("CustomComponents", 1, 0, "ThemeSettings");
     qmlRegisterType<QTextDocument>("com.wisteria.TextDocument", 1, 0, "QTextDocument");
     qmlRegisterType<FileTreeModel>("com.wisteria.FileTreeModel", 1, 0, "FileTreeModel");
+    qmlRegisterType<LineNumberGutter>("com.wisteria.LineNumberGutter", 1, 0, "LineNumberGutter");
+    qmlRegisterType<EditorView>("com.wisteria.EditorView", 1, 0, "EditorView");
+    qmlRegisterAnonymousType<TextDocument>("com.wisteria.EditorView", 1);
+    qmlRegisterType<Minimap>("com.wisteria.Minimap", 1, 0, "Minimap");
 
     // Expose FileManager and Theme to QML
     engine.rootContext()->setContextProperty("fileManager", &fileManager);
     engine.rootContext()->setContextProperty("theme", &theme);
     engine.rootContext()->setContextProperty("fileTreeModel", &fileTreeModel);
+    engine.rootContext()->setContextProperty("workspaceSearch", &workspaceSearch);
+    engine.rootContext()->setContextProperty("quickOpen", &quickOpen);
 
     // Load the main QML file
     const QUrl url(QStringLiteral("qrc:/wisteria/main.qml"));
@@ -54,5 +77,8 @@ int main(int argc, char *argv[])
                      }, Qt::QueuedConnection);
     engine.load(url);
 
+    // Restore edits left unsaved by a crash
+    fileManager.recoverJournals();
+
     return app.exec();
 }
@@ -7,6 +7,9 @@ import QtQuick.Layouts
 import QtQuick.Dialogs
 import Qt.labs.folderlistmodel
 import com.wisteria.FileTreeModel 1.0
+import com.wisteria.LineNumberGutter 1.0
+import com.wisteria.EditorView 1.0
+import com.wisteria.Minimap 1.0
 
 Window {
     id: root
@@ -16,6 +19,11 @@ Window {
     title: qsTr("Wisteria")
     color: theme.backgroundColor
 
+    // Project-wide search panel, toggled from the sidebar
+    property bool searchPanelVisible: false
+    // Document overview beside every editor, toggled from the View menu
+    property bool minimapVisible: true
+
     // Theme Settings Dialog
     Loader {
         id: themeSettingsLoader
@@ -110,11 +118,51 @@ Window {
                 font.pixelSize: 13
                 font.family: "JetBrains Mono Nerd Font"
             }
-            Text {
+            Button {
                 text: "View"
-                color: theme.menuTextColor
-                font.pixelSize: 13
-                font.family: "JetBrains Mono Nerd Font"
+                flat: true
+                contentItem: Text {
+                    text: parent.text
+                    color: theme.menuTextColor
+                    font.pixelSize: 13
+                    font.family: "JetBrains Mono Nerd Font"
+                }
+                onClicked: viewMenu.open()
+
+                Menu {
+                    id: viewMenu
+
+                    // Follow mode is kept per file, show the active one's
+                    onAboutToShow: {
+                        followMenuItem.checked = fileManager.isFileFollowing(fileManager.activeFileIndex)
+                        followLimitMenuItem.checked = fileManager.getFollowLineLimit(fileManager.activeFileIndex) > 0
+                    }
+
+                    MenuItem {
+                        id: followMenuItem
+                        text: "Follow File"
+                        checkable: true
+                        enabled: fileManager.activeFileIndex >= 0
+                        onTriggered: fileManager.setFileFollowing(fileManager.activeFileIndex, checked)
+                    }
+
+                    MenuItem {
+                        id: followLimitMenuItem
+                        text: "Keep Last 100,000 Lines"
+                        checkable: true
+                        enabled: fileManager.activeFileIndex >= 0
+                        onTriggered: fileManager.setFollowLineLimit(fileManager.activeFileIndex, checked ? 100000 : 0)
+                    }
+
+                    MenuSeparator {}
+
+                    MenuItem {
+                        text: "Show Minimap"
+                        checkable: true
+                        checked: root.minimapVisible
+                        onTriggered: root.minimapVisible = checked
+                    }
+                }
             }
             Text {
                 text: "Go"
@@ -213,6 +261,12 @@ Window {
                         anchors.horizontalCenter: parent.horizontalCenter
                         anchors.verticalCenter: parent.verticalCenter
                     }
+                    onClicked: {
+                        root.searchPanelVisible = !root.searchPanelVisible
+                        if (root.searchPanelVisible) {
+                            searchQueryField.forceActiveFocus()
+                        }
+                    }
                 }
 
                 Button {
@@ -504,6 +558,191 @@ Window {
                 }
             }
 
+            // Search Panel
+            Rectangle {
+                id: searchPanel
+                SplitView.preferredWidth: root.searchPanelVisible ? 300 : 0
+                SplitView.minimumWidth: 0
+                SplitView.maximumWidth: root.width * 0.4
+                visible: root.searchPanelVisible
+                color: theme.explorerColor
+
+                property bool caseSensitive: false
+
+                function search() {
+                    searchTimer.stop()
+                    workspaceSearch.search(searchQueryField.text, caseSensitive)
+                }
+
+                // Searching again is deferred while typing
+                Timer {
+                    id: searchTimer
+                    interval: 200
+                    onTriggered: searchPanel.search()
+                }
+
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: 5
+
+                    // Search header
+                    Rectangle {
+                        Layout.fillWidth: true
+                        height: 30
+                        color: "transparent"
+
+                        Text {
+                            anchors.left: parent.left
+                            anchors.leftMargin: 10
+                            anchors.verticalCenter: parent.verticalCenter
+                            text: "SEARCH"
+                            color: theme.menuTextColor
+                            font.pixelSize: 12
+                            font.bold: true
+                        }
+                    }
+
+                    RowLayout {
+                        Layout.fillWidth: true
+                        Layout.leftMargin: 10
+                        Layout.rightMargin: 10
+                        spacing: 4
+
+                        TextField {
+                            id: searchQueryField
+                            Layout.fillWidth: true
+                            placeholderText: "Search"
+                            enabled: fileManager.currentFolder !== ""
+                            color: theme.textColor
+                            placeholderTextColor: theme.lineNumberColor
+                            font.pixelSize: 12
+                            selectByMouse: true
+                            background: Rectangle {
+                                color: theme.backgroundColor
+                                border.width: 1
+                                border.color: theme.sidebarColor
+                            }
+                            onTextChanged: searchTimer.restart()
+                            Keys.onReturnPressed: searchPanel.search()
+                            Keys.onEscapePressed: workspaceSearch.cancel()
+                        }
+
+                        Button {
+                            Layout.preferredWidth: 28
+                            Layout.preferredHeight: 24
+                            flat: true
+                            checkable: true
+                            checked: searchPanel.caseSensitive
+                            text: "Aa"
+                            ToolTip.visible: hovered
+                            ToolTip.text: "Match case"
+                            onToggled: {
+                                searchPanel.caseSensitive = checked
+                                searchPanel.search()
+                            }
+                        }
+                    }
+
+                    Text {
+                        Layout.fillWidth: true
+                        Layout.leftMargin: 10
+                        Layout.rightMargin: 10
+                        text: fileManager.currentFolder === "" ? "Open a folder to search in it"
+                              : searchQueryField.text === "" ? ""
+                              : workspaceSearch.matchCount === 0
+                                ? (workspaceSearch.searching ? "Searching…" : "No results")
+                                : workspaceSearch.matchCount + " results in " + workspaceSearch.fileCount + " files"
+                                  + (workspaceSearch.truncated ? " (limited)" : "")
+                                  + (workspaceSearch.searching ? "…" : "")
+                        color: theme.menuTextColor
+                        font.pixelSize: 12
+                        elide: Text.ElideRight
+                    }
+
+                    // Results, grouped by file as they stream in
+                    ListView {
+                        id: searchResultsView
+                        Layout.fillWidth: true
+                        Layout.fillHeight: true
+                        clip: true
+                        boundsBehavior: Flickable.StopAtBounds
+                        model: workspaceSearch
+
+                        ScrollBar.vertical: ScrollBar {}
+
+                        section.property: "relativePath"
+                        section.delegate: Text {
+                            width: searchResultsView.width
+                            height: 22
+                            leftPadding: 10
+                            verticalAlignment: Text.AlignVCenter
+                            text: section
+                            color: theme.textColor
+                            font.pixelSize: 12
+                            font.bold: true
+                            elide: Text.ElideMiddle
+                        }
+
+                        delegate: Rectangle {
+                            width: searchResultsView.width
+                            height: 20
+                            color: resultMouseArea.containsMouse ? theme.sidebarColor : "transparent"
+                            clip: true
+
+                            Row {
+                                anchors.fill: parent
+                                anchors.leftMargin: 20
+                                spacing: 6
+
+                                Text {
+                                    anchors.verticalCenter: parent.verticalCenter
+                                    text: line + 1
+                                    color: theme.lineNumberColor
+                                    font.pixelSize: 12
+                                }
+
+                                // The match is shown in bold between its context
+                                Row {
+                                    anchors.verticalCenter: parent.verticalCenter
+
+                                    Text {
+                                        text: preview.substring(0, previewStart)
+                                        textFormat: Text.PlainText
+                                        color: theme.menuTextColor
+                                        font.family: "JetBrains Mono Nerd Font"
+                                        font.pixelSize: 12
+                                    }
+
+                                    Text {
+                                        text: preview.substring(previewStart, previewStart + matchLength)
+                                        textFormat: Text.PlainText
+                                        color: theme.textColor
+                                        font.family: "JetBrains Mono Nerd Font"
+                                        font.pixelSize: 12
+                                        font.bold: true
+                                    }
+
+                                    Text {
+                                        text: preview.substring(previewStart + matchLength)
+                                        textFormat: Text.PlainText
+                                        color: theme.menuTextColor
+                                        font.family: "JetBrains Mono Nerd Font"
+                                        font.pixelSize: 12
+                                    }
+                                }
+                            }
+
+                            MouseArea {
+                                id: resultMouseArea
+                                anchors.fill: parent
+                                hoverEnabled: true
+                                onClicked: fileManager.openFileAt(filePath, line, column, matchLength)
+                            }
+                        }
+                    }
+                }
+            }
+
             // Main content area
             Rectangle {
                 id: mainContentArea
@@ -672,144 +911,596 @@ Window {
                                 model: fileManager.openFiles
 
                                 Item {
+                                    id: editorItem
                                     // Container for editor and line numbers
+                                    property int fileIndex: index
+                                    // Very large files are mapped read-only and shown line by line
+                                    property bool readOnlyView: fileManager.isFileReadOnly(index)
+                                    // Other files are filled in chunks by a background loader
+                                    property bool loading: fileManager.isFileLoading(index)
+                                    property real loadProgress: fileManager.getLoadProgress(index)
+                                    // Kept up to date by the document, for the line number gutter
+                                    property int lineCount: fileManager.getLineCount(index)
+                                    // Set when another program changed the file under unsaved edits
+                                    property bool changedOnDisk: false
+
+                                    Connections {
+                                        target: fileManager
+                                        function onFileLoadingChanged(fileIndex, loading) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.loading = loading
+                                            }
+                                        }
+                                        function onFileLoadProgressChanged(fileIndex, progress) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.loadProgress = progress
+                                            }
+                                        }
+                                        function onFileLineCountChanged(fileIndex, lineCount) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.lineCount = lineCount
+                                            }
+                                        }
+                                        function onFileChangedOnDisk(fileIndex) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.changedOnDisk = true
+                                            }
+                                        }
+                                        function onFileReloaded(fileIndex) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.changedOnDisk = false
+                                            }
+                                        }
+                                        function onFileSaved(fileIndex) {
+                                            if (fileIndex === editorItem.fileIndex) {
+                                                editorItem.changedOnDisk = false
+                                            }
+                                        }
+                                        function onFileFollowAppended(fileIndex, position, length) {
+                                            // Stay at the end if that is where the cursor was
+                                            if (fileIndex === editorItem.fileIndex && textEdit.cursorPosition >= position) {
+                                                textEdit.cursorPosition = textEdit.length
+                                            }
+                                        }
+                                        function onFileRevealRequested(fileIndex, line, position, length) {
+                                            if (fileIndex !== editorItem.fileIndex) {
+                                                return
+                                            }
+                                            if (editorItem.readOnlyView) {
+                                                mappedView.positionViewAtIndex(line, ListView.Center)
+                                            } else {
+                                                textEdit.select(position, position + length)
+                                                textEdit.forceActiveFocus()
+                                            }
+                                        }
+                                    }
+
+                                    // Loading progress with a way to cancel
+                                    Rectangle {
+                                        id: loadingBar
+                                        anchors.top: parent.top
+                                        anchors.left: parent.left
+                                        anchors.right: parent.right
+                                        height: 24
+                                        visible: editorItem.loading
+                                        color: theme.explorerColor
+                                        z: 2
+
+                                        Rectangle {
+                                            anchors.bottom: parent.bottom
+                                            height: 2
+                                            width: parent.width * editorItem.loadProgress
+                                            color: "#55aaff"
+                                        }
+
+                                        RowLayout {
+                                            anchors.fill: parent
+                                            anchors.leftMargin: 10
+                                            anchors.rightMargin: 10
+
+                                            Text {
+                                                text: "Loading… " + Math.round(editorItem.loadProgress * 100) + "%"
+                                                color: theme.menuTextColor
+                                                font.pixelSize: 12
+                                                Layout.fillWidth: true
+                                            }
+
+                                            Button {
+                                                Layout.preferredHeight: 20
+                                                flat: true
+                                                text: "Cancel"
+                                                contentItem: Text {
+                                                    text: parent.text
+                                                    color: theme.textColor
+                                                    font.pixelSize: 12
+                                                    horizontalAlignment: Text.AlignHCenter
+                                                    verticalAlignment: Text.AlignVCenter
+                                                }
+                                                onClicked: fileManager.cancelLoading(editorItem.fileIndex)
+                                            }
+                                        }
+                                    }
+
+                                    // The file changed on disk while it has unsaved edits
+                                    Rectangle {
+                                        id: changedOnDiskBar
+                                        anchors.top: loadingBar.visible ? loadingBar.bottom : parent.top
+                                        anchors.left: parent.left
+                                        anchors.right: parent.right
+                                        height: 28
+                                        visible: editorItem.changedOnDisk
+                                        color: theme.explorerColor
+                                        z: 3
+
+                                        RowLayout {
+                                            anchors.fill: parent
+                                            anchors.leftMargin: 10
+                                            anchors.rightMargin: 10
+
+                                            Text {
+                                                text: "The file has changed on disk."
+                                                color: theme.menuTextColor
+                                                font.pixelSize: 12
+                                                Layout.fillWidth: true
+                                            }
+
+                                            Button {
+                                                Layout.preferredHeight: 22
+                                                flat: true
+                                                text: "Reload"
+                                                contentItem: Text {
+                                                    text: parent.text
+                                                    color: theme.textColor
+                                                    font.pixelSize: 12
+                                                    horizontalAlignment: Text.AlignHCenter
+                                                    verticalAlignment: Text.AlignVCenter
+                                                }
+                                                onClicked: fileManager.reloadFile(editorItem.fileIndex)
+                                            }
+
+                                            Button {
+                                                Layout.preferredHeight: 22
+                                                flat: true
+                                                text: "Keep My Changes"
+                                                contentItem: Text {
+                                                    text: parent.text
+                                                    color: theme.textColor
+                                                    font.pixelSize: 12
+                                                    horizontalAlignment: Text.AlignHCenter
+                                                    verticalAlignment: Text.AlignVCenter
+                                                }
+                                                onClicked: editorItem.changedOnDisk = false
+                                            }
+                                        }
+                                    }
+
+                                    // Find and replace, floats over the top right of the editor
+                                    Rectangle {
+                                        id: findBar
+                                        anchors.top: loadingBar.visible ? loadingBar.bottom : parent.top
+                                        anchors.right: parent.right
+                                        anchors.rightMargin: 20
+                                        width: 460
+                                        height: findColumn.implicitHeight + 12
+                                        visible: false
+                                        color: theme.explorerColor
+                                        border.color: Qt.rgba(0.3, 0.3, 0.3, 0.8)
+                                        z: 2
+
+                                        property bool caseSensitive: false
+                                        property bool regularExpression: false
+                                        // Matches of the last search found so far; the document
+                                        // keeps the matches themselves
+                                        property int matchCount: 0
+                                        property int current: -1
+                                        property bool searching: false
+
+                                        function open() {
+                                            visible = true
+                                            if (textEdit.selectedText.length > 0
+                                                    && textEdit.selectedText.indexOf("\n") === -1) {
+                                                findField.text = textEdit.selectedText
+                                            }
+                                            findField.forceActiveFocus()
+                                            findField.selectAll()
+                                            search()
+                                        }
+
+                                        function close() {
+                                            visible = false
+                                            fileManager.cancelFileSearch(editorItem.fileIndex)
+                                            matchCount = 0
+                                            current = -1
+                                            textEdit.forceActiveFocus()
+                                        }
+
+                                        function search() {
+                                            searchTimer.stop()
+                                            matchCount = 0
+                                            current = -1
+                                            if (findField.text.length === 0) {
+                                                fileManager.cancelFileSearch(editorItem.fileIndex)
+                                                searching = false
+                                                return
+                                            }
+                                            searching = true
+                                            fileManager.findAllInFile(editorItem.fileIndex, findField.text,
+                                                                      caseSensitive, regularExpression)
+                                        }
+
+                                        function select(matchIndex) {
+                                            if (matchCount === 0) {
+                                                return
+                                            }
+                                            current = (matchIndex + matchCount) % matchCount
+                                            var position = fileManager.getSearchMatchPosition(editorItem.fileIndex, current)
+                                            textEdit.select(position,
+                                                            position + fileManager.getSearchMatchLength(editorItem.fileIndex, current))
+                                        }
+
+                                        // First match at or after the cursor, or before it going backwards
+                                        function step(forward) {
+                                            if (matchCount === 0) {
+                                                return
+                                            }
+                                            if (current >= 0) {
+                                                select(current + (forward ? 1 : -1))
+                                                return
+                                            }
+                                            var i = fileManager.getSearchMatchAfter(editorItem.fileIndex, textEdit.selectionStart)
+                                            select(forward ? i : i - 1)
+                                        }
+
+                                        function replaceAll() {
+                                            if (findField.text.length === 0) {
+                                                return
+                                            }
+                                            // Searched again once the replacements are made
+                                            fileManager.replaceAllInFile(editorItem.fileIndex, findField.text,
+                                                                         replaceField.text, caseSensitive,
+                                                                         regularExpression)
+                                        }
+
+                                        // Searching again is deferred while typing or editing
+                                        Timer {
+                                            id: searchTimer
+                                            interval: 150
+                                            onTriggered: findBar.search()
+                                        }
+
+                                        Connections {
+                                            target: fileManager
+                                            function onFileSearchMatchesFound(fileIndex, matchCount) {
+                                                if (fileIndex === editorItem.fileIndex) {
+                                                    findBar.matchCount = matchCount
+                                                }
+                                            }
+                                            function onFileSearchFinished(fileIndex, matchCount) {
+                                                if (fileIndex === editorItem.fileIndex) {
+                                                    findBar.searching = false
+                                                }
+                                            }
+                                            function onFileReplaceAllFinished(fileIndex, replacementCount) {
+                                                if (fileIndex === editorItem.fileIndex && findBar.visible) {
+                                                    findBar.search()
+                                                }
+                                            }
+                                        }
+
+                                        Connections {
+                                            target: textEdit
+                                            enabled: findBar.visible
+                                            function onTextChanged() {
+                                                searchTimer.restart()
+                                            }
+                                        }
+
+                                        ColumnLayout {
+                                            id: findColumn
+                                            anchors.fill: parent
+                                            anchors.margins: 6
+                                            spacing: 4
+
+                                            RowLayout {
+                                                spacing: 4
+
+                                                TextField {
+                                                    id: findField
+                                                    Layout.fillWidth: true
+                                                    placeholderText: "Find"
+                                                    color: theme.textColor
+                                                    font.pixelSize: 12
+                                                    selectByMouse: true
+                                                    onTextChanged: searchTimer.restart()
+                                                    Keys.onReturnPressed: function(event) {
+                                                        findBar.step(!(event.modifiers & Qt.ShiftModifier))
+                                                    }
+                                                    Keys.onEscapePressed: findBar.close()
+                                                }
+
+                                                Text {
+                                                    Layout.preferredWidth: 70
+                                                    text: findField.text.length === 0 ? ""
+                                                          : findBar.matchCount === 0
+                                                            ? (findBar.searching ? "…" : "No results")
+                                                            : (findBar.current + 1 > 0 ? (findBar.current + 1) + " of " : "")
+                                                              + findBar.matchCount
+                                                              + (findBar.searching ? "…" : "")
+                                                    color: theme.menuTextColor
+                                                    font.pixelSize: 12
+                                                    horizontalAlignment: Text.AlignRight
+                                                }
+
+                                                Button {
+                                                    Layout.preferredWidth: 28
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    checkable: true
+                                                    checked: findBar.caseSensitive
+                                                    text: "Aa"
+                                                    ToolTip.visible: hovered
+                                                    ToolTip.text: "Match case"
+                                                    onToggled: {
+                                                        findBar.caseSensitive = checked
+                                                        findBar.search()
+                                                    }
+                                                }
+
+                                                Button {
+                                                    Layout.preferredWidth: 28
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    checkable: true
+                                                    checked: findBar.regularExpression
+                                                    text: ".*"
+                                                    ToolTip.visible: hovered
+                                                    ToolTip.text: "Use regular expression"
+                                                    onToggled: {
+                                                        findBar.regularExpression = checked
+                                                        findBar.search()
+                                                    }
+                                                }
+
+                                                Button {
+                                                    Layout.preferredWidth: 24
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    text: "↑"
+                                                    onClicked: findBar.step(false)
+                                                }
+
+                                                Button {
+                                                    Layout.preferredWidth: 24
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    text: "↓"
+                                                    onClicked: findBar.step(true)
+                                                }
+
+                                                Button {
+                                                    Layout.preferredWidth: 24
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    text: "×"
+                                                    onClicked: findBar.close()
+                                                }
+                                            }
+
+                                            RowLayout {
+                                                spacing: 4
+
+                                                TextField {
+                                                    id: replaceField
+                                                    Layout.fillWidth: true
+                                                    placeholderText: "Replace"
+                                                    color: theme.textColor
+                                                    font.pixelSize: 12
+                                                    selectByMouse: true
+                                                    Keys.onEscapePressed: findBar.close()
+                                                }
+
+                                                Button {
+                                                    Layout.preferredHeight: 24
+                                                    flat: true
+                                                    text: "Replace All"
+                                                    enabled: findBar.matchCount > 0
+                                                    contentItem: Text {
+                                                        text: parent.text
+                                                        color: theme.textColor
+                                                        font.pixelSize: 12
+                                                        horizontalAlignment: Text.AlignHCenter
+                                                        verticalAlignment: Text.AlignVCenter
+                                                    }
+                                                    onClicked: findBar.replaceAll()
+                                                }
+                                            }
+                                        }
+                                    }
 
                                     // Line numbers background
                                     Rectangle {
                                         id: lineNumbersArea
-                                        width: 40
+                                        width: Math.max(40, lineNumberGutter.implicitWidth)
                                         height: parent.height
                                         color: theme.explorerColor
                                         anchors.left: parent.left
+                                        visible: !editorItem.readOnlyView
                                         z: 1 // Ensure it's above the ScrollView
 
-                                        // Line numbers container
-                                        Flickable {
-                                            id: lineNumbersView
+                                        // Paints the numbers of the lines in view only
+                                        LineNumberGutter {
+                                            id: lineNumberGutter
                                             anchors.fill: parent
-                                            contentHeight: textEdit.contentHeight
-                                            clip: true
-                                            interactive: false // Don't allow independent scrolling
-
-                                            Column {
-                                                anchors.fill: parent
-                                                anchors.topMargin: 5
-                                                spacing: 0
-
-                                                Repeater {
-                                                    model: textEdit.text.split("\n").length
-
-                                                    Text {
-                                                        text: index + 1
-                                                        width: parent.width
-                                                        height: textEdit.font.pixelSize + 4 // Match line height
-                                                        horizontalAlignment: Text.AlignRight
-                                                        rightPadding: 5
-                                                        color: theme.lineNumberColor
-                                                        font.family: "JetBrains Mono Nerd Font"
-                                                        font.pixelSize: textEdit.font.pixelSize - 1 // 14
-                                                    }
-                                                }
-                                            }
+                                            lineCount: editorItem.lineCount
+                                            lineHeight: textEdit.lineHeight
+                                            contentY: textEdit.contentY
+                                            topPadding: textEdit.topPadding
+                                            currentLine: textEdit.focus ? Math.floor((textEdit.cursorRectangle.y - textEdit.topPadding) / lineHeight) : -1
+                                            color: theme.lineNumberColor
+                                            currentLineColor: theme.textColor
+                                            font.family: "JetBrains Mono Nerd Font"
+                                            font.pixelSize: textEdit.font.pixelSize - 1
                                         }
                                     }
 
-                                    // Text editor with scrolling
-                                    ScrollView {
-                                        id: scrollView
+                                    // Editor surface, only the lines in view are laid out and drawn
+                                    Rectangle {
+                                        anchors.fill: textEdit
+                                        color: theme.backgroundColor
+                                        visible: !editorItem.readOnlyView
+                                    }
+
+                                    EditorView {
+                                        id: textEdit
                                         anchors.left: lineNumbersArea.right
-                                        anchors.right: parent.right
+                                        anchors.right: minimap.visible ? minimap.left : parent.right
                                         anchors.top: parent.top
                                         anchors.bottom: parent.bottom
                                         clip: true
+                                        visible: !editorItem.readOnlyView
+                                        document: fileManager.getDocument(index)
+                                        color: theme.textColor
+                                        font.family: "JetBrains Mono Nerd Font"
+                                        font.pixelSize: 14
+                                        selectionColor: Qt.rgba(0.2, 0.4, 0.6, 0.4) // More IDE-like selection color
+                                        leftPadding: 10
+                                        topPadding: 5
+
+                                        // Add a cursor line highlight
+                                        Rectangle {
+                                            id: cursorLineHighlight
+                                            width: parent.width
+                                            height: textEdit.lineHeight
+                                            y: textEdit.cursorRectangle.y - textEdit.contentY
+                                            color: Qt.rgba(0.2, 0.2, 0.2, 0.2) // Subtle highlight for cursor line
+                                            visible: textEdit.focus
+                                        }
 
-                                        // We need to access the internal Flickable for scroll synchronization
-                                        ScrollBar.vertical.onPositionChanged: {
-                                            lineNumbersView.contentY = ScrollBar.vertical.position * (textEdit.contentHeight - scrollView.height)
+                                        // Add a vertical line at column 80 as a code guide
+                                        Rectangle {
+                                            id: columnGuide
+                                            x: textEdit.font.pixelSize * 0.6 * 80 + textEdit.leftPadding - textEdit.contentX
+                                            width: 1
+                                            height: parent.height
+                                            color: Qt.rgba(0.3, 0.3, 0.3, 0.5)
+                                            visible: true // Make configurable
                                         }
 
-                                        // Styled TextArea
-                                        TextArea {
-                                            id: textEdit
-                                            text: fileManager.getFileContent(index)
-                                            color: theme.textColor
-                                            font.family: "JetBrains Mono Nerd Font"
-                                            font.pixelSize: 14
-                                            wrapMode: TextEdit.NoWrap
-                                            selectByMouse: true
-                                            selectionColor: Qt.rgba(0.2, 0.4, 0.6, 0.4) // More IDE-like selection color
-                                            leftPadding: 10
-                                            rightPadding: 10
-                                            topPadding: 5
-                                            bottomPadding: 5
-
-                                            // Add a cursor line highlight
-                                            Rectangle {
-                                                id: cursorLineHighlight
-                                                width: parent.width
-                                                height: textEdit.font.pixelSize + 4
-                                                color: Qt.rgba(0.2, 0.2, 0.2, 0.2) // Subtle highlight for cursor line
-                                                visible: textEdit.focus
-
-                                                // Position the rectangle at the current cursor line
-                                                y: {
-                                                    let pos = textEdit.cursorRectangle.y
-                                                    return pos
+                                        ScrollBar {
+                                            anchors.top: parent.top
+                                            anchors.right: parent.right
+                                            anchors.bottom: parent.bottom
+                                            orientation: Qt.Vertical
+                                            policy: textEdit.contentHeight > textEdit.height ? ScrollBar.AlwaysOn : ScrollBar.AlwaysOff
+                                            size: textEdit.height / textEdit.contentHeight
+                                            position: textEdit.contentY / textEdit.contentHeight
+                                            onPositionChanged: {
+                                                if (pressed) {
+                                                    textEdit.contentY = position * textEdit.contentHeight
                                                 }
+                                            }
+                                        }
 
-                                                // Update position when cursor moves
-                                                Connections {
-                                                    target: textEdit
-                                                    function onCursorPositionChanged() {
-                                                        cursorLineHighlight.y = textEdit.cursorRectangle.y
-                                                    }
+                                        ScrollBar {
+                                            anchors.left: parent.left
+                                            anchors.right: parent.right
+                                            anchors.bottom: parent.bottom
+                                            orientation: Qt.Horizontal
+                                            policy: textEdit.contentWidth > textEdit.width ? ScrollBar.AsNeeded : ScrollBar.AlwaysOff
+                                            size: textEdit.width / textEdit.contentWidth
+                                            position: textEdit.contentX / textEdit.contentWidth
+                                            onPositionChanged: {
+                                                if (pressed) {
+                                                    textEdit.contentX = position * textEdit.contentWidth
                                                 }
                                             }
+                                        }
 
-                                            background: Rectangle {
-                                                color: theme.backgroundColor
+                                        // Keyboard shortcuts
+                                        Keys.onPressed: function(event) {
+                                            // Ctrl+S for save
+                                            if ((event.modifiers & Qt.ControlModifier) && event.key === Qt.Key_S) {
+                                                fileManager.saveFile(fileManager.activeFileIndex)
+                                                event.accepted = true
                                             }
 
-                                            // Add a vertical line at column 80 as a code guide
-                                            Rectangle {
-                                                id: columnGuide
-                                                x: textEdit.font.pixelSize * 0.6 * 80 + textEdit.leftPadding
-                                                width: 1
-                                                height: parent.height
-                                                color: Qt.rgba(0.3, 0.3, 0.3, 0.5)
-                                                visible: true // Make configurable
+                                            // Ctrl+F opens find and replace
+                                            if ((event.modifiers & Qt.ControlModifier) && event.key === Qt.Key_F) {
+                                                findBar.open()
+                                                event.accepted = true
                                             }
 
-                                            // Monitor content changes
-                                            onTextChanged: {
-                                                if (index === fileManager.activeFileIndex) {
-                                                    fileManager.setFileContent(index, text)
-                                                }
+                                            // Tab key handling for indentation
+                                            if (event.key === Qt.Key_Tab) {
+                                                // Insert spaces instead of tab character
+                                                var spaces = "    " // 4 spaces
+                                                textEdit.insert(textEdit.cursorPosition, spaces)
+                                                event.accepted = true
                                             }
+                                        }
+                                    }
 
-                                            // Set up the syntax highlighter when the component is created
-                                            Component.onCompleted: {
-                                                // Create syntax highlighter for this text document
-                                                fileManager.createSyntaxHighlighter(textEdit.textDocument,
-                                                                                  fileManager.getFileExtension(index))
-                                            }
+                                    // Overview of the whole file, rendered in tiles off the GUI thread
+                                    Minimap {
+                                        id: minimap
+                                        anchors.right: parent.right
+                                        anchors.top: parent.top
+                                        anchors.bottom: parent.bottom
+                                        width: implicitWidth
+                                        clip: true
+                                        visible: root.minimapVisible && !editorItem.readOnlyView
+                                        document: visible ? textEdit.document : null
+                                        color: theme.textColor
+                                        sliderColor: Qt.rgba(theme.textColor.r, theme.textColor.g, theme.textColor.b, 0.12)
+                                        firstLine: textEdit.contentY / textEdit.lineHeight
+                                        visibleLines: textEdit.height / textEdit.lineHeight
+                                        onScrollRequested: function(line) {
+                                            textEdit.contentY = line * textEdit.lineHeight
+                                        }
+                                    }
 
-                                            // Keyboard shortcuts
-                                            Keys.onPressed: function(event) {
-                                                // Ctrl+S for save
-                                                if ((event.modifiers & Qt.ControlModifier) && event.key === Qt.Key_S) {
-                                                    fileManager.saveFile(fileManager.activeFileIndex)
-                                                    event.accepted = true
-                                                }
+                                    // Read-only view for mapped files, only visible lines are decoded
+                                    ListView {
+                                        id: mappedView
+                                        anchors.fill: parent
+                                        visible: editorItem.readOnlyView
+                                        clip: true
+                                        boundsBehavior: Flickable.StopAtBounds
+                                        // Grows while the lines of the file are being found
+                                        model: editorItem.readOnlyView ? editorItem.lineCount : 0
+
+                                        ScrollBar.vertical: ScrollBar {}
+
+                                        delegate: Row {
+                                            height: 18
+                                            spacing: 10
 
-                                                // Tab key handling for indentation
-                                                if (event.key === Qt.Key_Tab) {
-                                                    // Insert spaces instead of tab character
-                                                    var spaces = "    " // 4 spaces
-                                                    textEdit.insert(textEdit.cursorPosition, spaces)
-                                                    event.accepted = true
+                                            Rectangle {
+                                                width: 60
+                                                height: parent.height
+                                                color: theme.explorerColor
+
+                                                Text {
+                                                    anchors.fill: parent
+                                                    text: index + 1
+                                                    horizontalAlignment: Text.AlignRight
+                                                    verticalAlignment: Text.AlignVCenter
+                                                    rightPadding: 5
+                                                    color: theme.lineNumberColor
+                                                    font.family: "JetBrains Mono Nerd Font"
+                                                    font.pixelSize: 13
                                                 }
                                             }
+
+                                            Text {
+                                                height: parent.height
+                                                text: fileManager.getLine(editorItem.fileIndex, index)
+                                                textFormat: Text.PlainText
+                                                verticalAlignment: Text.AlignVCenter
+                                                color: theme.textColor
+                                                font.family: "JetBrains Mono Nerd Font"
+                                                font.pixelSize: 14
+                                            }
                                         }
                                     }
 
@@ -936,6 +1627,123 @@ Window {
         }
     }
 
+    // Quick open: fuzzy file finder over the open folder
+    Shortcut {
+        sequence: "Ctrl+P"
+        enabled: fileManager.currentFolder !== ""
+        onActivated: quickOpenPopup.open()
+    }
+
+    Popup {
+        id: quickOpenPopup
+        x: (parent.width - width) / 2
+        y: parent.height * 0.1
+        width: Math.min(600, parent.width * 0.8)
+        height: quickOpenColumn.implicitHeight + 16
+        padding: 8
+        modal: true
+        focus: true
+
+        background: Rectangle {
+            color: theme.explorerColor
+            border.color: theme.sidebarColor
+            border.width: 1
+        }
+
+        onOpened: {
+            quickOpenField.text = ""
+            quickOpenField.forceActiveFocus()
+        }
+
+        function openSelected() {
+            var filePath = quickOpen.filePath(quickOpenList.currentIndex)
+            if (filePath !== "") {
+                fileManager.openFile(filePath)
+                close()
+            }
+        }
+
+        ColumnLayout {
+            id: quickOpenColumn
+            anchors.left: parent.left
+            anchors.right: parent.right
+            spacing: 6
+
+            TextField {
+                id: quickOpenField
+                Layout.fillWidth: true
+                placeholderText: quickOpen.indexing && quickOpen.fileCount === 0
+                                 ? "Indexing files…" : "Search files by name"
+                color: theme.textColor
+                placeholderTextColor: theme.lineNumberColor
+                selectByMouse: true
+                background: Rectangle {
+                    color: theme.backgroundColor
+                    border.width: 1
+                    border.color: theme.sidebarColor
+                }
+                onTextChanged: {
+                    quickOpen.query = text
+                    quickOpenList.currentIndex = 0
+                }
+                Keys.onUpPressed: quickOpenList.decrementCurrentIndex()
+                Keys.onDownPressed: quickOpenList.incrementCurrentIndex()
+                Keys.onReturnPressed: quickOpenPopup.openSelected()
+                Keys.onEscapePressed: quickOpenPopup.close()
+            }
+
+            ListView {
+                id: quickOpenList
+                Layout.fillWidth: true
+                Layout.preferredHeight: Math.min(count, 12) * 40
+                clip: true
+                model: quickOpen
+                boundsBehavior: Flickable.StopAtBounds
+                highlightMoveDuration: 0
+
+                delegate: Rectangle {
+                    width: quickOpenList.width
+                    height: 40
+                    color: ListView.isCurrentItem ? theme.sidebarColor : "transparent"
+
+                    Column {
+                        anchors.verticalCenter: parent.verticalCenter
+                        anchors.left: parent.left
+                        anchors.right: parent.right
+                        anchors.leftMargin: 8
+                        anchors.rightMargin: 8
+
+                        Text {
+                            width: parent.width
+                            text: highlightedName
+                            textFormat: Text.StyledText
+                            color: theme.textColor
+                            font.pixelSize: 13
+                            elide: Text.ElideRight
+                        }
+
+                        Text {
+                            width: parent.width
+                            text: highlightedDirectory
+                            textFormat: Text.StyledText
+                            color: theme.menuTextColor
+                            font.pixelSize: 11
+                            elide: Text.ElideMiddle
+                        }
+                    }
+
+                    MouseArea {
+                        anchors.fill: parent
+                        onClicked: {
+                            quickOpenList.currentIndex = index
+                            quickOpenPopup.openSelected()
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     // Error notification
     Connections {
         target: fileManager
@@ -0,0 +1,72 @@
+#include "mappedlineindexer.h"
+#include "mappedtextbuffer.h"
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+MappedLineIndexer::MappedLineIndexer(const char *data, qint64 size, QObject *parent)
+    : QThread(parent)
+    , m_data(data)
+    , m_size(size)
+    , m_cancelled(0)
+{
+}
+
+MappedLineIndexer::~MappedLineIndexer()
+{
+    // Never destroy a running thread
+    cancel();
+    wait();
+}
+
+void MappedLineIndexer::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+}
+
+bool MappedLineIndexer::isCancelled() const
+{
+    return m_cancelled.loadRelaxed() != 0;
+}
+
+void MappedLineIndexer::run()
+{
+#ifdef Q_OS_UNIX
+    madvise(const_cast<char *>(m_data), size_t(m_size), MADV_SEQUENTIAL);
+#endif
+
+    // The first line starts at 0, which the buffer knows already
+    int lineCount = 1;
+    qint64 position = 0;
+    while (position < m_size) {
+        if (isCancelled()) {
+            return;
+        }
+
+        const qint64 batchStart = position;
+        const qint64 batchEnd = qMin(position + BatchSize, m_size);
+        QVector<qint64> checkpoints;
+        while (position < batchEnd) {
+            const void *lineBreak = std::memchr(m_data + position, '\n', size_t(batchEnd - position));
+            if (!lineBreak) {
+                position = batchEnd;
+                break;
+            }
+
+            position = static_cast<const char *>(lineBreak) - m_data + 1;
+            if (lineCount % MappedTextBuffer::CheckpointInterval == 0) {
+                checkpoints.append(position);
+            }
+            ++lineCount;
+        }
+
+#ifdef Q_OS_UNIX
+        // The pages stay in the page cache, but they no longer need to be
+        // part of our resident set until a line is actually read
+        madvise(const_cast<char *>(m_data + batchStart), size_t(position - batchStart), MADV_DONTNEED);
+#endif
+        emit linesFound(checkpoints, lineCount, position);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPEDLINEINDEXER_H
+#define MAPPEDLINEINDEXER_H
+
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+
+// Finds the line breaks of a mapped file on a worker thread.
+//
+// The mapping is scanned in batches; after each one linesFound() hands over
+// the checkpoints of MappedTextBuffer found in it, so the line count of the
+// buffer grows while the rest is scanned. Pages are released from the
+// resident set once scanned. The mapping has to outlive the thread;
+// cancel() stops it at the next batch.
+class MappedLineIndexer : public QThread
+{
+    Q_OBJECT
+
+public:
+    MappedLineIndexer(const char *data, qint64 size, QObject *parent = nullptr);
+    ~MappedLineIndexer();
+
+    void cancel();
+    bool isCancelled() const;
+
+signals:
+    // Checkpoints found in the batch, the lines found so far and the bytes
+    // scanned, which reach the size of the mapping with the last batch
+    void linesFound(const QVector<qint64> &checkpoints, int lineCount, qint64 scanned);
+
+protected:
+    void run() override;
+
+private:
+    static const qint64 BatchSize = 16 * 1024 * 1024;
+
+    const char *m_data;
+    qint64 m_size;
+    QAtomicInt m_cancelled;
+};
+
+#endif // MAPPEDLINEINDEXER_H
@@ -0,0 +1,160 @@
+#include "mappedtextbuffer.h"
+#include <cstring>
+#include <algorithm>
+
+MappedTextBuffer::MappedTextBuffer()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_lineCount(0)
+    , m_indexed(0)
+{
+}
+
+MappedTextBuffer::~MappedTextBuffer()
+{
+    close();
+}
+
+bool MappedTextBuffer::open(const QString &filePath)
+{
+    close();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size > 0) {
+        uchar *mapped = m_file.map(0, m_size);
+        if (!mapped) {
+            m_file.close();
+            m_size = 0;
+            return false;
+        }
+        m_data = reinterpret_cast<const char *>(mapped);
+    }
+
+    // Only the first line is known until lines are added
+    m_checkpoints.append(0);
+    m_lineCount = 1;
+    return true;
+}
+
+void MappedTextBuffer::close()
+{
+    if (m_data) {
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+        m_data = nullptr;
+    }
+
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+
+    m_size = 0;
+    m_lineCount = 0;
+    m_indexed = 0;
+    m_checkpoints.clear();
+}
+
+bool MappedTextBuffer::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+const char *MappedTextBuffer::data() const
+{
+    return m_data;
+}
+
+qint64 MappedTextBuffer::size() const
+{
+    return m_size;
+}
+
+int MappedTextBuffer::lineCount() const
+{
+    return m_lineCount;
+}
+
+qint64 MappedTextBuffer::lineStart(int line) const
+{
+    if (line < 0 || line >= m_lineCount) {
+        return -1;
+    }
+
+    // Jump to the closest checkpoint, then walk the remaining lines
+    qint64 position = m_checkpoints.at(line / CheckpointInterval);
+    for (int remaining = line % CheckpointInterval; remaining > 0; --remaining) {
+        const void *lineBreak = std::memchr(m_data + position, '\n', size_t(m_size - position));
+        position = static_cast<const char *>(lineBreak) - m_data + 1;
+    }
+
+    return position;
+}
+
+qint64 MappedTextBuffer::lineLength(int line) const
+{
+    const qint64 start = lineStart(line);
+    if (start < 0) {
+        return -1;
+    }
+
+    const void *lineBreak = std::memchr(m_data + start, '\n', size_t(m_size - start));
+    qint64 end = lineBreak ? static_cast<const char *>(lineBreak) - m_data : m_size;
+
+    if (end > start && m_data[end - 1] == '\r') {
+        --end;
+    }
+
+    return end - start;
+}
+
+QString MappedTextBuffer::line(int line) const
+{
+    const qint64 start = lineStart(line);
+    if (start < 0) {
+        return QString();
+    }
+
+    return QString::fromUtf8(m_data + start, lineLength(line));
+}
+
+int MappedTextBuffer::lineAt(qint64 position) const
+{
+    if (m_lineCount == 0) {
+        return -1;
+    }
+
+    // Past the bytes scanned, the last line found is as far as is known
+    position = qBound(Q_INT64_C(0), position, m_indexed);
+
+    // Last checkpoint at or before the position, then count the rest
+    const auto checkpoint = std::upper_bound(m_checkpoints.constBegin(), m_checkpoints.constEnd(), position) - 1;
+    int line = int(checkpoint - m_checkpoints.constBegin()) * CheckpointInterval;
+    qint64 offset = *checkpoint;
+
+    while (offset < position) {
+        const void *lineBreak = std::memchr(m_data + offset, '\n', size_t(position - offset));
+        if (!lineBreak) {
+            break;
+        }
+        offset = static_cast<const char *>(lineBreak) - m_data + 1;
+        ++line;
+    }
+
+    return line;
+}
+
+void MappedTextBuffer::addLines(const QVector<qint64> &checkpoints, int lineCount, qint64 scanned)
+{
+    m_checkpoints += checkpoints;
+    m_lineCount = lineCount;
+    m_indexed = scanned;
+}
+
+bool MappedTextBuffer::isIndexed() const
+{
+    return m_indexed == m_size;
+}
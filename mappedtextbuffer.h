@@ -0,0 +1,58 @@
+#ifndef MAPPEDTEXTBUFFER_H
+#define MAPPEDTEXTBUFFER_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Read-only view of a UTF-8 text file mapped into memory.
+//
+// Nothing is decoded up front, and opening does not even read the file.
+// A MappedLineIndexer scans the mapping for line breaks in the background
+// and addLines() records the byte offset of every CheckpointInterval-th
+// line; until it is done, only the lines found so far exist. A line is
+// located by jumping to the nearest checkpoint and scanning forward, and is
+// decoded to a QString only when it is asked for. This keeps the resident
+// footprint of multi-GB files to the sparse index plus the pages that are
+// actually being looked at.
+class MappedTextBuffer
+{
+public:
+    static const int CheckpointInterval = 64;
+
+    MappedTextBuffer();
+    ~MappedTextBuffer();
+
+    bool open(const QString &filePath);
+    void close();
+    bool isOpen() const;
+
+    // Raw bytes
+    const char *data() const;
+    qint64 size() const;
+
+    // Lines ('\n' separated, a trailing '\r' is not part of the line)
+    int lineCount() const;
+    qint64 lineStart(int line) const;
+    qint64 lineLength(int line) const;
+    QString line(int line) const;
+    int lineAt(qint64 position) const;
+
+    // Lines found by scanning the mapping up to scanned; checkpoints follow
+    // the ones added before
+    void addLines(const QVector<qint64> &checkpoints, int lineCount, qint64 scanned);
+    // Whether every line break is known
+    bool isIndexed() const;
+
+private:
+    QFile m_file;
+    const char *m_data;
+    qint64 m_size;
+    int m_lineCount;
+    // Bytes scanned for line breaks so far
+    qint64 m_indexed;
+    // Byte offset of every CheckpointInterval-th line start
+    QVector<qint64> m_checkpoints;
+};
+
+#endif // MAPPEDTEXTBUFFER_H
@@ -0,0 +1,557 @@
+#include "minimap.h"
+#include "sceneitem.h"
+#include <QMap>
+#include <QMouseEvent>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQuickWindow>
+#include <QSGSimpleRectNode>
+#include <QSGTransformNode>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <QtMath>
+
+// Alpha of the character blocks, so the strips read as texture rather
+// than as solid bars
+static const int BlockAlpha = 170;
+
+// Characters [start, start + length) of a line in one colour
+struct MinimapRun
+{
+    int start;
+    int length;
+    QRgb color;
+};
+
+// What a tile is rendered from, copied out of the document
+struct MinimapLine
+{
+    QString text;
+    QVector<MinimapRun> runs;
+};
+
+struct MinimapJob
+{
+    quint64 serial;
+    QRgb color;
+    QVector<MinimapLine> lines;
+};
+
+// Renders tiles on a worker thread, one job per tile at most; a tile asked
+// for again before it was rendered only keeps the newest job
+class MinimapRenderer : public QThread
+{
+public:
+    explicit MinimapRenderer(Minimap *minimap)
+        : m_minimap(minimap)
+        , m_stopping(false)
+    {
+    }
+
+    ~MinimapRenderer()
+    {
+        // Never destroy a running thread
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+            m_condition.wakeAll();
+        }
+        wait();
+    }
+
+    void render(int tile, const MinimapJob &job)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_jobs.insert(tile, job);
+        m_condition.wakeOne();
+    }
+
+    // Drops the jobs of tiles that left the view
+    void retain(int first, int last)
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+            if (it.key() < first || it.key() > last) {
+                it = m_jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+protected:
+    void run() override
+    {
+        QMutexLocker locker(&m_mutex);
+        while (true) {
+            while (m_jobs.isEmpty() && !m_stopping) {
+                m_condition.wait(&m_mutex);
+            }
+            if (m_stopping) {
+                break;
+            }
+
+            const int tile = m_jobs.firstKey();
+            const MinimapJob job = m_jobs.take(tile);
+
+            locker.unlock();
+            const QImage image = renderTile(job);
+            Minimap *target = m_minimap;
+            const quint64 serial = job.serial;
+            QMetaObject::invokeMethod(m_minimap, [target, tile, serial, image]() {
+                target->tileRendered(tile, serial, image);
+            }, Qt::QueuedConnection);
+            locker.relock();
+        }
+    }
+
+private:
+    static QRgb blockColor(QRgb color)
+    {
+        return qPremultiply(qRgba(qRed(color), qGreen(color), qBlue(color), BlockAlpha));
+    }
+
+    static QImage renderTile(const MinimapJob &job)
+    {
+        QImage image(Minimap::Columns, Minimap::TileLines * Minimap::LinePixels, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+
+        const QRgb defaultColor = blockColor(job.color);
+        QVector<QRgb> colors;
+        for (int i = 0; i < job.lines.size(); ++i) {
+            const MinimapLine &line = job.lines.at(i);
+            const int length = line.text.length();
+            colors.fill(defaultColor, length);
+            for (const MinimapRun &run : line.runs) {
+                const QRgb color = blockColor(run.color);
+                const int end = qMin(length, run.start + run.length);
+                for (int c = qMax(0, run.start); c < end; ++c) {
+                    colors[c] = color;
+                }
+            }
+
+            // A block per character that is not blank, tabs to the next stop
+            QRgb *rows[Minimap::LinePixels];
+            for (int r = 0; r < Minimap::LinePixels; ++r) {
+                rows[r] = reinterpret_cast<QRgb *>(image.scanLine(i * Minimap::LinePixels + r));
+            }
+            const QChar *data = line.text.constData();
+            int column = 0;
+            for (int c = 0; c < length && column < Minimap::Columns; ++c) {
+                if (data[c] == QLatin1Char('\t')) {
+                    column = (column / Minimap::TabColumns + 1) * Minimap::TabColumns;
+                    continue;
+                }
+                if (!data[c].isSpace()) {
+                    for (int r = 0; r < Minimap::LinePixels; ++r) {
+                        rows[r][column] = colors.at(c);
+                    }
+                }
+                ++column;
+            }
+        }
+        return image;
+    }
+
+    Minimap *m_minimap;
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    // Pending jobs by tile, guarded by m_mutex
+    QMap<int, MinimapJob> m_jobs;
+    bool m_stopping;
+};
+
+// Tiles and the slider are placed in minimap content coordinates under one
+// transform, so scrolling only changes its matrix
+class MinimapRootNode : public QSGTransformNode
+{
+public:
+    MinimapRootNode()
+        : slider(new QSGSimpleRectNode)
+    {
+        appendChildNode(slider);
+    }
+
+    QSGSimpleRectNode *slider;
+    QHash<int, ImageTextureNode *> tiles;
+};
+
+Minimap::Minimap(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_color(Qt::gray)
+    , m_sliderColor(QColor(128, 128, 128, 60))
+    , m_firstLine(0)
+    , m_visibleLines(0)
+    , m_editSeen(false)
+    , m_lineCount(0)
+    , m_offset(0)
+    , m_grab(0)
+    , m_nextSerial(0)
+    , m_renderer(new MinimapRenderer(this))
+{
+    setFlag(ItemHasContents);
+    setAcceptedMouseButtons(Qt::LeftButton);
+    setImplicitWidth(Columns);
+
+    m_renderer->start(QThread::LowPriority);
+}
+
+Minimap::~Minimap()
+{
+    delete m_renderer;
+}
+
+TextDocument *Minimap::document() const
+{
+    return m_document;
+}
+
+void Minimap::setDocument(TextDocument *document)
+{
+    if (m_document == document) {
+        return;
+    }
+
+    if (m_document) {
+        disconnect(m_document, nullptr, this, nullptr);
+    }
+
+    m_document = document;
+
+    if (m_document) {
+        connect(m_document, &TextDocument::textEdited, this, &Minimap::handleTextEdited);
+        connect(m_document, &TextDocument::contentChanged, this, &Minimap::handleContentChanged);
+        connect(m_document, &TextDocument::highlightingChanged, this, &Minimap::invalidateLines);
+    }
+
+    m_lineCount = lineCount();
+    m_tiles.clear();
+    polish();
+    emit documentChanged();
+}
+
+QColor Minimap::color() const
+{
+    return m_color;
+}
+
+void Minimap::setColor(const QColor &color)
+{
+    if (m_color == color) {
+        return;
+    }
+
+    m_color = color;
+    invalidateLines(0, m_lineCount);
+    emit colorChanged();
+}
+
+QColor Minimap::sliderColor() const
+{
+    return m_sliderColor;
+}
+
+void Minimap::setSliderColor(const QColor &color)
+{
+    if (m_sliderColor == color) {
+        return;
+    }
+
+    m_sliderColor = color;
+    update();
+    emit sliderColorChanged();
+}
+
+qreal Minimap::firstLine() const
+{
+    return m_firstLine;
+}
+
+void Minimap::setFirstLine(qreal line)
+{
+    if (m_firstLine == line) {
+        return;
+    }
+
+    // Tiles that scroll in are requested before the next frame
+    m_firstLine = line;
+    polish();
+    emit firstLineChanged();
+}
+
+qreal Minimap::visibleLines() const
+{
+    return m_visibleLines;
+}
+
+void Minimap::setVisibleLines(qreal lines)
+{
+    if (m_visibleLines == lines) {
+        return;
+    }
+
+    m_visibleLines = lines;
+    polish();
+    emit visibleLinesChanged();
+}
+
+void Minimap::updatePolish()
+{
+    updateOffset();
+
+    const int count = lineCount();
+    if (count == 0) {
+        m_tiles.clear();
+        m_renderer->retain(0, -1);
+        update();
+        return;
+    }
+
+    const int tileHeight = TileLines * LinePixels;
+    const int first = qMax(0, int(m_offset / tileHeight) - OverscanTiles);
+    const int last = qMin((count - 1) / TileLines, int((m_offset + height()) / tileHeight) + OverscanTiles);
+
+    // Tiles that left the view drop their images, and their jobs if they
+    // were not rendered yet
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        if (it.key() < first || it.key() > last) {
+            it = m_tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_renderer->retain(first, last);
+
+    for (int tile = first; tile <= last; ++tile) {
+        auto it = m_tiles.find(tile);
+        if (it == m_tiles.end()) {
+            // Renders asked for before the tile left the view are stale
+            Tile empty;
+            empty.version = m_nextSerial;
+            empty.dirty = true;
+            it = m_tiles.insert(tile, empty);
+        }
+        if (it->dirty) {
+            it->dirty = false;
+            requestTile(tile);
+        }
+    }
+
+    update();
+}
+
+QSGNode *Minimap::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    MinimapRootNode *root = static_cast<MinimapRootNode *>(oldNode);
+    if (!root) {
+        root = new MinimapRootNode;
+    }
+
+    QMatrix4x4 matrix;
+    matrix.translate(0, -m_offset);
+    root->setMatrix(matrix);
+
+    // Nodes of tiles that left the view or were rendered again are reused
+    QVector<ImageTextureNode *> spare;
+    for (auto it = root->tiles.begin(); it != root->tiles.end();) {
+        const auto tile = m_tiles.constFind(it.key());
+        if (tile == m_tiles.constEnd() || tile->version != it.value()->version) {
+            spare.append(it.value());
+            it = root->tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it) {
+        const Tile &tile = it.value();
+        if (tile.image.isNull() || root->tiles.contains(it.key())) {
+            continue;
+        }
+
+        ImageTextureNode *node;
+        if (!spare.isEmpty()) {
+            node = spare.takeLast();
+        } else {
+            node = new ImageTextureNode;
+            root->insertChildNodeBefore(node, root->slider);
+        }
+
+        node->version = tile.version;
+        node->setImage(window(), tile.image);
+        node->setRect(QRectF(QPointF(0, it.key() * TileLines * LinePixels), QSizeF(tile.image.size())));
+        root->tiles.insert(it.key(), node);
+    }
+
+    for (ImageTextureNode *node : spare) {
+        root->removeChildNode(node);
+        delete node;
+    }
+
+    root->slider->setColor(m_sliderColor);
+    root->slider->setRect(m_document && m_lineCount > 0
+                          ? QRectF(0, m_firstLine * LinePixels, width(), m_visibleLines * LinePixels)
+                          : QRectF());
+
+    return root;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+void Minimap::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+#else
+void Minimap::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+#endif
+    polish();
+}
+
+void Minimap::mousePressEvent(QMouseEvent *event)
+{
+    // Dragging keeps the slider where it was grabbed; clicking elsewhere
+    // centres it on the click first
+    const qreal y = eventPosition(event).y();
+    const qreal sliderTop = m_firstLine * LinePixels - m_offset;
+    const qreal sliderHeight = m_visibleLines * LinePixels;
+    if (y >= sliderTop && y < sliderTop + sliderHeight) {
+        m_grab = y - sliderTop;
+    } else {
+        m_grab = sliderHeight / 2;
+        scrollToSlider(y - m_grab);
+    }
+}
+
+void Minimap::mouseMoveEvent(QMouseEvent *event)
+{
+    scrollToSlider(eventPosition(event).y() - m_grab);
+}
+
+void Minimap::handleTextEdited(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    m_editSeen = true;
+
+    // Lines below a change of the line count moved, their tiles are all
+    // rendered again
+    const int count = lineCount();
+    const int first = lineAt(position);
+    if (count != m_lineCount) {
+        m_lineCount = count;
+        invalidateLines(first, count);
+    } else {
+        invalidateLines(first, lineAt(position + charsAdded));
+    }
+}
+
+void Minimap::handleContentChanged()
+{
+    if (m_editSeen) {
+        m_editSeen = false;
+        return;
+    }
+
+    // No textEdited() came first: the document was loaded or reloaded and
+    // every tile is stale
+    m_lineCount = lineCount();
+    m_tiles.clear();
+    polish();
+}
+
+void Minimap::invalidateLines(int first, int last)
+{
+    const int firstTile = first / TileLines;
+    const int lastTile = last / TileLines;
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+        if (it.key() >= firstTile && it.key() <= lastTile) {
+            it->dirty = true;
+        }
+    }
+    polish();
+}
+
+void Minimap::requestTile(int tile)
+{
+    MinimapJob job;
+    job.serial = ++m_nextSerial;
+    job.color = m_color.rgba();
+
+    // Only the characters that fit are copied, however long the line
+    const int first = tile * TileLines;
+    const int last = qMin(lineCount(), first + TileLines);
+    job.lines.reserve(last - first);
+    for (int line = first; line < last; ++line) {
+        MinimapLine minimapLine;
+        const int length = qMin(m_document->getLineLength(line) - 1, int(Columns));
+        minimapLine.text = m_document->text(int(m_document->getLineStart(line)), length);
+
+        const QVector<QTextLayout::FormatRange> formats = m_document->lineFormats(line);
+        for (const QTextLayout::FormatRange &range : formats) {
+            if (range.start < length && range.format.hasProperty(QTextFormat::ForegroundBrush)) {
+                minimapLine.runs.append({ range.start, range.length, range.format.foreground().color().rgba() });
+            }
+        }
+        job.lines.append(minimapLine);
+    }
+
+    m_renderer->render(tile, job);
+}
+
+void Minimap::tileRendered(int tile, quint64 serial, const QImage &image)
+{
+    auto it = m_tiles.find(tile);
+    if (it == m_tiles.end() || serial <= it->version) {
+        return;
+    }
+
+    it->image = image;
+    it->version = serial;
+    update();
+}
+
+void Minimap::updateOffset()
+{
+    // Scrolled in proportion with the editor once it does not fit
+    const qreal total = lineCount() * LinePixels;
+    if (total <= height()) {
+        m_offset = 0;
+        return;
+    }
+
+    const qreal lastFirstLine = qMax(qreal(1), lineCount() - m_visibleLines);
+    m_offset = qBound(qreal(0), m_firstLine / lastFirstLine, qreal(1)) * (total - height());
+}
+
+void Minimap::scrollToSlider(qreal sliderTop)
+{
+    if (!m_document) {
+        return;
+    }
+
+    // The slider's top is at line * LinePixels - offset(line), and the
+    // offset grows linearly with the line
+    const qreal total = lineCount() * LinePixels;
+    const qreal lastFirstLine = qMax(qreal(0), lineCount() - m_visibleLines);
+    qreal pixelsPerLine = LinePixels;
+    if (total > height()) {
+        pixelsPerLine -= (total - height()) / qMax(qreal(1), lastFirstLine);
+    }
+    if (pixelsPerLine <= 0) {
+        return;
+    }
+
+    emit scrollRequested(qBound(qreal(0), sliderTop / pixelsPerLine, lastFirstLine));
+}
+
+int Minimap::lineCount() const
+{
+    // Mapped files are never decoded as a whole and have no minimap
+    return m_document && !m_document->isReadOnly() ? m_document->lineCount() : 0;
+}
+
+int Minimap::lineAt(int position) const
+{
+    return m_document ? qMax(0, m_document->getLineNumber(position)) : 0;
+}
@@ -0,0 +1,120 @@
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPointer>
+#include "textdocument.h"
+
+class MinimapRenderer;
+
+// Scaled-down overview of a document beside its editor.
+//
+// Every line is a strip a few pixels high, with a block per character in
+// the colour the syntax highlighter gave it. The strips are cut into tiles
+// of TileLines lines, rendered on a worker thread and kept only for the
+// tiles in view, so the overview of a huge file costs a few images and
+// opening it never waits on the whole text. The lines of a tile are copied
+// out of the document on the GUI thread when it is requested; an edit or a
+// change of highlighting renders again only the tiles of the lines it
+// touched. The old image stays up until the new one arrives.
+//
+// When the document is taller than the minimap, the minimap scrolls in
+// proportion with the editor. The slider marks the lines in view; clicking
+// and dragging asks the editor to scroll through scrollRequested().
+class Minimap : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(TextDocument *document READ document WRITE setDocument NOTIFY documentChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor sliderColor READ sliderColor WRITE setSliderColor NOTIFY sliderColorChanged)
+    Q_PROPERTY(qreal firstLine READ firstLine WRITE setFirstLine NOTIFY firstLineChanged)
+    Q_PROPERTY(qreal visibleLines READ visibleLines WRITE setVisibleLines NOTIFY visibleLinesChanged)
+
+public:
+    explicit Minimap(QQuickItem *parent = nullptr);
+    ~Minimap();
+
+    TextDocument *document() const;
+    void setDocument(TextDocument *document);
+    QColor color() const;
+    void setColor(const QColor &color);
+    QColor sliderColor() const;
+    void setSliderColor(const QColor &color);
+
+    // Lines of the editor in view, fractional while scrolling
+    qreal firstLine() const;
+    void setFirstLine(qreal line);
+    qreal visibleLines() const;
+    void setVisibleLines(qreal lines);
+
+signals:
+    void documentChanged();
+    void colorChanged();
+    void sliderColorChanged();
+    void firstLineChanged();
+    void visibleLinesChanged();
+    // The line the editor should show at its top
+    void scrollRequested(qreal line);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void updatePolish() override;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+#else
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+#endif
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+    friend class MinimapRenderer;
+
+    // A rendered tile and the serial of the render it came from; results
+    // older than the image shown are dropped
+    struct Tile
+    {
+        QImage image;
+        quint64 version;
+        bool dirty;
+    };
+
+    static const int TileLines = 128;
+    static const int LinePixels = 2;
+    static const int Columns = 120;
+    static const int TabColumns = 4;
+    // Tiles kept above and below the view
+    static const int OverscanTiles = 1;
+
+    void handleTextEdited(int position, int charsRemoved, int charsAdded);
+    void handleContentChanged();
+    void invalidateLines(int first, int last);
+    void requestTile(int tile);
+    void tileRendered(int tile, quint64 serial, const QImage &image);
+    void updateOffset();
+    void scrollToSlider(qreal sliderTop);
+    int lineCount() const;
+    int lineAt(int position) const;
+
+    QPointer<TextDocument> m_document;
+    QColor m_color;
+    QColor m_sliderColor;
+    qreal m_firstLine;
+    qreal m_visibleLines;
+    // Tells handleContentChanged() the change was an edit already handled
+    bool m_editSeen;
+    int m_lineCount;
+
+    // Minimap pixels scrolled past, and where the slider was grabbed
+    qreal m_offset;
+    qreal m_grab;
+
+    QHash<int, Tile> m_tiles;
+    quint64 m_nextSerial;
+    MinimapRenderer *m_renderer;
+};
+
+#endif // MINIMAP_H
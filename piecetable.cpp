@@ -0,0 +1,459 @@
+#include "piecetable.h"
+#include <algorithm>
+
+PieceTable::Snapshot::Snapshot()
+    : m_length(0)
+{
+}
+
+int PieceTable::Snapshot::length() const
+{
+    return m_length;
+}
+
+QString PieceTable::Snapshot::text() const
+{
+    QString out;
+    out.reserve(m_length);
+    forEachChunk([&out](const QChar *data, int length) {
+        out.append(data, length);
+    });
+    return out;
+}
+
+PieceTable::PieceTable()
+    : m_root(-1)
+    , m_seed(0x9E3779B9u)
+{
+    clear();
+}
+
+PieceTable::PieceTable(const QString &text)
+    : PieceTable()
+{
+    setText(text);
+}
+
+void PieceTable::setText(const QString &text)
+{
+    clear();
+
+    m_buffers[OriginalBuffer] = text;
+    indexLineBreaks(text, 0, m_lineBreaks[OriginalBuffer]);
+
+    if (!text.isEmpty()) {
+        m_root = createNode(OriginalBuffer, 0, text.length());
+    }
+}
+
+void PieceTable::clear()
+{
+    m_buffers.clear();
+    m_buffers.append(QString());
+    m_lineBreaks.clear();
+    m_lineBreaks.append(QVector<int>());
+
+    m_nodes.clear();
+    m_freeNodes.clear();
+    m_root = -1;
+}
+
+QString PieceTable::text() const
+{
+    return text(0, length());
+}
+
+QString PieceTable::text(int position, int length) const
+{
+    const int total = this->length();
+    position = qBound(0, position, total);
+    length = qBound(0, length, total - position);
+
+    QString out;
+    if (length == 0) {
+        return out;
+    }
+
+    out.reserve(length);
+    appendText(m_root, position, length, 0, out);
+    return out;
+}
+
+int PieceTable::length() const
+{
+    return subtreeLength(m_root);
+}
+
+bool PieceTable::isEmpty() const
+{
+    return length() == 0;
+}
+
+void PieceTable::insert(int position, const QString &text)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+
+    position = qBound(0, position, length());
+
+    // New text goes to the end of the last add block, or to a fresh block
+    // when it does not fit. Blocks are never reallocated once shared with a
+    // snapshot, at worst the last one is copied.
+    int buffer = m_buffers.size() - 1;
+    if (buffer == OriginalBuffer || m_buffers.at(buffer).length() + text.length() > BlockSize) {
+        m_buffers.append(QString());
+        m_buffers.last().reserve(qMax(int(BlockSize), int(text.length())));
+        m_lineBreaks.append(QVector<int>());
+        buffer = m_buffers.size() - 1;
+    }
+
+    const int start = m_buffers.at(buffer).length();
+    m_buffers[buffer].append(text);
+    indexLineBreaks(text, start, m_lineBreaks[buffer]);
+
+    int left, right;
+    split(m_root, position, left, right);
+
+    // Consecutive typing extends the previous piece instead of adding a new one
+    if (!extendLastPiece(left, buffer, start, text.length())) {
+        left = merge(left, createNode(buffer, start, text.length()));
+    }
+
+    m_root = merge(left, right);
+}
+
+void PieceTable::remove(int position, int length)
+{
+    const int total = this->length();
+    position = qBound(0, position, total);
+    length = qBound(0, length, total - position);
+    if (length == 0) {
+        return;
+    }
+
+    int left, middle, right;
+    split(m_root, position, left, middle);
+    split(middle, length, middle, right);
+
+    // The removed characters stay in their buffer, only the pieces go away
+    releaseTree(middle);
+    m_root = merge(left, right);
+}
+
+int PieceTable::lineCount() const
+{
+    return subtreeLineBreaks(m_root) + 1;
+}
+
+int PieceTable::lineStart(int line) const
+{
+    if (line < 0 || line >= lineCount()) {
+        return -1;
+    }
+
+    if (line == 0) {
+        return 0;
+    }
+
+    // Find the line-th line break; the line starts right after it
+    int remaining = line;
+    int offset = 0;
+    int node = m_root;
+
+    while (node >= 0) {
+        const Node &n = m_nodes.at(node);
+        const int leftBreaks = subtreeLineBreaks(n.left);
+
+        if (remaining <= leftBreaks) {
+            node = n.left;
+            continue;
+        }
+
+        remaining -= leftBreaks;
+        offset += subtreeLength(n.left);
+
+        if (remaining <= n.lineBreaks) {
+            const QVector<int> &breaks = m_lineBreaks.at(n.buffer);
+            const int first = std::lower_bound(breaks.constBegin(), breaks.constEnd(), n.start) - breaks.constBegin();
+            return offset + breaks.at(first + remaining - 1) - n.start + 1;
+        }
+
+        remaining -= n.lineBreaks;
+        offset += n.length;
+        node = n.right;
+    }
+
+    return -1;
+}
+
+int PieceTable::lineLength(int line) const
+{
+    const int start = lineStart(line);
+    if (start < 0) {
+        return -1;
+    }
+
+    const int end = line + 1 < lineCount() ? lineStart(line + 1) - 1 : length();
+    return end - start;
+}
+
+QString PieceTable::line(int line) const
+{
+    const int start = lineStart(line);
+    if (start < 0) {
+        return QString();
+    }
+
+    return text(start, lineLength(line));
+}
+
+int PieceTable::lineAt(int position) const
+{
+    // The line of a position is the number of line breaks before it
+    int remaining = qBound(0, position, length());
+    int line = 0;
+    int node = m_root;
+
+    while (node >= 0) {
+        const Node &n = m_nodes.at(node);
+        const int leftLength = subtreeLength(n.left);
+
+        if (remaining <= leftLength) {
+            node = n.left;
+            continue;
+        }
+
+        line += subtreeLineBreaks(n.left);
+        remaining -= leftLength;
+
+        if (remaining <= n.length) {
+            return line + countLineBreaks(n.buffer, n.start, remaining);
+        }
+
+        line += n.lineBreaks;
+        remaining -= n.length;
+        node = n.right;
+    }
+
+    return line;
+}
+
+PieceTable::Snapshot PieceTable::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.m_buffers = m_buffers;
+    snapshot.m_length = length();
+    snapshot.m_pieces.reserve(m_nodes.size() - m_freeNodes.size());
+    collectPieces(m_root, snapshot.m_pieces);
+    return snapshot;
+}
+
+int PieceTable::createNode(int buffer, int start, int length)
+{
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.priority = nextPriority();
+    node.buffer = buffer;
+    node.start = start;
+    node.length = length;
+    node.lineBreaks = countLineBreaks(buffer, start, length);
+    node.subtreeLength = length;
+    node.subtreeLineBreaks = node.lineBreaks;
+
+    if (!m_freeNodes.isEmpty()) {
+        const int index = m_freeNodes.takeLast();
+        m_nodes[index] = node;
+        return index;
+    }
+
+    m_nodes.append(node);
+    return m_nodes.size() - 1;
+}
+
+void PieceTable::releaseTree(int node)
+{
+    if (node < 0) {
+        return;
+    }
+
+    releaseTree(m_nodes.at(node).left);
+    releaseTree(m_nodes.at(node).right);
+    m_freeNodes.append(node);
+}
+
+quint32 PieceTable::nextPriority()
+{
+    // xorshift32, good enough to keep the treap balanced
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    return m_seed;
+}
+
+void PieceTable::update(int node)
+{
+    Node &n = m_nodes[node];
+    n.subtreeLength = subtreeLength(n.left) + n.length + subtreeLength(n.right);
+    n.subtreeLineBreaks = subtreeLineBreaks(n.left) + n.lineBreaks + subtreeLineBreaks(n.right);
+}
+
+void PieceTable::split(int node, int position, int &left, int &right)
+{
+    if (node < 0) {
+        left = -1;
+        right = -1;
+        return;
+    }
+
+    const int leftLength = subtreeLength(m_nodes.at(node).left);
+    const int pieceLength = m_nodes.at(node).length;
+
+    if (position <= leftLength) {
+        int l, r;
+        split(m_nodes.at(node).left, position, l, r);
+        m_nodes[node].left = r;
+        update(node);
+        left = l;
+        right = node;
+    } else if (position >= leftLength + pieceLength) {
+        int l, r;
+        split(m_nodes.at(node).right, position - leftLength - pieceLength, l, r);
+        m_nodes[node].right = l;
+        update(node);
+        left = node;
+        right = r;
+    } else {
+        // The split point falls inside this piece: cut it in two. The tail
+        // inherits the priority and right subtree, so the heap order holds.
+        const int offset = position - leftLength;
+        const int tail = createNode(m_nodes.at(node).buffer, m_nodes.at(node).start + offset, pieceLength - offset);
+
+        Node &head = m_nodes[node];
+        m_nodes[tail].priority = head.priority;
+        m_nodes[tail].right = head.right;
+        head.right = -1;
+        head.length = offset;
+        head.lineBreaks = countLineBreaks(head.buffer, head.start, head.length);
+
+        update(node);
+        update(tail);
+        left = node;
+        right = tail;
+    }
+}
+
+int PieceTable::merge(int left, int right)
+{
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+
+    if (m_nodes.at(left).priority >= m_nodes.at(right).priority) {
+        const int merged = merge(m_nodes.at(left).right, right);
+        m_nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+
+    const int merged = merge(left, m_nodes.at(right).left);
+    m_nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+bool PieceTable::extendLastPiece(int node, int buffer, int start, int length)
+{
+    if (node < 0) {
+        return false;
+    }
+
+    const int right = m_nodes.at(node).right;
+    if (right >= 0) {
+        if (!extendLastPiece(right, buffer, start, length)) {
+            return false;
+        }
+    } else {
+        Node &n = m_nodes[node];
+        if (n.buffer != buffer || n.start + n.length != start) {
+            return false;
+        }
+        n.length += length;
+        n.lineBreaks = countLineBreaks(n.buffer, n.start, n.length);
+    }
+
+    update(node);
+    return true;
+}
+
+int PieceTable::subtreeLength(int node) const
+{
+    return node < 0 ? 0 : m_nodes.at(node).subtreeLength;
+}
+
+int PieceTable::subtreeLineBreaks(int node) const
+{
+    return node < 0 ? 0 : m_nodes.at(node).subtreeLineBreaks;
+}
+
+int PieceTable::countLineBreaks(int buffer, int start, int length) const
+{
+    const QVector<int> &breaks = m_lineBreaks.at(buffer);
+    const auto first = std::lower_bound(breaks.constBegin(), breaks.constEnd(), start);
+    const auto last = std::lower_bound(first, breaks.constEnd(), start + length);
+    return last - first;
+}
+
+void PieceTable::appendText(int node, int position, int length, int offset, QString &out) const
+{
+    if (node < 0) {
+        return;
+    }
+
+    const Node &n = m_nodes.at(node);
+    const int pieceStart = offset + subtreeLength(n.left);
+    const int pieceEnd = pieceStart + n.length;
+    const int end = position + length;
+
+    if (position < pieceStart) {
+        appendText(n.left, position, length, offset, out);
+    }
+
+    if (position < pieceEnd && end > pieceStart) {
+        const int from = qMax(position, pieceStart);
+        const int to = qMin(end, pieceEnd);
+        out.append(m_buffers.at(n.buffer).constData() + n.start + (from - pieceStart), to - from);
+    }
+
+    if (end > pieceEnd) {
+        appendText(n.right, position, length, pieceEnd, out);
+    }
+}
+
+void PieceTable::collectPieces(int node, QVector<Piece> &pieces) const
+{
+    if (node < 0) {
+        return;
+    }
+
+    const Node &n = m_nodes.at(node);
+    collectPieces(n.left, pieces);
+    pieces.append({ n.buffer, n.start, n.length });
+    collectPieces(n.right, pieces);
+}
+
+void PieceTable::indexLineBreaks(const QString &text, int offset, QVector<int> &lineBreaks)
+{
+    const QChar *data = text.constData();
+    const int size = text.length();
+
+    for (int i = 0; i < size; ++i) {
+        if (data[i] == QLatin1Char('\n')) {
+            lineBreaks.append(offset + i);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <QString>
+#include <QVector>
+
+// Piece table text buffer.
+//
+// The text a document was loaded with is kept untouched in the original
+// buffer and every insertion is appended to add buffers, so edits never
+// move existing characters around. Add buffers are blocks of at most
+// BlockSize characters that are only ever appended to, which lets a
+// Snapshot share them with the live table. The document itself is a
+// sequence of pieces, each referencing a span of one buffer. Pieces are kept
+// in a treap ordered by document position; every node caches the length and
+// the number of line breaks of its subtree, which makes inserts, removals
+// and line lookups O(log n) in the number of pieces.
+class PieceTable
+{
+public:
+    struct Piece {
+        int buffer;
+        int start;
+        int length;
+    };
+
+    // Immutable copy of the table that can be read from another thread.
+    // Taking one costs O(pieces); the buffers are implicitly shared.
+    class Snapshot
+    {
+    public:
+        Snapshot();
+
+        int length() const;
+        QString text() const;
+
+        // Calls fn(const QChar *data, int length) for every piece in order
+        template<typename Fn>
+        void forEachChunk(Fn fn) const
+        {
+            for (const Piece &piece : m_pieces) {
+                fn(m_buffers.at(piece.buffer).constData() + piece.start, piece.length);
+            }
+        }
+
+    private:
+        friend class PieceTable;
+
+        QVector<QString> m_buffers;
+        QVector<Piece> m_pieces;
+        int m_length;
+    };
+
+    PieceTable();
+    explicit PieceTable(const QString &text);
+
+    // Content
+    void setText(const QString &text);
+    void clear();
+    QString text() const;
+    QString text(int position, int length) const;
+    int length() const;
+    bool isEmpty() const;
+
+    // Editing
+    void insert(int position, const QString &text);
+    void remove(int position, int length);
+
+    // Lines ('\n' separated, the line break is not part of the line)
+    int lineCount() const;
+    int lineStart(int line) const;
+    int lineLength(int line) const;
+    QString line(int line) const;
+    int lineAt(int position) const;
+
+    Snapshot snapshot() const;
+
+private:
+    static const int OriginalBuffer = 0;
+    static const int BlockSize = 64 * 1024;
+
+    struct Node {
+        int left;
+        int right;
+        quint32 priority;
+        int buffer;
+        int start;
+        int length;
+        int lineBreaks;
+        int subtreeLength;
+        int subtreeLineBreaks;
+    };
+
+    // Node pool
+    int createNode(int buffer, int start, int length);
+    void releaseTree(int node);
+    quint32 nextPriority();
+
+    // Treap primitives
+    void update(int node);
+    void split(int node, int position, int &left, int &right);
+    int merge(int left, int right);
+    bool extendLastPiece(int node, int buffer, int start, int length);
+
+    // Helpers
+    int subtreeLength(int node) const;
+    int subtreeLineBreaks(int node) const;
+    int countLineBreaks(int buffer, int start, int length) const;
+    void appendText(int node, int position, int length, int offset, QString &out) const;
+    void collectPieces(int node, QVector<Piece> &pieces) const;
+    static void indexLineBreaks(const QString &text, int offset, QVector<int> &lineBreaks);
+
+    // m_buffers[OriginalBuffer] is the loaded text, the rest are add blocks
+    QVector<QString> m_buffers;
+    // Buffer offsets of every '\n', per buffer, in ascending order
+    QVector<QVector<int>> m_lineBreaks;
+
+    QVector<Node> m_nodes;
+    QVector<int> m_freeNodes;
+    int m_root;
+    quint32 m_seed;
+};
+
+#endif // PIECETABLE_H
@@ -0,0 +1,657 @@
+#include "quickopenmodel.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QUICKOPEN_SSE2
+#endif
+
+// Paths scored by one task at least; smaller lists are not worth splitting
+static const int MinimumPathsPerTask = 8192;
+// Folders are watched again after a burst of changes has settled
+static const int RefreshDelay = 1000;
+
+// Score weights
+static const int ScoreMatch = 16;
+static const int BonusSeparator = 10;
+static const int BonusBoundary = 8;
+static const int BonusCamelCase = 7;
+static const int BonusConsecutive = 5;
+static const int BonusFileName = 20;
+static const int PenaltyGapStart = 3;
+static const int PenaltyGapExtension = 1;
+static const int MaxGapExtension = 8;
+
+static inline uchar foldByte(uchar byte)
+{
+    return (byte >= 'A' && byte <= 'Z') ? uchar(byte | 0x20) : byte;
+}
+
+// Character class of a byte in the path and query masks
+static inline int maskBit(uchar byte)
+{
+    byte = foldByte(byte);
+    if (byte >= 'a' && byte <= 'z') {
+        return byte - 'a';
+    }
+    if (byte >= '0' && byte <= '9') {
+        return 26 + (byte - '0');
+    }
+    switch (byte) {
+    case '.':
+        return 36;
+    case '_':
+        return 37;
+    case '-':
+        return 38;
+    case '/':
+        return 39;
+    default:
+        return 40 + byte % 24;
+    }
+}
+
+static quint64 characterMask(const char *data, int length)
+{
+    quint64 mask = 0;
+    for (int i = 0; i < length; ++i) {
+        mask |= quint64(1) << maskBit(uchar(data[i]));
+    }
+    return mask;
+}
+
+// Scores a path as a subsequence match of a folded query, or returns -1.
+// The matched byte offsets go to positions if given.
+static int scorePath(const char *folded, const char *original, int length, int nameStart,
+                     const QByteArray &query, QVector<int> *positions)
+{
+    const int queryLength = query.size();
+
+    // The leftmost match that ends first, tried in the file name before the
+    // whole path
+    int last = -1;
+    int from = nameStart;
+    for (int attempt = 0; attempt < 2 && last < 0; ++attempt, from = 0) {
+        const char *position = folded + from;
+        const char *end = folded + length;
+        int i = 0;
+        for (; i < queryLength; ++i) {
+            const char *hit = static_cast<const char *>(std::memchr(position, query.at(i), size_t(end - position)));
+            if (!hit) {
+                break;
+            }
+            position = hit + 1;
+        }
+        if (i == queryLength) {
+            last = int(position - folded) - 1;
+        } else if (from == 0) {
+            return -1;
+        }
+    }
+
+    // Walking back from the end finds the shortest window with that end
+    int start = last;
+    for (int i = last, remaining = queryLength - 1; i >= 0; --i) {
+        if (folded[i] == query.at(remaining) && --remaining < 0) {
+            start = i;
+            break;
+        }
+    }
+
+    int score = 0;
+    int previous = -1;
+    for (int i = start, next = 0; next < queryLength; ++i) {
+        if (folded[i] != query.at(next)) {
+            continue;
+        }
+
+        int bonus = 0;
+        if (i == 0) {
+            bonus = BonusSeparator;
+        } else {
+            const uchar before = uchar(original[i - 1]);
+            const uchar here = uchar(original[i]);
+            if (before == '/') {
+                bonus = BonusSeparator;
+            } else if (before == '_' || before == '-' || before == '.' || before == ' ') {
+                bonus = BonusBoundary;
+            } else if (before >= 'a' && before <= 'z' && here >= 'A' && here <= 'Z') {
+                bonus = BonusCamelCase;
+            }
+        }
+
+        if (previous >= 0 && i == previous + 1) {
+            bonus += BonusConsecutive;
+        } else if (previous >= 0) {
+            score -= PenaltyGapStart + qMin(i - previous - 2, MaxGapExtension) * PenaltyGapExtension;
+        }
+
+        score += ScoreMatch + bonus;
+        if (positions) {
+            positions->append(i);
+        }
+        previous = i;
+        ++next;
+    }
+
+    if (start >= nameStart) {
+        score += BonusFileName;
+    }
+    // Shorter paths first among equal matches
+    return score - length / 8;
+}
+
+// Part of a path as rich text with the matched bytes in bold
+static QString highlight(const char *data, int begin, int end, const QVector<int> &positions)
+{
+    QString html;
+    int plainStart = begin;
+    int i = 0;
+    while (i < positions.size() && positions.at(i) < begin) {
+        ++i;
+    }
+
+    while (i < positions.size() && positions.at(i) < end) {
+        // Runs of matched bytes, widened to whole UTF-8 sequences
+        int runStart = positions.at(i);
+        int runEnd = runStart + 1;
+        while (++i < positions.size() && positions.at(i) == runEnd && runEnd < end) {
+            ++runEnd;
+        }
+        while (runStart > plainStart && (uchar(data[runStart]) & 0xc0) == 0x80) {
+            --runStart;
+        }
+        while (runEnd < end && (uchar(data[runEnd]) & 0xc0) == 0x80) {
+            ++runEnd;
+        }
+
+        html += QString::fromUtf8(data + plainStart, runStart - plainStart).toHtmlEscaped();
+        html += "<b>" + QString::fromUtf8(data + runStart, runEnd - runStart).toHtmlEscaped() + "</b>";
+        plainStart = runEnd;
+        while (i < positions.size() && positions.at(i) < runEnd) {
+            ++i;
+        }
+    }
+
+    html += QString::fromUtf8(data + plainStart, end - plainStart).toHtmlEscaped();
+    return html;
+}
+
+namespace {
+
+struct Candidate
+{
+    int score;
+    quint32 entry;
+};
+
+// Heap order: the worst candidate is on top and goes first
+inline bool isBetter(const Candidate &a, const Candidate &b)
+{
+    return a.score != b.score ? a.score > b.score : a.entry < b.entry;
+}
+
+}
+
+// Lists the files below a folder on a worker thread
+class QuickOpenIndexer : public QThread
+{
+public:
+    QuickOpenIndexer(const QString &rootPath, QObject *parent)
+        : QThread(parent)
+        , m_rootPath(rootPath)
+        , m_cancelled(0)
+    {
+    }
+
+    ~QuickOpenIndexer()
+    {
+        // Never destroy a running thread
+        m_cancelled.storeRelaxed(1);
+        wait();
+    }
+
+    QSharedPointer<QuickOpenPaths> paths() const
+    {
+        return m_paths;
+    }
+
+protected:
+    void run() override
+    {
+        QSharedPointer<QuickOpenPaths> paths = QSharedPointer<QuickOpenPaths>::create();
+        paths->offsets.append(0);
+
+        // Hidden entries are skipped by leaving out QDir::Hidden
+        const QDir root(m_rootPath);
+        QDirIterator it(m_rootPath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks,
+                        QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            if (m_cancelled.loadRelaxed()) {
+                return;
+            }
+
+            const QString filePath = it.next();
+            if (it.fileInfo().isDir()) {
+                paths->directories.append(filePath);
+                continue;
+            }
+
+            const QByteArray relativePath = root.relativeFilePath(filePath).toUtf8();
+            const quint32 start = quint32(paths->paths.size());
+            const int slash = relativePath.lastIndexOf('/');
+            paths->paths += relativePath;
+            paths->offsets.append(quint32(paths->paths.size()));
+            paths->nameOffsets.append(start + quint32(slash + 1));
+            paths->masks.append(characterMask(relativePath.constData(), relativePath.size()));
+        }
+
+        paths->folded = paths->paths;
+        char *folded = paths->folded.data();
+        for (int i = 0; i < paths->folded.size(); ++i) {
+            folded[i] = char(foldByte(uchar(folded[i])));
+        }
+        m_paths = paths;
+    }
+
+private:
+    QString m_rootPath;
+    QAtomicInt m_cancelled;
+    QSharedPointer<QuickOpenPaths> m_paths;
+};
+
+// Shared state of one query, owned by the model and every task of it
+class QuickOpenJob
+{
+public:
+    QuickOpenJob(QuickOpenModel *model, int generation, const QSharedPointer<const QuickOpenPaths> &paths,
+                 const QByteArray &query)
+        : model(model)
+        , generation(generation)
+        , paths(paths)
+        , query(query)
+        , mask(characterMask(query.constData(), query.size()))
+        , cancelled(0)
+        , pendingTasks(0)
+    {
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled.loadRelaxed() != 0;
+    }
+
+    // Adds the best candidates of a task; the last task publishes the results
+    void finishTask(const std::vector<Candidate> &candidates)
+    {
+        {
+            QMutexLocker locker(&mutex);
+            merged.insert(merged.end(), candidates.begin(), candidates.end());
+        }
+        if (pendingTasks.deref() || isCancelled()) {
+            return;
+        }
+
+        std::sort(merged.begin(), merged.end(), isBetter);
+        if (merged.size() > size_t(QuickOpenModel::MaxResults)) {
+            merged.resize(QuickOpenModel::MaxResults);
+        }
+
+        QVector<QuickOpenResult> results;
+        results.reserve(int(merged.size()));
+        for (const Candidate &candidate : merged) {
+            const int start = int(paths->offsets.at(int(candidate.entry)));
+            const int length = int(paths->offsets.at(int(candidate.entry) + 1)) - start;
+            const int nameStart = int(paths->nameOffsets.at(int(candidate.entry))) - start;
+            const char *original = paths->paths.constData() + start;
+
+            QVector<int> positions;
+            scorePath(paths->folded.constData() + start, original, length, nameStart, query, &positions);
+
+            QuickOpenResult result;
+            result.relativePath = QString::fromUtf8(original, length);
+            result.fileName = QString::fromUtf8(original + nameStart, length - nameStart);
+            result.highlightedName = highlight(original, nameStart, length, positions);
+            result.highlightedDirectory = highlight(original, 0, qMax(0, nameStart - 1), positions);
+            result.score = candidate.score;
+            results.append(result);
+        }
+
+        QuickOpenModel *target = model;
+        const int queryGeneration = generation;
+        QMetaObject::invokeMethod(model, [target, queryGeneration, results]() {
+            target->setResults(queryGeneration, results);
+        }, Qt::QueuedConnection);
+    }
+
+    QuickOpenModel *model;
+    const int generation;
+    const QSharedPointer<const QuickOpenPaths> paths;
+    const QByteArray query;
+    const quint64 mask;
+    QAtomicInt cancelled;
+    QAtomicInt pendingTasks;
+    QMutex mutex;
+    std::vector<Candidate> merged;
+};
+
+// Scores a range of paths and keeps the best in a bounded heap
+class QuickOpenTask : public QRunnable
+{
+public:
+    QuickOpenTask(const QSharedPointer<QuickOpenJob> &job, int begin, int end)
+        : m_job(job)
+        , m_begin(begin)
+        , m_end(end)
+    {
+    }
+
+    void run() override
+    {
+        const QuickOpenPaths &paths = *m_job->paths;
+        const quint64 *masks = paths.masks.constData();
+        const quint64 mask = m_job->mask;
+        int i = m_begin;
+
+#ifdef QUICKOPEN_SSE2
+        // Two masks at a time: a path is a candidate if no bit of the query
+        // mask is missing from its own
+        const __m128i queryMask = _mm_set_epi32(int(mask >> 32), int(mask), int(mask >> 32), int(mask));
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 2 <= m_end; i += 2) {
+            if ((i & 1023) == 0 && m_job->isCancelled()) {
+                break;
+            }
+            const __m128i pathMasks = _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks + i));
+            const __m128i missing = _mm_xor_si128(_mm_and_si128(pathMasks, queryMask), queryMask);
+            const int present = _mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero));
+            if ((present & 0x00ff) == 0x00ff) {
+                consider(paths, i);
+            }
+            if ((present & 0xff00) == 0xff00) {
+                consider(paths, i + 1);
+            }
+        }
+#endif
+
+        for (; i < m_end; ++i) {
+            if ((i & 1023) == 0 && m_job->isCancelled()) {
+                break;
+            }
+            if ((masks[i] & mask) == mask) {
+                consider(paths, i);
+            }
+        }
+
+        m_job->finishTask(m_heap);
+    }
+
+private:
+    void consider(const QuickOpenPaths &paths, int entry)
+    {
+        const int start = int(paths.offsets.at(entry));
+        const int length = int(paths.offsets.at(entry + 1)) - start;
+        const int score = scorePath(paths.folded.constData() + start, paths.paths.constData() + start, length,
+                                    int(paths.nameOffsets.at(entry)) - start, m_job->query, nullptr);
+        if (score == -1) {
+            return;
+        }
+
+        const Candidate candidate = { score, quint32(entry) };
+        if (m_heap.size() < size_t(QuickOpenModel::MaxResults)) {
+            m_heap.push_back(candidate);
+            std::push_heap(m_heap.begin(), m_heap.end(), isBetter);
+        } else if (isBetter(candidate, m_heap.front())) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), isBetter);
+            m_heap.back() = candidate;
+            std::push_heap(m_heap.begin(), m_heap.end(), isBetter);
+        }
+    }
+
+    QSharedPointer<QuickOpenJob> m_job;
+    int m_begin;
+    int m_end;
+    std::vector<Candidate> m_heap;
+};
+
+QuickOpenModel::QuickOpenModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_indexer(nullptr)
+    , m_refreshPending(false)
+    , m_generation(0)
+{
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(RefreshDelay);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &QuickOpenModel::refresh);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, &m_refreshTimer,
+            static_cast<void (QTimer::*)()>(&QTimer::start));
+}
+
+QuickOpenModel::~QuickOpenModel()
+{
+    // Tasks point back at this model
+    if (m_job) {
+        m_job->cancelled.storeRelaxed(1);
+    }
+    m_pool.waitForDone();
+    delete m_indexer;
+}
+
+QString QuickOpenModel::rootPath() const
+{
+    return m_rootPath;
+}
+
+void QuickOpenModel::setRootPath(const QString &path)
+{
+    if (m_rootPath == path) {
+        return;
+    }
+
+    delete m_indexer;
+    m_indexer = nullptr;
+    m_refreshPending = false;
+    m_refreshTimer.stop();
+    if (!m_watcher.directories().isEmpty()) {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+
+    m_rootPath = path;
+    m_paths.clear();
+    emit rootPathChanged();
+    emit fileCountChanged();
+
+    startQuery();
+    if (!m_rootPath.isEmpty()) {
+        refresh();
+    } else {
+        emit indexingChanged();
+    }
+}
+
+QString QuickOpenModel::query() const
+{
+    return m_query;
+}
+
+void QuickOpenModel::setQuery(const QString &query)
+{
+    if (m_query == query) {
+        return;
+    }
+
+    m_query = query;
+    emit queryChanged();
+    startQuery();
+}
+
+int QuickOpenModel::fileCount() const
+{
+    return m_paths ? m_paths->count() : 0;
+}
+
+bool QuickOpenModel::isIndexing() const
+{
+    return m_indexer != nullptr;
+}
+
+void QuickOpenModel::refresh()
+{
+    if (m_rootPath.isEmpty()) {
+        return;
+    }
+    // Changes during a walk are picked up by another one
+    if (m_indexer) {
+        m_refreshPending = true;
+        return;
+    }
+
+    QuickOpenIndexer *indexer = new QuickOpenIndexer(m_rootPath, this);
+    connect(indexer, &QThread::finished, this, [this, indexer]() {
+        if (indexer == m_indexer) {
+            finishIndexing();
+        }
+    });
+    m_indexer = indexer;
+    indexer->start();
+    emit indexingChanged();
+}
+
+QString QuickOpenModel::filePath(int row) const
+{
+    if (row < 0 || row >= m_results.size()) {
+        return QString();
+    }
+    return QDir(m_rootPath).filePath(m_results.at(row).relativePath);
+}
+
+void QuickOpenModel::startQuery()
+{
+    if (m_job) {
+        m_job->cancelled.storeRelaxed(1);
+        m_job.clear();
+    }
+    // Whatever is still queued for the previous query is dropped
+    ++m_generation;
+
+    // Spaces only separate parts of the query
+    QByteArray query = m_query.toUtf8();
+    query.replace(' ', QByteArray());
+    for (int i = 0; i < query.size(); ++i) {
+        query[i] = char(foldByte(uchar(query.at(i))));
+    }
+
+    if (query.isEmpty() || !m_paths || m_paths->count() == 0) {
+        setResults(m_generation, QVector<QuickOpenResult>());
+        return;
+    }
+
+    m_job = QSharedPointer<QuickOpenJob>::create(this, m_generation, m_paths, query);
+    const int count = m_paths->count();
+    const int taskCount = qBound(1, count / MinimumPathsPerTask, qMax(1, m_pool.maxThreadCount() * 4));
+    const int perTask = (count + taskCount - 1) / taskCount;
+
+    m_job->pendingTasks.storeRelaxed(taskCount);
+    for (int begin = 0, task = 0; task < taskCount; ++task, begin += perTask) {
+        m_pool.start(new QuickOpenTask(m_job, begin, qMin(begin + perTask, count)));
+    }
+}
+
+void QuickOpenModel::setResults(int generation, const QVector<QuickOpenResult> &results)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    beginResetModel();
+    m_results = results;
+    endResetModel();
+}
+
+void QuickOpenModel::finishIndexing()
+{
+    QuickOpenIndexer *indexer = m_indexer;
+    m_indexer = nullptr;
+    indexer->deleteLater();
+
+    if (indexer->paths()) {
+        m_paths = indexer->paths();
+        emit fileCountChanged();
+        watchDirectories();
+        startQuery();
+    }
+    emit indexingChanged();
+
+    if (m_refreshPending) {
+        m_refreshPending = false;
+        refresh();
+    }
+}
+
+void QuickOpenModel::watchDirectories()
+{
+    if (!m_watcher.directories().isEmpty()) {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+
+    QStringList directories;
+    directories.append(m_rootPath);
+    directories += m_paths->directories.mid(0, MaxWatchedDirectories - 1);
+    m_watcher.addPaths(directories);
+}
+
+int QuickOpenModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_results.size();
+}
+
+QVariant QuickOpenModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_results.size()) {
+        return QVariant();
+    }
+
+    const QuickOpenResult &result = m_results.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case RelativePathRole:
+        return result.relativePath;
+    case FilePathRole:
+        return filePath(index.row());
+    case FileNameRole:
+        return result.fileName;
+    case HighlightedNameRole:
+        return result.highlightedName;
+    case HighlightedDirectoryRole:
+        return result.highlightedDirectory;
+    case ScoreRole:
+        return result.score;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> QuickOpenModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[FilePathRole] = "filePath";
+    roles[FileNameRole] = "fileName";
+    roles[RelativePathRole] = "relativePath";
+    roles[HighlightedNameRole] = "highlightedName";
+    roles[HighlightedDirectoryRole] = "highlightedDirectory";
+    roles[ScoreRole] = "score";
+    return roles;
+}
@@ -0,0 +1,126 @@
+#ifndef QUICKOPENMODEL_H
+#define QUICKOPENMODEL_H
+
+#include <QAbstractListModel>
+#include <QFileSystemWatcher>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QTimer>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QuickOpenIndexer;
+class QuickOpenJob;
+
+// Every file below a folder, stored back to back instead of one string per
+// path. Shared read-only between the model and the scoring tasks.
+struct QuickOpenPaths
+{
+    // UTF-8 relative paths and the same with ASCII letters lower-cased
+    QByteArray paths;
+    QByteArray folded;
+    // Start of every path, plus the end of the last one
+    QVector<quint32> offsets;
+    // Start of the file name of every path
+    QVector<quint32> nameOffsets;
+    // Characters present in every path, one bit per character class
+    QVector<quint64> masks;
+    // Folders below the root, for change notifications
+    QStringList directories;
+
+    int count() const { return offsets.size() - 1; }
+};
+
+// A ranked quick-open result
+struct QuickOpenResult
+{
+    QString relativePath;
+    QString fileName;
+    // Rich text with the matched characters in bold
+    QString highlightedName;
+    QString highlightedDirectory;
+    int score;
+};
+
+// Fuzzy file finder over a flat list of the paths below a root folder.
+//
+// The list is built by a worker thread and rebuilt when a watched folder
+// changes. A query is scored in parallel: the paths are split into ranges,
+// each task drops paths missing a character of the query with a vectorized
+// test on precomputed character masks, scores the rest as subsequence
+// matches, and keeps its best results in a bounded heap. The last task to
+// finish merges the heaps and hands the top results to the model; results of
+// a superseded query are dropped.
+class QuickOpenModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString rootPath READ rootPath WRITE setRootPath NOTIFY rootPathChanged)
+    Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged)
+    Q_PROPERTY(int fileCount READ fileCount NOTIFY fileCountChanged)
+    Q_PROPERTY(bool indexing READ isIndexing NOTIFY indexingChanged)
+
+public:
+    enum Roles {
+        FilePathRole = Qt::UserRole + 1,
+        FileNameRole,
+        RelativePathRole,
+        HighlightedNameRole,
+        HighlightedDirectoryRole,
+        ScoreRole
+    };
+
+    explicit QuickOpenModel(QObject *parent = nullptr);
+    ~QuickOpenModel();
+
+    QString rootPath() const;
+    void setRootPath(const QString &path);
+    QString query() const;
+    void setQuery(const QString &query);
+    int fileCount() const;
+    bool isIndexing() const;
+
+    // Rebuilds the path list in the background
+    Q_INVOKABLE void refresh();
+    Q_INVOKABLE QString filePath(int row) const;
+
+    // QAbstractListModel implementation
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void rootPathChanged();
+    void queryChanged();
+    void fileCountChanged();
+    void indexingChanged();
+
+private:
+    friend class QuickOpenJob;
+    friend class QuickOpenTask;
+
+    // Results kept per query
+    static const int MaxResults = 100;
+    // Folders watched for changes; larger trees are refreshed on demand
+    static const int MaxWatchedDirectories = 4096;
+
+    void startQuery();
+    void setResults(int generation, const QVector<QuickOpenResult> &results);
+    void finishIndexing();
+    void watchDirectories();
+
+    QString m_rootPath;
+    QString m_query;
+    QSharedPointer<const QuickOpenPaths> m_paths;
+    QuickOpenIndexer *m_indexer;
+    bool m_refreshPending;
+    QThreadPool m_pool;
+    QSharedPointer<QuickOpenJob> m_job;
+    int m_generation;
+    QVector<QuickOpenResult> m_results;
+    QFileSystemWatcher m_watcher;
+    QTimer m_refreshTimer;
+};
+
+#endif // QUICKOPENMODEL_H
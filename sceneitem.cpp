@@ -0,0 +1,31 @@
+#include "sceneitem.h"
+#include <QMouseEvent>
+#include <QQuickWindow>
+
+ImageTextureNode::ImageTextureNode()
+    : version(0)
+    , m_texture(nullptr)
+{
+}
+
+ImageTextureNode::~ImageTextureNode()
+{
+    delete m_texture;
+}
+
+void ImageTextureNode::setImage(QQuickWindow *window, const QImage &image)
+{
+    QSGTexture *texture = window->createTextureFromImage(image);
+    setTexture(texture);
+    delete m_texture;
+    m_texture = texture;
+}
+
+QPointF eventPosition(const QMouseEvent *event)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return event->position();
+#else
+    return event->localPos();
+#endif
+}
@@ -0,0 +1,32 @@
+#ifndef SCENEITEM_H
+#define SCENEITEM_H
+#include <QImage>
+#include <QPointF>
+#include <QSGSimpleTextureNode>
+
+class QMouseEvent;
+class QQuickWindow;
+
+// Helpers shared by the items drawn straight into the scene graph, the
+// editor and the minimap
+
+// A node textured with an image painted off the render thread. version
+// tells the item which content the image shows.
+class ImageTextureNode : public QSGSimpleTextureNode
+{
+public:
+    ImageTextureNode();
+    ~ImageTextureNode();
+
+    void setImage(QQuickWindow *window, const QImage &image);
+
+    quint64 version;
+
+private:
+    QSGTexture *m_texture;
+};
+
+// Position of a mouse event in item coordinates
+QPointF eventPosition(const QMouseEvent *event);
+
+#endif // SCENEITEM_H
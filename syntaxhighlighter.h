@@ -1,51 +0,0 @@
-#ifndef SYNTAXHIGHLIGHTER_H
-#define SYNTAXHIGHLIGHTER_H
-
-#include <QSyntaxHighlighter>
-#include <QTextDocument>
-#include <QRegularExpression>
-#include <QTextCharFormat>
-#include <QVector>
-#include <QColor>
-
-class SyntaxHighlighter : public QSyntaxHighlighter
-{
-    Q_OBJECT
-
-public:
-    explicit SyntaxHighlighter(QTextDocument *parent = nullptr);
-    void setLanguage(const QString &language);
-
-protected:
-    void highlightBlock(const QString &text) override;
-
-private:
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-
-    void setupCppRules();
-    void setupJavaScriptRules();
-    void setupPythonRules();
-    void setupQmlRules();
-    void setupGenericRules();
-
-    QVector<HighlightingRule> highlightingRules;
-
-    // Multi-line comment handling
-    QRegularExpression commentStartExpression;
-    QRegularExpression commentEndExpression;
-    QTextCharFormat multiLineCommentFormat;
-
-    // Different formatting styles
-    QTextCharFormat keywordFormat;
-    QTextCharFormat classFormat;
-    QTextCharFormat functionFormat;
-    QTextCharFormat numberFormat;
-    QTextCharFormat stringFormat;
-    QTextCharFormat commentFormat;
-    QTextCharFormat preprocessorFormat;
-};
-
-#endif // SYNTAXHIGHLIGHTER_H
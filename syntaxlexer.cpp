@@ -0,0 +1,430 @@
+#include "syntaxlexer.h"
+#include "languagecache.h"
+#include <QDataStream>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringView>
+
+namespace {
+
+bool isAscii(const QString &text)
+{
+    for (const QChar c : text) {
+        if (c.unicode() >= 128) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool isBlank(ushort c)
+{
+    return c == ' ' || c == '\t';
+}
+
+}
+
+SyntaxLexer::Definition SyntaxLexer::genericDefinition()
+{
+    // Strings, numbers and C-style block comments
+    Definition definition;
+    definition.name = "generic";
+    definition.blockCommentStart = "/*";
+    definition.blockCommentEnd = "*/";
+    definition.strings = { { "\"", "\"", QLatin1Char('\\'), false },
+                           { "'", "'", QLatin1Char('\\'), false } };
+    return definition;
+}
+
+QString SyntaxLexer::languageForExtension(const QString &fileExtension)
+{
+    const QString name = LanguageCache::languageForExtension(fileExtension.toLower());
+    return name.isEmpty() ? QString("generic") : name;
+}
+
+QSharedPointer<const SyntaxLexer> SyntaxLexer::forLanguage(const QString &name)
+{
+    // Kept even when no document uses them, a language is only read from
+    // the cache once; highlighters may ask from any thread
+    static QMutex mutex;
+    static QHash<QString, QSharedPointer<const SyntaxLexer>> lexers;
+
+    QMutexLocker locker(&mutex);
+    QSharedPointer<const SyntaxLexer> lexer = lexers.value(name);
+    if (!lexer) {
+        lexer = LanguageCache::loadLexer(name);
+        if (!lexer) {
+            // Unknown languages share the generic lexer
+            lexer = lexers.value("generic");
+            if (!lexer) {
+                lexer = QSharedPointer<const SyntaxLexer>(new SyntaxLexer(genericDefinition()));
+                lexers.insert("generic", lexer);
+            }
+        }
+        lexers.insert(name, lexer);
+    }
+    return lexer;
+}
+
+SyntaxLexer::SyntaxLexer()
+    : SyntaxLexer(genericDefinition())
+{
+}
+
+SyntaxLexer::SyntaxLexer(const Definition &definition)
+    : m_name(definition.name)
+    , m_preprocessor(definition.preprocessor)
+    , m_highlightCalls(definition.highlightCalls)
+    , m_delimiterStates(AsciiCount, -1)
+    , m_delimiterRegions(1, -1)
+    , m_wordStates(WordCharacterCount, -1)
+    , m_wordFlags(1, 0)
+{
+    auto addRegion = [this](const QString &open, const QString &close, TokenType type, QChar escape,
+                            bool multiLine) {
+        // Delimiters are matched through ASCII tables
+        if (open.isEmpty() || !isAscii(open) || !isAscii(close)) {
+            return;
+        }
+
+        Region region;
+        region.type = type;
+        region.escape = escape.unicode();
+        region.multiLine = multiLine && !close.isEmpty();
+        region.closeLength = close.length();
+
+        // KMP automaton: row j is the state with the first j characters of
+        // the delimiter matched, mismatches fall back to the longest border
+        region.closeStates.fill(0, close.length() * AsciiCount);
+        if (!close.isEmpty()) {
+            region.closeStates[close.at(0).unicode()] = 1;
+            int border = 0;
+            for (int j = 1; j < close.length(); ++j) {
+                for (int c = 0; c < AsciiCount; ++c) {
+                    region.closeStates[j * AsciiCount + c] = region.closeStates.at(border * AsciiCount + c);
+                }
+                region.closeStates[j * AsciiCount + close.at(j).unicode()] = qint16(j + 1);
+                border = region.closeStates.at(border * AsciiCount + close.at(j).unicode());
+            }
+        }
+
+        m_regions.append(region);
+        addDelimiter(open, m_regions.size() - 1);
+    };
+
+    if (!definition.lineComment.isEmpty()) {
+        addRegion(definition.lineComment, QString(), Comment, QChar(), false);
+    }
+    if (!definition.blockCommentStart.isEmpty() && !definition.blockCommentEnd.isEmpty()) {
+        addRegion(definition.blockCommentStart, definition.blockCommentEnd, Comment, QChar(), true);
+    }
+    for (const StringRule &rule : definition.strings) {
+        addRegion(rule.open, rule.close.isEmpty() ? rule.open : rule.close, String, rule.escape, rule.multiLine);
+    }
+
+    for (const QString &word : definition.keywords) {
+        addWord(word, IsKeyword);
+    }
+    for (const QString &word : definition.typeIntroducers) {
+        addWord(word, IntroducesType);
+    }
+    for (const QString &word : definition.functionIntroducers) {
+        addWord(word, IntroducesFunction);
+    }
+}
+
+QString SyntaxLexer::name() const
+{
+    return m_name;
+}
+
+void SyntaxLexer::writeTables(QDataStream &stream) const
+{
+    stream << m_name << m_preprocessor << m_highlightCalls << quint32(m_regions.size());
+    for (const Region &region : m_regions) {
+        stream << quint8(region.type) << region.escape << region.multiLine << qint32(region.closeLength)
+               << region.closeStates;
+    }
+    stream << m_delimiterStates << m_delimiterRegions << m_wordStates << m_wordFlags;
+}
+
+bool SyntaxLexer::readTables(QDataStream &stream)
+{
+    quint32 regionCount;
+    stream >> m_name >> m_preprocessor >> m_highlightCalls >> regionCount;
+
+    m_regions.clear();
+    for (quint32 i = 0; i < regionCount && stream.status() == QDataStream::Ok; ++i) {
+        Region region;
+        quint8 type;
+        qint32 closeLength;
+        stream >> type >> region.escape >> region.multiLine >> closeLength >> region.closeStates;
+        if (type >= TokenTypeCount || closeLength < 0 || region.closeStates.size() != closeLength * AsciiCount) {
+            return false;
+        }
+        region.type = TokenType(type);
+        region.closeLength = closeLength;
+        m_regions.append(region);
+    }
+    stream >> m_delimiterStates >> m_delimiterRegions >> m_wordStates >> m_wordFlags;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // Tables from a damaged file must not send the lexer out of bounds
+    const int delimiterCount = m_delimiterRegions.size();
+    const int wordCount = m_wordFlags.size();
+    if (delimiterCount == 0 || m_delimiterStates.size() != delimiterCount * AsciiCount
+        || wordCount == 0 || m_wordStates.size() != wordCount * WordCharacterCount) {
+        return false;
+    }
+    for (const Region &region : std::as_const(m_regions)) {
+        for (const qint16 state : region.closeStates) {
+            if (state < 0 || state > region.closeLength) {
+                return false;
+            }
+        }
+    }
+    for (const qint16 state : std::as_const(m_delimiterStates)) {
+        if (state >= delimiterCount) {
+            return false;
+        }
+    }
+    for (const qint16 region : std::as_const(m_delimiterRegions)) {
+        if (region >= m_regions.size()) {
+            return false;
+        }
+    }
+    for (const qint16 state : std::as_const(m_wordStates)) {
+        if (state >= wordCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SyntaxLexer::addDelimiter(const QString &open, int region)
+{
+    int state = 0;
+    for (const QChar c : open) {
+        const int index = state * AsciiCount + c.unicode();
+        if (m_delimiterStates.at(index) < 0) {
+            m_delimiterStates[index] = qint16(m_delimiterRegions.size());
+            m_delimiterRegions.append(-1);
+            m_delimiterStates.insert(m_delimiterStates.size(), AsciiCount, -1);
+        }
+        state = m_delimiterStates.at(index);
+    }
+
+    // A delimiter given twice keeps its first meaning
+    if (m_delimiterRegions.at(state) < 0) {
+        m_delimiterRegions[state] = qint16(region);
+    }
+}
+
+void SyntaxLexer::addWord(const QString &word, int flag)
+{
+    for (const QChar c : word) {
+        if (wordIndex(c.unicode()) < 0) {
+            return;
+        }
+    }
+
+    int state = 0;
+    for (const QChar c : word) {
+        const int index = state * WordCharacterCount + wordIndex(c.unicode());
+        if (m_wordStates.at(index) < 0) {
+            m_wordStates[index] = qint16(m_wordFlags.size());
+            m_wordFlags.append(0);
+            m_wordStates.insert(m_wordStates.size(), WordCharacterCount, -1);
+        }
+        state = m_wordStates.at(index);
+    }
+    m_wordFlags[state] |= quint8(flag);
+}
+
+int SyntaxLexer::wordIndex(ushort c)
+{
+    // Characters of \w: a-z, A-Z, 0-9 and '_'
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 26 + c - 'A';
+    }
+    if (c >= '0' && c <= '9') {
+        return 52 + c - '0';
+    }
+    return c == '_' ? 62 : -1;
+}
+
+int SyntaxLexer::findRegionEnd(const Region &region, const QChar *text, int length, int from) const
+{
+    if (region.closeLength == 0) {
+        return -1;
+    }
+
+    const qint16 *states = region.closeStates.constData();
+    int state = 0;
+    for (int i = from; i < length; ++i) {
+        const ushort c = text[i].unicode();
+        if (region.escape && c == region.escape) {
+            // The escaped character, whatever it is, does not close
+            ++i;
+            state = 0;
+            continue;
+        }
+        state = c < AsciiCount ? states[state * AsciiCount + c] : 0;
+        if (state == region.closeLength) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+int SyntaxLexer::lexLine(const QChar *text, int length, int state, QVector<Token> &tokens) const
+{
+    int i = 0;
+
+    if (state > 0 && state <= m_regions.size()) {
+        // Inside a comment or string left open by the previous line
+        const Region &region = m_regions.at(state - 1);
+        const int end = findRegionEnd(region, text, length, 0);
+        if (end < 0) {
+            if (length > 0) {
+                tokens.append({ 0, length, region.type });
+            }
+            return state;
+        }
+        tokens.append({ 0, end, region.type });
+        i = end;
+    } else if (!m_preprocessor.isEmpty()) {
+        // A directive: the marker and the word after it
+        int start = 0;
+        while (start < length && isBlank(text[start].unicode())) {
+            ++start;
+        }
+        if (QStringView(text + start, length - start).startsWith(m_preprocessor)) {
+            int end = start + m_preprocessor.length();
+            while (end < length && isBlank(text[end].unicode())) {
+                ++end;
+            }
+            while (end < length && (wordIndex(text[end].unicode()) >= 0 || text[end].isLetter())) {
+                ++end;
+            }
+            tokens.append({ start, end - start, Preprocessor });
+            i = end;
+        }
+    }
+
+    const qint16 *delimiterStates = m_delimiterStates.constData();
+    const qint16 *wordStates = m_wordStates.constData();
+
+    // Set after a word that introduces a name, until something other than
+    // blanks and a ':' comes
+    int nameType = -1;
+
+    while (i < length) {
+        const ushort c = text[i].unicode();
+
+        // Comments and strings, by the longest delimiter starting here
+        if (c < AsciiCount && delimiterStates[c] >= 0) {
+            int delimiterState = delimiterStates[c];
+            int region = m_delimiterRegions.at(delimiterState);
+            int openEnd = i + 1;
+            for (int j = i + 1; j < length; ++j) {
+                const ushort next = text[j].unicode();
+                if (next >= AsciiCount || delimiterStates[delimiterState * AsciiCount + next] < 0) {
+                    break;
+                }
+                delimiterState = delimiterStates[delimiterState * AsciiCount + next];
+                if (m_delimiterRegions.at(delimiterState) >= 0) {
+                    region = m_delimiterRegions.at(delimiterState);
+                    openEnd = j + 1;
+                }
+            }
+
+            if (region >= 0) {
+                const Region &open = m_regions.at(region);
+                const int end = findRegionEnd(open, text, length, openEnd);
+                if (end < 0) {
+                    tokens.append({ i, length - i, open.type });
+                    return open.multiLine ? region + 1 : 0;
+                }
+                tokens.append({ i, end - i, open.type });
+                i = end;
+                nameType = -1;
+                continue;
+            }
+        }
+
+        const int index = c < AsciiCount ? wordIndex(c) : -1;
+
+        // Numbers run on through letters, digits and dots, which covers
+        // hexadecimal, exponents and suffixes
+        if (index >= 52 && index <= 61) {
+            int end = i + 1;
+            while (end < length && (wordIndex(text[end].unicode()) >= 0 || text[end] == QLatin1Char('.'))) {
+                ++end;
+            }
+            tokens.append({ i, end - i, Number });
+            i = end;
+            nameType = -1;
+            continue;
+        }
+
+        if (index < 0 && !(c >= AsciiCount && QChar(c).isLetter())) {
+            if (!isBlank(c) && !(c == ':' && nameType >= 0)) {
+                nameType = -1;
+            }
+            ++i;
+            continue;
+        }
+
+        // Identifier, walked through the keyword trie as it is scanned;
+        // other letters are part of names but of no keyword
+        int wordState = 0;
+        int end = i;
+        while (end < length) {
+            const ushort u = text[end].unicode();
+            const int character = u < AsciiCount ? wordIndex(u) : -1;
+            if (character >= 0) {
+                if (wordState >= 0) {
+                    wordState = wordStates[wordState * WordCharacterCount + character];
+                }
+            } else if (u >= AsciiCount && QChar(u).isLetterOrNumber()) {
+                wordState = -1;
+            } else {
+                break;
+            }
+            ++end;
+        }
+        const int flags = wordState >= 0 ? m_wordFlags.at(wordState) : 0;
+
+        if (nameType >= 0) {
+            tokens.append({ i, end - i, TokenType(nameType) });
+        } else if (flags & IsKeyword) {
+            tokens.append({ i, end - i, Keyword });
+        } else if (m_highlightCalls) {
+            int next = end;
+            while (next < length && isBlank(text[next].unicode())) {
+                ++next;
+            }
+            if (next < length && text[next] == QLatin1Char('(')) {
+                tokens.append({ i, end - i, Function });
+            }
+        }
+
+        if (flags & IntroducesType) {
+            nameType = Type;
+        } else if (flags & IntroducesFunction) {
+            nameType = Function;
+        } else {
+            nameType = -1;
+        }
+        i = end;
+    }
+
+    return 0;
+}
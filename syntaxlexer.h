@@ -0,0 +1,150 @@
+#ifndef SYNTAXLEXER_H
+#define SYNTAXLEXER_H
+
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QDataStream;
+
+// Table-driven lexer for syntax highlighting.
+//
+// A language is described by a Definition: its comment and string
+// delimiters, keywords and a few naming conventions. Compiling it builds
+// three kinds of state machine, each a flat transition table indexed by
+// state and character:
+//
+//  - a trie of every delimiter that can start a comment or string, walked
+//    from characters that begin one, taking the longest match;
+//  - for every comment or string, a KMP automaton that finds its closing
+//    delimiter, skipping escaped characters;
+//  - a trie of keywords over word characters, walked while an identifier
+//    is scanned, so telling a keyword from a name costs nothing extra.
+//
+// lexLine() then produces the tokens of a line in one left-to-right pass,
+// never looking at a character twice except to peek past an identifier for
+// a '('. Comments and strings that run past the end of a line are carried
+// in the returned state, which the next line starts in.
+// Only the tables are read while lexing, so one lexer can serve any number
+// of threads; forLanguage() loads each language once for the whole process
+// and every highlighter shares it. Languages are defined in JSON files and
+// kept compiled by LanguageCache.
+class SyntaxLexer
+{
+public:
+    enum TokenType {
+        Keyword,
+        Type,
+        Function,
+        Number,
+        String,
+        Comment,
+        Preprocessor,
+        TokenTypeCount
+    };
+
+    struct Token
+    {
+        int start;
+        int length;
+        TokenType type;
+    };
+
+    // A string literal; multi-line ones carry over line breaks, the others
+    // end with their line
+    struct StringRule
+    {
+        QString open;
+        QString close;
+        QChar escape;
+        bool multiLine;
+    };
+
+    struct Definition
+    {
+        QString name;
+        // File extensions, lower case and without the dot
+        QStringList extensions;
+        QString lineComment;
+        QString blockCommentStart;
+        QString blockCommentEnd;
+        QVector<StringRule> strings;
+        // Marks a directive when it starts a line, like '#' in C
+        QString preprocessor;
+        QStringList keywords;
+        // Words whose next identifier, past blanks and a ':', names a type
+        // or a function, like "class" and "def"; they need not be keywords
+        QStringList typeIntroducers;
+        QStringList functionIntroducers;
+        // Identifiers followed by '(' are functions
+        bool highlightCalls = false;
+    };
+
+    // Definition of "generic", used for files of no known language
+    static Definition genericDefinition();
+    // Name of the language of files with an extension, "generic" if unknown
+    static QString languageForExtension(const QString &fileExtension);
+    // Lexer of a language, loaded on first use and kept for the process
+    static QSharedPointer<const SyntaxLexer> forLanguage(const QString &name);
+
+    SyntaxLexer();
+    explicit SyntaxLexer(const Definition &definition);
+
+    QString name() const;
+
+    // Compiled tables, as kept in the language cache; readTables() replaces
+    // those of the lexer and fails on tables that are not consistent
+    void writeTables(QDataStream &stream) const;
+    bool readTables(QDataStream &stream);
+
+    // Appends the tokens of a line to tokens, starting in the state the
+    // previous line ended in (0 for the first), and returns the state the
+    // line ends in. Text outside tokens is plain.
+    int lexLine(const QChar *text, int length, int state, QVector<Token> &tokens) const;
+
+private:
+    static const int AsciiCount = 128;
+    static const int WordCharacterCount = 63;
+
+    enum WordFlag {
+        IsKeyword = 1,
+        IntroducesType = 2,
+        IntroducesFunction = 4
+    };
+
+    // Comment or string spanning from its opening to its closing delimiter
+    struct Region
+    {
+        TokenType type;
+        ushort escape;
+        bool multiLine;
+        // Closing delimiter, empty for line comments
+        int closeLength;
+        // KMP automaton over the closing delimiter: closeLength rows of
+        // AsciiCount next states, reaching closeLength completes it
+        QVector<qint16> closeStates;
+    };
+
+    void addDelimiter(const QString &open, int region);
+    void addWord(const QString &word, int flag);
+    int findRegionEnd(const Region &region, const QChar *text, int length, int from) const;
+    static int wordIndex(ushort c);
+
+    QString m_name;
+    QString m_preprocessor;
+    bool m_highlightCalls;
+
+    QVector<Region> m_regions;
+    // Delimiter trie: AsciiCount next states per state, -1 for none, and
+    // the region a state completes the opening of, -1 for none
+    QVector<qint16> m_delimiterStates;
+    QVector<qint16> m_delimiterRegions;
+
+    // Keyword trie: WordCharacterCount next states per state, -1 for
+    // none, and the WordFlags of the word a state completes
+    QVector<qint16> m_wordStates;
+    QVector<quint8> m_wordFlags;
+};
+
+#endif // SYNTAXLEXER_H
@@ -1,66 +1,329 @@
 #include "textdocument.h"
-#include "syntaxhighlighter.h"
+#include "documenthighlighter.h"
+#include "documentloader.h"
+#include "documentsaver.h"
+#include "documentsearch.h"
+#include "linediff.h"
+#include "mappedlineindexer.h"
 #include <QFile>
-#include <QTextStream>
-#include <QTextCursor>
-#include <QTextBlock>
+#include <QSet>
 #include <QUndoCommand>
 #include <QFileInfo>
+#include <QTimer>
 #include <QDebug>
+#include <algorithm>
 
-// Text edit command for undo/redo functionality
-class TextDocument::TextEditCommand : public QUndoCommand
+// Quiet time after an edit before the buffer is hashed against the saved text
+static const int DirtyCheckDelay = 300;
+
+// Undo history kept per document before the oldest edits are dropped
+static const qint64 DefaultUndoBudget = Q_INT64_C(32) * 1024 * 1024;
+
+// How often a followed file is checked for appended text, in milliseconds
+static const int FollowPollInterval = 1000;
+
+// Appended bytes read per step; a large append is taken in several
+static const qint64 MaxFollowRead = Q_INT64_C(4) * 1024 * 1024;
+
+// Undo command whose memory counts against the undo budget. pushEdit()
+// starts the accounting; once over budget, the oldest commands have their
+// text freed and can no longer be undone.
+class TextDocument::EditCommand : public QUndoCommand
 {
 public:
-    TextEditCommand(QTextDocument *document, int position, const QString &textToRemove, const QString &textToInsert, TextDocument *parent)
+    explicit EditCommand(TextDocument *parent)
         : QUndoCommand()
-        , m_document(document)
+        , m_parent(parent)
+        , m_serial(0)
+        , m_trackedCost(0)
+        , m_discarded(false)
+    {
+    }
+
+    ~EditCommand() override
+    {
+        m_parent->untrackUndoCommand(this);
+    }
+
+    // Approximate memory held by this command
+    virtual qint64 cost() const = 0;
+
+    quint64 serial() const
+    {
+        return m_serial;
+    }
+
+    void setSerial(quint64 serial)
+    {
+        m_serial = serial;
+    }
+
+    // Cost the budget accounts for, cost() as of the last update
+    qint64 trackedCost() const
+    {
+        return m_trackedCost;
+    }
+
+    void setTrackedCost(qint64 cost)
+    {
+        m_trackedCost = cost;
+    }
+
+    bool isDiscarded() const
+    {
+        return m_discarded;
+    }
+
+    // Frees the text; the command can no longer be undone
+    void discard()
+    {
+        m_discarded = true;
+        freeText();
+    }
+
+protected:
+    virtual void freeText() = 0;
+
+    // Accounts for a change of cost(), as when a command absorbs another
+    void updateCost()
+    {
+        const qint64 cost = this->cost();
+        m_parent->m_undoBytes += cost - m_trackedCost;
+        m_trackedCost = cost;
+    }
+
+    TextDocument *m_parent;
+
+private:
+    quint64 m_serial;
+    qint64 m_trackedCost;
+    bool m_discarded;
+};
+
+// Text edit command for undo/redo functionality. Only the replaced range is
+// stored, and consecutive single character edits are merged into word sized
+// groups so typing does not create one command per keystroke.
+class TextDocument::TextEditCommand : public EditCommand
+{
+public:
+    enum { Id = 1 };
+
+    TextEditCommand(int position, const QString &textToRemove, const QString &textToInsert, TextDocument *parent)
+        : EditCommand(parent)
         , m_position(position)
         , m_textToRemove(textToRemove)
         , m_textToInsert(textToInsert)
-        , m_parent(parent)
     {
     }
 
+    int id() const override
+    {
+        return Id;
+    }
+
+    bool mergeWith(const QUndoCommand *other) override
+    {
+        const TextEditCommand *next = static_cast<const TextEditCommand *>(other);
+        if (isDiscarded()) {
+            return false;
+        }
+
+        // Typing: a single character inserted right after this insertion
+        if (m_textToRemove.isEmpty() && next->m_textToRemove.isEmpty()
+            && next->m_textToInsert.length() == 1 && !m_textToInsert.isEmpty()
+            && next->m_position == m_position + m_textToInsert.length()
+            && !isWordBoundary(m_textToInsert.back(), next->m_textToInsert.front())) {
+            m_textToInsert.append(next->m_textToInsert);
+        }
+        // Backspace: a single character removed right before this removal
+        else if (m_textToInsert.isEmpty() && next->m_textToInsert.isEmpty()
+                 && next->m_textToRemove.length() == 1 && !m_textToRemove.isEmpty()
+                 && next->m_position + 1 == m_position
+                 && !isWordBoundary(next->m_textToRemove.front(), m_textToRemove.front())) {
+            m_textToRemove.prepend(next->m_textToRemove);
+            m_position = next->m_position;
+        }
+        // Delete: a single character removed at the same position
+        else if (m_textToInsert.isEmpty() && next->m_textToInsert.isEmpty()
+                 && next->m_textToRemove.length() == 1 && !m_textToRemove.isEmpty()
+                 && next->m_position == m_position
+                 && !isWordBoundary(m_textToRemove.back(), next->m_textToRemove.front())) {
+            m_textToRemove.append(next->m_textToRemove);
+        } else {
+            return false;
+        }
+
+        updateCost();
+        return true;
+    }
+
     void undo() override
     {
-        QTextCursor cursor(m_document);
-        cursor.setPosition(m_position);
-        cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, m_textToInsert.length());
-        cursor.removeSelectedText();
-        cursor.insertText(m_textToRemove);
-        m_parent->contentChanged();
+        m_parent->applyEdit(m_position, m_textToInsert.length(), m_textToRemove);
     }
 
     void redo() override
     {
-        QTextCursor cursor(m_document);
-        cursor.setPosition(m_position);
-        cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, m_textToRemove.length());
-        cursor.removeSelectedText();
-        cursor.insertText(m_textToInsert);
-        m_parent->contentChanged();
+        m_parent->applyEdit(m_position, m_textToRemove.length(), m_textToInsert);
+    }
+
+    qint64 cost() const override
+    {
+        return qint64(sizeof(*this)) + (m_textToRemove.length() + m_textToInsert.length()) * qint64(sizeof(QChar));
+    }
+
+protected:
+    void freeText() override
+    {
+        m_textToRemove = QString();
+        m_textToInsert = QString();
     }
 
 private:
-    QTextDocument *m_document;
+    // A group is a word plus the whitespace after it; line breaks stand alone
+    static bool isWordBoundary(QChar previous, QChar next)
+    {
+        if (previous == QLatin1Char('\n') || next == QLatin1Char('\n')) {
+            return true;
+        }
+        return previous.isSpace() && !next.isSpace();
+    }
+
     int m_position;
     QString m_textToRemove;
     QString m_textToInsert;
-    TextDocument *m_parent;
+};
+
+// Replaces every match at once. The text between the first and the last
+// match is rebuilt in a single pass and swapped in as one edit, so the
+// buffer, the views and the journal see one change however many matches
+// there are. Only the matched and replacement strings are stored.
+class TextDocument::ReplaceAllCommand : public EditCommand
+{
+public:
+    // Found by a DocumentSearch, positions are in the text before the command
+    typedef DocumentSearch::Replacement Replacement;
+
+    ReplaceAllCommand(const QVector<Replacement> &replacements, TextDocument *parent)
+        : EditCommand(parent)
+        , m_replacements(replacements)
+    {
+    }
+
+    void undo() override
+    {
+        apply(true);
+    }
+
+    void redo() override
+    {
+        apply(false);
+    }
+
+    qint64 cost() const override
+    {
+        qint64 cost = qint64(sizeof(*this));
+        for (const Replacement &replacement : m_replacements) {
+            cost += qint64(sizeof(Replacement))
+                    + (replacement.before.length() + replacement.after.length()) * qint64(sizeof(QChar));
+        }
+        return cost;
+    }
+
+protected:
+    void freeText() override
+    {
+        m_replacements = QVector<Replacement>();
+    }
+
+private:
+    void apply(bool reverse)
+    {
+        if (m_replacements.isEmpty()) {
+            return;
+        }
+
+        // The first match starts at the same position in both directions
+        const int spanStart = m_replacements.first().position;
+        const Replacement &last = m_replacements.last();
+        int shift = 0;
+        if (reverse) {
+            for (const Replacement &replacement : m_replacements) {
+                shift += replacement.after.length() - replacement.before.length();
+            }
+            shift -= last.after.length() - last.before.length();
+        }
+        const int spanEnd = last.position + shift + (reverse ? last.after : last.before).length();
+
+        const QString source = m_parent->m_buffer.text(spanStart, spanEnd - spanStart);
+        QString result;
+        result.reserve(source.length());
+
+        int cursor = 0;
+        shift = 0;
+        for (const Replacement &replacement : m_replacements) {
+            const QString &from = reverse ? replacement.after : replacement.before;
+            const QString &to = reverse ? replacement.before : replacement.after;
+            const int position = replacement.position + (reverse ? shift : 0) - spanStart;
+
+            result.append(source.constData() + cursor, position - cursor);
+            result.append(to);
+            cursor = position + from.length();
+            shift += replacement.after.length() - replacement.before.length();
+        }
+        result.append(source.constData() + cursor, source.length() - cursor);
+
+        m_parent->applyEdit(spanStart, source.length(), result);
+    }
+
+    QVector<Replacement> m_replacements;
 };
 
 TextDocument::TextDocument(QObject *parent)
     : QObject(parent)
-    , m_document(new QTextDocument(this))
+    , m_indexer(nullptr)
     , m_undoStack(new QUndoStack(this))
     , m_isDirty(false)
-    , m_highlighter(nullptr)
+    , m_savedLength(0)
+    , m_savedHash(ContentHash().result())
+    , m_dirtyCheckTimer(new QTimer(this))
+    , m_lossy(false)
+    , m_lineCount(1)
+    , m_highlighter(new DocumentHighlighter(&m_buffer, this))
+    , m_loader(nullptr)
+    , m_loadProgress(1.0)
+    , m_loadSettled(true)
+    , m_reloader(nullptr)
+    , m_diskSize(0)
+    , m_following(false)
+    , m_followLineLimit(0)
+    , m_followOffset(0)
+    , m_followTimer(new QTimer(this))
+    , m_followTrimmed(false)
+    , m_appendingFromDisk(false)
+    , m_saver(nullptr)
+    , m_savePending(false)
+    , m_revision(0)
+    , m_savedRevision(0)
+    , m_journal(nullptr)
+    , m_search(nullptr)
+    , m_replace(nullptr)
+    , m_nextUndoSerial(0)
+    , m_undoBytes(0)
+    , m_undoBudget(DefaultUndoBudget)
 {
-    // Connect signal to detect dirty state
-    connect(m_undoStack, &QUndoStack::cleanChanged, this, [this](bool clean) {
-        markAsDirty(!clean);
-    });
+    // Connect signals to detect dirty state
+    connect(m_undoStack, &QUndoStack::cleanChanged, this, &TextDocument::updateDirtyState);
+    connect(m_undoStack, &QUndoStack::indexChanged, this, &TextDocument::updateDirtyState);
+
+    m_dirtyCheckTimer->setSingleShot(true);
+    m_dirtyCheckTimer->setInterval(DirtyCheckDelay);
+    connect(m_dirtyCheckTimer, &QTimer::timeout, this, &TextDocument::checkSavedHash);
+
+    m_followTimer->setInterval(FollowPollInterval);
+    connect(m_followTimer, &QTimer::timeout, this, &TextDocument::readAppended);
+
+    connect(m_highlighter, &DocumentHighlighter::highlightingChanged, this, &TextDocument::highlightingChanged);
 
     // Set initial state as clean
     m_undoStack->setClean();
@@ -68,232 +331,1330 @@ TextDocument::TextDocument(QObject *parent)
 
 TextDocument::~TextDocument()
 {
-    // Cleanup resources
-    if (m_highlighter) {
-        // m_highlighter is automatically deleted when its parent m_document is deleted
-        m_highlighter = nullptr;
-    }
+    // Waits for a running loader to stop and a running save to complete
+    delete m_loader;
+    delete m_indexer;
+    delete m_reloader;
+    delete m_saver;
+    delete m_search;
+    delete m_replace;
+
+    // Closed normally, nothing to recover
+    discardJournal();
+
+    // Stops its worker before the buffer goes away
+    delete m_highlighter;
 
-    delete m_document;
     delete m_undoStack;
 }
 
 bool TextDocument::loadFile(const QString &filePath)
 {
     QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::ReadOnly)) {
         return false;
     }
 
-    QTextStream in(&file);
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    in.setEncoding(QStringConverter::Utf8);
-#else
-    in.setCodec("UTF-8");
-#endif
-    QString fileContent = in.readAll();
+    // Detects the encoding and normalizes line endings in one pass
+    const QByteArray bytes = file.readAll();
     file.close();
 
+    TextDecoder decoder;
+    QString fileContent = decoder.decode(bytes.constData(), bytes.size());
+    fileContent.append(decoder.finish());
+
+    // Invalid bytes at the very end of what looked like UTF-8; Latin-1
+    // keeps them as they are
+    if (decoder.isLossy() && decoder.format().encoding == TextFormat::Utf8 && !decoder.format().hasBom) {
+        TextFormat latin1;
+        latin1.encoding = TextFormat::Latin1;
+        decoder = TextDecoder(latin1);
+        fileContent = decoder.decode(bytes.constData(), bytes.size());
+        fileContent.append(decoder.finish());
+    }
+
+    stopLoader();
+    stopReloader();
+    stopReplace();
+    discardJournal();
+    const bool wasReadOnly = isReadOnly();
+    closeMapped();
+
     m_filePath = filePath;
-    m_originalContent = fileContent;
-    m_document->setPlainText(fileContent);
+    m_format = decoder.format();
+    m_lossy = decoder.isLossy() || decoder.hasMixedLineEndings();
+    m_diskSize = bytes.size();
+    m_buffer.setText(fileContent);
+    m_highlighter->reset();
 
     // Reset undo stack
     resetUndoStack();
     markAsDirty(false);
     updateLineCount();
 
+    ContentHash hash;
+    hash.addData(fileContent.constData(), fileContent.length());
+    m_savedLength = fileContent.length();
+    m_savedHash = hash.result();
+
+    m_followTrimmed = false;
+    if (m_following && !startFollowing()) {
+        setFollowing(false);
+    }
+
     // Apply syntax highlighting based on file extension
     // QFileInfo fileInfo(filePath);
     // applySyntaxHighlighting(fileInfo.suffix());
 
+    if (wasReadOnly) {
+        emit readOnlyChanged(false);
+    }
     emit contentChanged();
 
     return true;
 }
 
-bool TextDocument::saveFile(const QString &filePath)
+bool TextDocument::loadFileMapped(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    // Map the file instead of decoding it, lines are decoded on demand
+    stopLoader();
+    stopReloader();
+    if (!openMapped(filePath)) {
         return false;
     }
 
-    QTextStream out(&file);
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    out.setEncoding(QStringConverter::Utf8);
-#else
-    out.setCodec("UTF-8");
-#endif
-    out << m_document->toPlainText();
-    file.close();
+    // Mapped files are reread as a whole instead
+    setFollowing(false);
+    m_filePath = filePath;
+    resetContent();
+
+    emit readOnlyChanged(true);
+    emit contentChanged();
+
+    return true;
+}
+
+bool TextDocument::loadFileAsync(const QString &filePath)
+{
+    if (!QFileInfo(filePath).isReadable()) {
+        return false;
+    }
 
+    stopLoader();
+    stopReloader();
+    const bool wasReadOnly = isReadOnly();
+    closeMapped();
+
+    // Start from an empty, editable buffer; chunks are appended as they arrive
     m_filePath = filePath;
-    m_originalContent = m_document->toPlainText();
+    resetContent();
 
-    // Mark as clean
-    m_undoStack->setClean();
-    markAsDirty(false);
+    if (wasReadOnly) {
+        emit readOnlyChanged(false);
+    }
+    emit contentChanged();
 
-    // If the file extension has changed, update syntax highlighting
-    //QFileInfo fileInfo(filePath);
-    //applySyntaxHighlighting(fileInfo.suffix());
+    DocumentLoader *loader = new DocumentLoader(filePath, this);
+    m_loader = loader;
+    m_loadSettled = false;
 
+    // Queued signals of a loader that was replaced or cancelled are dropped
+    connect(loader, &DocumentLoader::chunkLoaded, this, [this, loader](const QString &text) {
+        if (loader != m_loader || loader->isCancelled()) {
+            return;
+        }
+        m_loadHash.addData(text.constData(), text.length());
+        applyEdit(m_buffer.length(), 0, text);
+    });
+
+    // The file is read again in another encoding, loaded text goes
+    connect(loader, &DocumentLoader::restarted, this, [this, loader]() {
+        if (loader != m_loader || loader->isCancelled()) {
+            return;
+        }
+        m_loadHash.reset();
+        applyEdit(0, m_buffer.length(), QString());
+        resetUndoStack();
+    });
+
+    connect(loader, &DocumentLoader::formatSettled, this, [this, loader]() {
+        if (loader != m_loader) {
+            return;
+        }
+        m_loadSettled = true;
+    });
+
+    connect(loader, &DocumentLoader::progressChanged, this, [this, loader](qint64 bytesRead, qint64 totalBytes) {
+        if (loader != m_loader) {
+            return;
+        }
+        m_loadProgress = totalBytes > 0 ? qreal(bytesRead) / qreal(totalBytes) : 1.0;
+        emit loadProgressChanged(m_loadProgress);
+    });
+
+    connect(loader, &DocumentLoader::loadFinished, this, [this, loader](bool completed) {
+        if (loader != m_loader) {
+            return;
+        }
+        finishLoading();
+        emit loadFinished(completed);
+    });
+
+    connect(loader, &DocumentLoader::loadFailed, this, [this, loader](const QString &error) {
+        if (loader != m_loader) {
+            return;
+        }
+        finishLoading();
+        emit loadFailed(error);
+    });
+
+    m_loadProgress = 0.0;
+    emit loadProgressChanged(m_loadProgress);
+    emit loadingChanged(true);
+
+    loader->start();
     return true;
 }
 
-QString TextDocument::content() const
+void TextDocument::reloadFromDisk(bool discardChanges)
 {
-    return m_document->toPlainText();
+    if (m_filePath.isEmpty() || isLoading()) {
+        return;
+    }
+
+    // Mapped files have no edits to keep, the mapping is simply redone
+    if (isReadOnly()) {
+        if (openMapped(m_filePath)) {
+            updateLineCount();
+            emit contentChanged();
+        }
+        return;
+    }
+
+    // A running save is what changed the file
+    if (m_saver) {
+        return;
+    }
+
+    // Only the appended text is read, unless the edits are to be dropped
+    if (m_following && !discardChanges) {
+        readAppended();
+        return;
+    }
+
+    stopReloader();
+    DocumentLoader *reloader = new DocumentLoader(m_filePath, this);
+    m_reloader = reloader;
+    m_reloadText.clear();
+    m_reloadHash.reset();
+
+    connect(reloader, &DocumentLoader::chunkLoaded, this, [this, reloader](const QString &text) {
+        if (reloader != m_reloader) {
+            return;
+        }
+        m_reloadText += text;
+        m_reloadHash.addData(text.constData(), text.length());
+    });
+
+    connect(reloader, &DocumentLoader::restarted, this, [this, reloader]() {
+        if (reloader != m_reloader) {
+            return;
+        }
+        m_reloadText.clear();
+        m_reloadHash.reset();
+    });
+
+    connect(reloader, &DocumentLoader::loadFinished, this, [this, reloader, discardChanges](bool completed) {
+        if (reloader != m_reloader) {
+            return;
+        }
+        m_reloader = nullptr;
+        reloader->deleteLater();
+
+        QString text;
+        text.swap(m_reloadText);
+        const quint64 hash = m_reloadHash.result();
+
+        // Our own saves, and touching the file, leave the text as it was
+        if (!completed || m_saver || (text.length() == m_savedLength && hash == m_savedHash)) {
+            return;
+        }
+
+        if (m_isDirty && !discardChanges) {
+            emit changedOnDisk();
+            return;
+        }
+
+        applyReload(text, hash, reloader);
+    });
+
+    connect(reloader, &DocumentLoader::loadFailed, this, [this, reloader](const QString &) {
+        if (reloader != m_reloader) {
+            return;
+        }
+        m_reloader = nullptr;
+        reloader->deleteLater();
+        m_reloadText.clear();
+    });
+
+    reloader->start();
 }
 
-void TextDocument::setContent(const QString &content)
+void TextDocument::findAll(const QString &pattern, bool caseSensitive, bool regularExpression)
 {
-    if (m_document->toPlainText() != content) {
-        // Create an edit command to track this change
-        QString oldContent = m_document->toPlainText();
+    // A new query replaces the running one
+    cancelSearch();
 
-        // Push to undo stack
-        m_undoStack->push(new TextEditCommand(m_document, 0, oldContent, content, this));
+    if (isReadOnly() || pattern.isEmpty()) {
+        emit searchFinished(0);
+        return;
+    }
 
-        // Set the content directly to avoid recursion
-        m_document->setPlainText(content);
+    DocumentSearch *search = new DocumentSearch(m_buffer.snapshot(), pattern, caseSensitive, regularExpression, this);
+    m_search = search;
 
-        updateLineCount();
-        emit contentChanged();
+    // Queued batches of a search that was replaced are dropped
+    connect(search, &DocumentSearch::matchesFound, this,
+            [this, search](const QVector<int> &positions, const QVector<int> &lengths) {
+        if (search == m_search) {
+            m_matchPositions += positions;
+            m_matchLengths += lengths;
+            emit searchMatchesFound(m_matchPositions.size());
+        }
+    });
+
+    connect(search, &DocumentSearch::searchFinished, this, [this, search](int matchCount, bool completed) {
+        if (search != m_search) {
+            return;
+        }
+        m_search = nullptr;
+        search->deleteLater();
+        if (completed) {
+            emit searchFinished(matchCount);
+        }
+    });
+
+    search->start();
+}
+
+void TextDocument::cancelSearch()
+{
+    m_matchPositions.clear();
+    m_matchLengths.clear();
+    if (!m_search) {
+        return;
     }
+
+    // Deleting the search waits for it to reach its next check
+    DocumentSearch *search = m_search;
+    m_search = nullptr;
+    search->disconnect(this);
+    delete search;
 }
 
-bool TextDocument::isDirty() const
+int TextDocument::searchMatchCount() const
 {
-    return m_isDirty;
+    return m_matchPositions.size();
 }
 
-int TextDocument::lineCount() const
+int TextDocument::searchMatchPosition(int match) const
 {
-    return m_document->lineCount();
+    return match >= 0 && match < m_matchPositions.size() ? m_matchPositions.at(match) : -1;
 }
 
-void TextDocument::undo()
+int TextDocument::searchMatchLength(int match) const
 {
-    m_undoStack->undo();
+    return match >= 0 && match < m_matchLengths.size() ? m_matchLengths.at(match) : 0;
 }
 
-void TextDocument::redo()
+int TextDocument::searchMatchAfter(int position) const
 {
-    m_undoStack->redo();
+    return int(std::lower_bound(m_matchPositions.constBegin(), m_matchPositions.constEnd(), position)
+               - m_matchPositions.constBegin());
 }
 
-void TextDocument::insertText(int position, const QString &text)
+void TextDocument::replaceAll(const QString &pattern, const QString &replacement, bool caseSensitive,
+                              bool regularExpression)
 {
-    if (position < 0 || position > m_document->characterCount()) {
+    stopReplace();
+    if (isReadOnly() || isLoading() || pattern.isEmpty()) {
+        emit replaceAllFinished(0);
         return;
     }
 
-    // Create a command for undo/redo
-    m_undoStack->push(new TextEditCommand(m_document, position, "", text, this));
+    cancelSearch();
 
-    // The actual insertion happens in the command's redo() method
+    DocumentSearch *search = new DocumentSearch(m_buffer.snapshot(), pattern, caseSensitive, regularExpression, this);
+    search->setReplacement(replacement);
+    m_replace = search;
+
+    // The replacements are only valid for the text they were found in; an
+    // edit made meanwhile sends the search over the new text
+    const quint64 revision = m_revision;
+    connect(search, &DocumentSearch::searchFinished, this,
+            [this, search, revision, pattern, replacement, caseSensitive, regularExpression](int, bool completed) {
+        if (search != m_replace) {
+            return;
+        }
+        m_replace = nullptr;
+        search->deleteLater();
+        if (!completed) {
+            return;
+        }
+        if (revision != m_revision) {
+            replaceAll(pattern, replacement, caseSensitive, regularExpression);
+            return;
+        }
+
+        const QVector<ReplaceAllCommand::Replacement> replacements = search->replacements();
+        if (!replacements.isEmpty()) {
+            pushEdit(new ReplaceAllCommand(replacements, this));
+        }
+        emit replaceAllFinished(replacements.size());
+    });
+
+    search->start();
 }
 
-void TextDocument::removeText(int position, int length)
+void TextDocument::stopReplace()
 {
-    if (position < 0 || position + length > m_document->characterCount()) {
+    if (!m_replace) {
         return;
     }
 
-    // Get the text to be removed for undo purposes
-    QTextCursor cursor(m_document);
-    cursor.setPosition(position);
-    cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, length);
-    QString textToRemove = cursor.selectedText();
-
-    // Create a command for undo/redo
-    m_undoStack->push(new TextEditCommand(m_document, position, textToRemove, "", this));
+    // Deleting the search waits for it to reach its next check
+    DocumentSearch *search = m_replace;
+    m_replace = nullptr;
+    search->disconnect(this);
+    delete search;
+}
 
-    // The actual removal happens in the command's redo() method
+void TextDocument::cancelLoading()
+{
+    // The loader stops at the next chunk and reports loadFinished(false)
+    if (m_loader) {
+        m_loader->cancel();
+    }
 }
 
-void TextDocument::replaceText(int position, int length, const QString &text)
+bool TextDocument::saveFile(const QString &filePath)
 {
-    if (position < 0 || position + length > m_document->characterCount()) {
-        return;
+    if (isReadOnly()) {
+        // A mapped file cannot have been modified, saving elsewhere is a copy
+        if (filePath == m_filePath) {
+            return true;
+        }
+
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        return file.write(m_mappedBuffer.data(), m_mappedBuffer.size()) == m_mappedBuffer.size();
     }
 
-    // Get the text to be replaced for undo purposes
-    QTextCursor cursor(m_document);
-    cursor.setPosition(position);
-    cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, length);
-    QString textToRemove = cursor.selectedText();
+    // Saving a partially loaded buffer would truncate the file
+    if (isLoading()) {
+        return false;
+    }
 
-    // Create a command for undo/redo
-    m_undoStack->push(new TextEditCommand(m_document, position, textToRemove, text, this));
+    // The oldest lines were dropped while following, or invalid bytes were
+    // replaced or line endings mixed; only a copy can be saved
+    if (filePath == m_filePath && (m_followTrimmed || m_lossy)) {
+        return false;
+    }
+    if (filePath != m_filePath) {
+        setFollowing(false);
+        m_followTrimmed = false;
+        m_lossy = false;
+    }
 
-    // The actual replacement happens in the command's redo() method
+    m_filePath = filePath;
+
+    // A reload that started before the save would bring back the old text
+    stopReloader();
+
+    // Write-behind: only the latest request is kept while a save is running
+    if (m_saver) {
+        m_savePending = true;
+        m_pendingSavePath = filePath;
+        return true;
+    }
+
+    emit savingChanged(true);
+    startSave(filePath);
+
+    // If the file extension has changed, update syntax highlighting
+    //QFileInfo fileInfo(filePath);
+    //applySyntaxHighlighting(fileInfo.suffix());
+
+    return true;
 }
 
-QString TextDocument::getLine(int lineNumber) const
+QString TextDocument::content() const
 {
-    if (lineNumber < 0 || lineNumber >= m_document->lineCount()) {
-        return "";
+    // Decoding a mapped file as a whole would defeat mapping it
+    if (isReadOnly()) {
+        return QString();
     }
 
-    QTextBlock block = m_document->findBlockByLineNumber(lineNumber);
-    return block.text();
+    return m_buffer.text();
 }
 
-int TextDocument::getLineStart(int lineNumber) const
+void TextDocument::setContent(const QString &content)
 {
-    if (lineNumber < 0 || lineNumber >= m_document->lineCount()) {
-        return -1;
+    if (!isEditable()) {
+        return;
     }
 
-    QTextBlock block = m_document->findBlockByLineNumber(lineNumber);
-    return block.position();
+    pushReplacement(0, m_buffer.text(), content);
 }
 
-int TextDocument::getLineLength(int lineNumber) const
+int TextDocument::length() const
 {
-    if (lineNumber < 0 || lineNumber >= m_document->lineCount()) {
-        return -1;
-    }
+    return m_buffer.length();
+}
 
-    QTextBlock block = m_document->findBlockByLineNumber(lineNumber);
-    return block.length();
+QString TextDocument::text(int position, int length) const
+{
+    position = qBound(0, position, m_buffer.length());
+    return m_buffer.text(position, qBound(0, length, m_buffer.length() - position));
 }
 
-void TextDocument::applySyntaxHighlighting(const QString &fileExtension)
+bool TextDocument::isDirty() const
+{
+    return m_isDirty;
+}
+
+int TextDocument::lineCount() const
 {
-    // Remove any existing highlighter
-    if (m_highlighter) {
-        delete m_highlighter;
-        m_highlighter = nullptr;
+    if (isReadOnly()) {
+        return m_mappedBuffer.lineCount();
     }
 
-    // Create a new syntax highlighter for the document
-    m_highlighter = new SyntaxHighlighter(m_document);
+    return m_buffer.lineCount();
+}
 
-    // Set the language based on file extension
-    m_highlighter->setLanguage(fileExtension);
+bool TextDocument::isReadOnly() const
+{
+    return m_mappedBuffer.isOpen();
 }
 
-void TextDocument::updateLineCount()
+// Text still loading in a guessed encoding may be dropped and read again
+bool TextDocument::isEditable() const
 {
-    static int previousLineCount = 0;
-    int currentLineCount = m_document->lineCount();
+    return !isReadOnly() && (!m_loader || m_loadSettled);
+}
 
-    if (previousLineCount != currentLineCount) {
-        previousLineCount = currentLineCount;
-        emit lineCountChanged(currentLineCount);
-    }
+bool TextDocument::isSaving() const
+{
+    return m_saver != nullptr;
 }
 
-void TextDocument::markAsDirty(bool dirty)
+bool TextDocument::isLoading() const
 {
-    if (m_isDirty != dirty) {
-        m_isDirty = dirty;
-        emit dirtyChanged(m_isDirty);
-    }
+    return m_loader != nullptr;
+}
+
+bool TextDocument::isFollowing() const
+{
+    return m_following;
+}
+
+void TextDocument::setFollowing(bool following)
+{
+    // Mapped files and unsaved buffers have nothing to follow
+    if (following && (isReadOnly() || m_filePath.isEmpty())) {
+        return;
+    }
+
+    if (m_following == following) {
+        return;
+    }
+
+    // While loading, following starts once the whole file is in
+    m_following = following;
+    if (!following) {
+        stopFollowing();
+    } else if (!isLoading() && !startFollowing()) {
+        m_following = false;
+        return;
+    }
+
+    emit followingChanged(m_following);
+}
+
+int TextDocument::followLineLimit() const
+{
+    return m_followLineLimit;
+}
+
+void TextDocument::setFollowLineLimit(int lines)
+{
+    lines = qMax(0, lines);
+    if (m_followLineLimit == lines) {
+        return;
+    }
+
+    m_followLineLimit = lines;
+    if (m_following && !isLoading()) {
+        trimToFollowLineLimit();
+    }
+
+    emit followLineLimitChanged(m_followLineLimit);
+}
+
+qreal TextDocument::loadProgress() const
+{
+    return m_loadProgress;
+}
+
+void TextDocument::undo()
+{
+    // History beyond the undo budget has been dropped
+    if (isDiscarded(m_undoStack->command(m_undoStack->index() - 1))) {
+        return;
+    }
+
+    m_undoStack->undo();
+}
+
+void TextDocument::redo()
+{
+    // Like undo(), though trimming keeps the text of undone commands
+    if (isDiscarded(m_undoStack->command(m_undoStack->index()))) {
+        return;
+    }
+
+    m_undoStack->redo();
+}
+
+void TextDocument::insertText(int position, const QString &text)
+{
+    if (!isEditable() || position < 0 || position > m_buffer.length()) {
+        return;
+    }
+
+    // Create a command for undo/redo
+    pushEdit(new TextEditCommand(position, "", text, this));
+
+    // The actual insertion happens in the command's redo() method
+}
+
+void TextDocument::removeText(int position, int length)
+{
+    if (!isEditable() || position < 0 || length < 0 || position + length > m_buffer.length()) {
+        return;
+    }
+
+    // Get the text to be removed for undo purposes
+    QString textToRemove = m_buffer.text(position, length);
+
+    // Create a command for undo/redo
+    pushEdit(new TextEditCommand(position, textToRemove, "", this));
+
+    // The actual removal happens in the command's redo() method
+}
+
+void TextDocument::replaceText(int position, int length, const QString &text)
+{
+    if (!isEditable() || position < 0 || length < 0 || position + length > m_buffer.length()) {
+        return;
+    }
+
+    // Get the text to be replaced for undo purposes
+    QString textToRemove = m_buffer.text(position, length);
+
+    // Create a command for undo/redo
+    pushEdit(new TextEditCommand(position, textToRemove, text, this));
+
+    // The actual replacement happens in the command's redo() method
+}
+
+QString TextDocument::getLine(int lineNumber) const
+{
+    if (lineNumber < 0 || lineNumber >= lineCount()) {
+        return "";
+    }
+
+    if (isReadOnly()) {
+        return m_mappedBuffer.line(lineNumber);
+    }
+
+    return m_buffer.line(lineNumber);
+}
+
+qint64 TextDocument::getLineStart(int lineNumber) const
+{
+    if (lineNumber < 0 || lineNumber >= lineCount()) {
+        return -1;
+    }
+
+    // Mapped files report byte offsets, since they are never decoded as a whole
+    if (isReadOnly()) {
+        return m_mappedBuffer.lineStart(lineNumber);
+    }
+
+    return m_buffer.lineStart(lineNumber);
+}
+
+int TextDocument::getLineLength(int lineNumber) const
+{
+    if (lineNumber < 0 || lineNumber >= lineCount()) {
+        return -1;
+    }
+
+    // Includes the line separator, like QTextBlock::length()
+    if (isReadOnly()) {
+        return m_mappedBuffer.line(lineNumber).length() + 1;
+    }
+
+    return m_buffer.lineLength(lineNumber) + 1;
+}
+
+int TextDocument::getLineNumber(qint64 position) const
+{
+    if (position < 0) {
+        return -1;
+    }
+
+    // Mapped files take byte offsets, as returned by getLineStart()
+    if (isReadOnly()) {
+        return m_mappedBuffer.lineAt(position);
+    }
+
+    if (position > m_buffer.length()) {
+        return -1;
+    }
+
+    return m_buffer.lineAt(int(position));
+}
+
+QVector<QTextLayout::FormatRange> TextDocument::lineFormats(int lineNumber) const
+{
+    // Mapped files are not highlighted
+    if (isReadOnly()) {
+        return QVector<QTextLayout::FormatRange>();
+    }
+
+    return m_highlighter->lineFormats(lineNumber);
+}
+
+void TextDocument::setViewportLines(int firstLine, int lastLine)
+{
+    m_highlighter->setViewport(firstLine, lastLine);
+}
+
+void TextDocument::applySyntaxHighlighting(const QString &fileExtension)
+{
+    if (fileExtension == m_language) {
+        return;
+    }
+    m_language = fileExtension;
+
+    // Highlighted again in the background, the text stays as it is
+    m_highlighter->setLanguage(fileExtension);
+}
+
+void TextDocument::applyEdit(int position, int removeLength, const QString &text)
+{
+    // Loaded chunks are not edits, nor is text followed from disk unless
+    // there are unsaved edits to keep in step with; a buffer edited while
+    // loading is journaled in full once loading is done
+    if (!isLoading() && !m_filePath.isEmpty() && (m_journal || !m_appendingFromDisk)) {
+        if (!m_journal) {
+            startJournal();
+        }
+        m_journal->appendEdit(position, removeLength, text);
+    }
+
+    ++m_revision;
+    m_buffer.remove(position, removeLength);
+    m_buffer.insert(position, text);
+    m_highlighter->applyEdit(position, removeLength, text.length());
+
+    updateLineCount();
+    emit textEdited(position, removeLength, text.length());
+    emit contentChanged();
+}
+
+void TextDocument::pushReplacement(int position, const QString &oldText, const QString &newText)
+{
+    // Only the range between the common prefix and suffix has changed
+    const int oldLength = oldText.length();
+    const int newLength = newText.length();
+    const QChar *oldData = oldText.constData();
+    const QChar *newData = newText.constData();
+
+    const int maxPrefix = qMin(oldLength, newLength);
+    int prefix = 0;
+    while (prefix < maxPrefix && oldData[prefix] == newData[prefix]) {
+        ++prefix;
+    }
+
+    if (prefix == oldLength && prefix == newLength) {
+        return;
+    }
+
+    const int maxSuffix = maxPrefix - prefix;
+    int suffix = 0;
+    while (suffix < maxSuffix && oldData[oldLength - 1 - suffix] == newData[newLength - 1 - suffix]) {
+        ++suffix;
+    }
+
+    // Push to undo stack, the command's redo() applies the change
+    pushEdit(new TextEditCommand(position + prefix,
+                                 oldText.mid(prefix, oldLength - prefix - suffix),
+                                 newText.mid(prefix, newLength - prefix - suffix),
+                                 this));
+}
+
+void TextDocument::updateLineCount()
+{
+    int currentLineCount = lineCount();
+
+    if (m_lineCount != currentLineCount) {
+        m_lineCount = currentLineCount;
+        emit lineCountChanged(currentLineCount);
+    }
+}
+
+void TextDocument::resetContent()
+{
+    stopReplace();
+    discardJournal();
+    m_buffer.clear();
+    m_highlighter->reset();
+
+    resetUndoStack();
+    markAsDirty(false);
+    updateLineCount();
+
+    m_loadHash.reset();
+    m_savedLength = 0;
+    m_savedHash = m_loadHash.result();
+    m_diskSize = 0;
+    m_followTrimmed = false;
+    m_lossy = false;
+}
+
+// Maps a file and starts finding its lines, which are added as they are
+// found. The indexer reads the mapping, so it has to stop before the
+// mapping goes.
+bool TextDocument::openMapped(const QString &filePath)
+{
+    closeMapped();
+    if (!m_mappedBuffer.open(filePath)) {
+        return false;
+    }
+    if (m_mappedBuffer.isIndexed()) {
+        return true;
+    }
+
+    MappedLineIndexer *indexer = new MappedLineIndexer(m_mappedBuffer.data(), m_mappedBuffer.size(), this);
+    m_indexer = indexer;
+
+    // Queued batches of an indexer that was stopped are dropped
+    connect(indexer, &MappedLineIndexer::linesFound, this,
+            [this, indexer](const QVector<qint64> &checkpoints, int lineCount, qint64 scanned) {
+        if (indexer != m_indexer) {
+            return;
+        }
+        m_mappedBuffer.addLines(checkpoints, lineCount, scanned);
+        if (m_mappedBuffer.isIndexed()) {
+            m_indexer = nullptr;
+            indexer->deleteLater();
+        }
+        updateLineCount();
+    });
+
+    indexer->setPriority(QThread::LowPriority);
+    indexer->start();
+    return true;
+}
+
+void TextDocument::closeMapped()
+{
+    if (m_indexer) {
+        // Deleting the indexer waits for it to reach its next batch
+        MappedLineIndexer *indexer = m_indexer;
+        m_indexer = nullptr;
+        indexer->disconnect(this);
+        delete indexer;
+    }
+    m_mappedBuffer.close();
+}
+
+void TextDocument::stopLoader()
+{
+    if (!m_loader) {
+        return;
+    }
+
+    // Deleting the loader waits for its thread to reach a chunk boundary
+    DocumentLoader *loader = m_loader;
+    m_loader = nullptr;
+    loader->disconnect(this);
+    loader->cancel();
+    delete loader;
+
+    m_loadProgress = 1.0;
+    emit loadingChanged(false);
+}
+
+void TextDocument::stopReloader()
+{
+    if (!m_reloader) {
+        return;
+    }
+
+    DocumentLoader *reloader = m_reloader;
+    m_reloader = nullptr;
+    reloader->disconnect(this);
+    reloader->cancel();
+    delete reloader;
+    m_reloadText.clear();
+}
+
+void TextDocument::applyReload(const QString &text, quint64 hash, const DocumentLoader *reloader)
+{
+    const QString current = m_buffer.text();
+    const QVector<int> oldOffsets = LineDiff::lineOffsets(current);
+    const QVector<int> newOffsets = LineDiff::lineOffsets(text);
+    const QVector<LineDiff::Hunk> hunks = LineDiff::compute(current, oldOffsets, text, newOffsets);
+
+    // Only the changed lines are replaced, so the view keeps its cursor and
+    // highlighting everywhere else; last hunk first keeps offsets valid
+    if (!hunks.isEmpty()) {
+        m_undoStack->beginMacro(tr("Reload from disk"));
+        for (int i = hunks.size() - 1; i >= 0; --i) {
+            const LineDiff::Hunk &hunk = hunks.at(i);
+            const int start = oldOffsets.at(hunk.oldStart);
+            const int end = oldOffsets.at(hunk.oldStart + hunk.oldCount);
+            const int newStart = newOffsets.at(hunk.newStart);
+            const int newEnd = newOffsets.at(hunk.newStart + hunk.newCount);
+            pushEdit(new TextEditCommand(start, current.mid(start, end - start),
+                                         text.mid(newStart, newEnd - newStart), this));
+        }
+        m_undoStack->endMacro();
+    }
+
+    // The buffer is the file again
+    m_format = reloader->format();
+    m_lossy = reloader->isLossy();
+    m_diskSize = reloader->bytesRead();
+    m_savedLength = text.length();
+    m_savedHash = hash;
+    m_undoStack->setClean();
+    markAsDirty(false);
+    discardJournal();
+
+    m_followTrimmed = false;
+    if (m_following && !startFollowing()) {
+        setFollowing(false);
+    }
+
+    emit reloaded();
+}
+
+bool TextDocument::startFollowing()
+{
+    // The offset is only known while the buffer is the text on disk
+    if (m_isDirty) {
+        return false;
+    }
+
+    // A trimmed buffer goes on from where it stopped
+    if (!m_followTrimmed) {
+        if (m_savedLength < 0) {
+            return false;
+        }
+        m_followOffset = m_diskSize;
+        m_followDecoder = TextDecoder(m_format);
+        m_followHash.reset();
+        m_buffer.snapshot().forEachChunk([this](const QChar *data, int length) {
+            m_followHash.addData(data, length);
+        });
+        trimToFollowLineLimit();
+    }
+
+    m_followTimer->start();
+    readAppended();
+    return true;
+}
+
+void TextDocument::stopFollowing()
+{
+    m_followTimer->stop();
+}
+
+void TextDocument::readAppended()
+{
+    if (!m_following || isLoading() || m_saver) {
+        return;
+    }
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // Shorter than what was read: truncated or replaced, as when a log is
+    // rotated. A clean buffer starts over, edits are not thrown away.
+    const qint64 size = file.size();
+    if (size < m_followOffset) {
+        file.close();
+        if (m_isDirty) {
+            setFollowing(false);
+            emit changedOnDisk();
+        } else {
+            loadFileAsync(m_filePath);
+        }
+        return;
+    }
+
+    if (size == m_followOffset || !file.seek(m_followOffset)) {
+        return;
+    }
+
+    const QByteArray bytes = file.read(qMin(size - m_followOffset, MaxFollowRead));
+    file.close();
+    if (bytes.isEmpty()) {
+        return;
+    }
+    m_followOffset += bytes.size();
+    if (!m_followTrimmed) {
+        m_diskSize = m_followOffset;
+    }
+
+    const QString text = m_followDecoder.decode(bytes.constData(), bytes.size());
+    m_lossy = m_lossy || m_followDecoder.isLossy() || m_followDecoder.hasMixedLineEndings();
+    if (!text.isEmpty()) {
+        m_followHash.addData(text.constData(), text.length());
+
+        // Appended like a loaded chunk: not an undo step, and the lines
+        // above keep their layout and highlighting
+        const int position = m_buffer.length();
+        m_appendingFromDisk = true;
+        applyEdit(position, 0, text);
+        m_appendingFromDisk = false;
+
+        if (!m_followTrimmed) {
+            m_savedLength += text.length();
+            m_savedHash = m_followHash.result();
+        }
+
+        trimToFollowLineLimit();
+
+        const int length = qMin(text.length(), m_buffer.length());
+        emit followAppended(m_buffer.length() - length, length);
+    }
+
+    // The rest of a large append is read on the next turn of the event loop
+    if (m_followOffset < size) {
+        QTimer::singleShot(0, this, &TextDocument::readAppended);
+    }
+}
+
+void TextDocument::trimToFollowLineLimit()
+{
+    // Dropping lines resets the undo history, so it waits for unsaved edits
+    const int excess = m_buffer.lineCount() - m_followLineLimit;
+    if (m_followLineLimit <= 0 || excess <= 0 || m_isDirty) {
+        return;
+    }
+
+    m_appendingFromDisk = true;
+    applyEdit(0, m_buffer.lineStart(excess), QString());
+    m_appendingFromDisk = false;
+
+    resetUndoStack();
+    m_followTrimmed = true;
+    m_savedLength = -1;
+}
+
+void TextDocument::finishLoading()
+{
+    DocumentLoader *loader = m_loader;
+    m_loader = nullptr;
+    m_format = loader->format();
+    m_lossy = loader->isLossy();
+    m_diskSize = loader->bytesRead();
+    loader->deleteLater();
+
+    m_loadProgress = 1.0;
+    emit loadProgressChanged(m_loadProgress);
+    emit loadingChanged(false);
+
+    // The loaded chunks are the saved text unless they were edited while loading
+    if (m_undoStack->isClean()) {
+        m_savedLength = m_buffer.length();
+        m_savedHash = m_loadHash.result();
+    } else {
+        m_savedLength = -1;
+        startJournal();
+    }
+
+    if (m_following && !startFollowing()) {
+        setFollowing(false);
+    }
+}
+
+void TextDocument::startSave(const QString &filePath)
+{
+    // Snapshot the buffer once; encoding and writing happen on the saver thread
+    DocumentSaver *saver = new DocumentSaver(m_buffer.snapshot(), m_format, filePath, this);
+    m_saver = saver;
+    m_savedRevision = m_revision;
+
+    connect(saver, &DocumentSaver::saveFinished, this, [this, saver]() {
+        m_savedLength = saver->savedLength();
+        m_savedHash = saver->savedHash();
+        m_diskSize = saver->savedSize();
+        discardJournal();
+
+        // Edits made while saving keep the document dirty, and are
+        // journaled again on top of the text just saved
+        if (m_revision == m_savedRevision) {
+            m_undoStack->setClean();
+            markAsDirty(false);
+        } else {
+            updateDirtyState();
+            startJournal();
+        }
+
+        // The file was rewritten, reading resumes at its new end
+        if (m_following && !startFollowing()) {
+            setFollowing(false);
+        }
+
+        const QString filePath = saver->filePath();
+        finishSave();
+        emit saveFinished(filePath);
+    });
+
+    connect(saver, &DocumentSaver::saveFailed, this, [this, saver](const QString &error) {
+        const QString filePath = saver->filePath();
+        finishSave();
+        emit saveFailed(filePath, error);
+    });
+
+    saver->start();
+}
+
+void TextDocument::finishSave()
+{
+    m_saver->deleteLater();
+    m_saver = nullptr;
+
+    if (m_savePending) {
+        m_savePending = false;
+        startSave(m_pendingSavePath);
+        return;
+    }
+
+    emit savingChanged(false);
+}
+
+void TextDocument::markAsDirty(bool dirty)
+{
+    if (m_isDirty != dirty) {
+        m_isDirty = dirty;
+        emit dirtyChanged(m_isDirty);
+    }
+}
+
+TextFormat TextDocument::textFormat() const
+{
+    return m_format;
+}
+
+bool TextDocument::isLossy() const
+{
+    return m_lossy;
+}
+
+void TextDocument::updateDirtyState()
+{
+    m_dirtyCheckTimer->stop();
+
+    if (m_undoStack->isClean()) {
+        markAsDirty(false);
+        return;
+    }
+
+    markAsDirty(true);
+
+    // Back at the saved length, the text may match the file again
+    if (m_buffer.length() == m_savedLength) {
+        m_dirtyCheckTimer->start();
+    }
+}
+
+void TextDocument::checkSavedHash()
+{
+    if (m_buffer.length() != m_savedLength) {
+        return;
+    }
+
+    if (bufferHash() == m_savedHash) {
+        markAsDirty(false);
+    }
+}
+
+quint64 TextDocument::bufferHash() const
+{
+    ContentHash hash;
+    m_buffer.snapshot().forEachChunk([&hash](const QChar *data, int length) {
+        hash.addData(data, length);
+    });
+    return hash.result();
+}
+
+bool TextDocument::recoverJournal(const EditJournal::Contents &contents)
+{
+    if (isReadOnly() || isLoading()) {
+        return false;
+    }
+
+    // Edits only apply to the text they were made on
+    if (!contents.hasText
+        && (m_buffer.length() != contents.savedLength || bufferHash() != contents.savedHash)) {
+        return false;
+    }
+
+    if (!contents.hasText && contents.edits.isEmpty()) {
+        return true;
+    }
+
+    m_undoStack->beginMacro(tr("Recover unsaved changes"));
+
+    if (contents.hasText) {
+        pushReplacement(0, m_buffer.text(), contents.text);
+    }
+
+    for (const EditJournal::Edit &edit : contents.edits) {
+        const int position = qBound(0, edit.position, m_buffer.length());
+        const int removeLength = qBound(0, edit.removeLength, m_buffer.length() - position);
+        pushEdit(new TextEditCommand(position, m_buffer.text(position, removeLength), edit.text, this));
+    }
+
+    m_undoStack->endMacro();
+    return true;
+}
+
+void TextDocument::startJournal()
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+
+    if (!m_journal) {
+        m_journal = new EditJournal(EditJournal::journalPathFor(m_filePath), this);
+    }
+
+    // A clean buffer is the file on disk, anything else is logged in full
+    if (!m_isDirty && m_savedLength >= 0) {
+        m_journal->beginFromFile(m_filePath, m_savedLength, m_savedHash);
+    } else {
+        m_journal->beginFromText(m_filePath, m_buffer.text());
+    }
+
+    m_journal->start();
+}
+
+void TextDocument::discardJournal()
+{
+    if (!m_journal) {
+        return;
+    }
+
+    m_journal->discard();
+    delete m_journal;
+    m_journal = nullptr;
+}
+
+qint64 TextDocument::undoBudget() const
+{
+    return m_undoBudget;
+}
+
+void TextDocument::setUndoBudget(qint64 bytes)
+{
+    m_undoBudget = bytes;
+    trimUndoHistory();
+}
+
+void TextDocument::pushEdit(EditCommand *command)
+{
+    // push() runs the command, and may merge it into the previous one
+    trackUndoCommand(command);
+    m_undoStack->push(command);
+    trimUndoHistory();
+}
+
+void TextDocument::trackUndoCommand(EditCommand *command)
+{
+    command->setSerial(m_nextUndoSerial++);
+    command->setTrackedCost(command->cost());
+    m_undoCommands.insert(command->serial(), command);
+    m_undoBytes += command->trackedCost();
+}
+
+void TextDocument::untrackUndoCommand(EditCommand *command)
+{
+    // Discarded commands were already taken out of the accounting
+    if (!command->isDiscarded() && m_undoCommands.remove(command->serial())) {
+        m_undoBytes -= command->trackedCost();
+    }
+}
+
+void TextDocument::trimUndoHistory()
+{
+    // Undone commands are the newest and redo needs their text; trimming
+    // stops at the first of them
+    QSet<const QUndoCommand *> undone;
+    for (int i = m_undoStack->index(); i < m_undoStack->count(); ++i) {
+        collectCommands(m_undoStack->command(i), undone);
+    }
+
+    // QUndoStack cannot drop its oldest commands, so their text is freed
+    // instead and undo stops there. The newest edit is always kept.
+    while (m_undoBytes > m_undoBudget && m_undoCommands.size() > 1) {
+        if (undone.contains(m_undoCommands.first())) {
+            break;
+        }
+        EditCommand *command = m_undoCommands.take(m_undoCommands.firstKey());
+        m_undoBytes -= command->trackedCost();
+        command->discard();
+    }
+}
+
+void TextDocument::collectCommands(const QUndoCommand *command, QSet<const QUndoCommand *> &commands)
+{
+    commands.insert(command);
+    for (int i = 0; i < command->childCount(); ++i) {
+        collectCommands(command->child(i), commands);
+    }
+}
+
+bool TextDocument::isDiscarded(const QUndoCommand *command)
+{
+    if (!command) {
+        return false;
+    }
+
+    const EditCommand *edit = dynamic_cast<const EditCommand *>(command);
+    if (edit && edit->isDiscarded()) {
+        return true;
+    }
+
+    for (int i = 0; i < command->childCount(); ++i) {
+        if (isDiscarded(command->child(i))) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 void TextDocument::resetUndoStack()
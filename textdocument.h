@@ -2,11 +2,23 @@
 #define TEXTDOCUMENT_H
 #include <QObject>
 #include <QString>
-#include <QTextDocument>
+#include <QTextLayout>
 #include <QUndoStack>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include "piecetable.h"
+#include "mappedtextbuffer.h"
+#include "contenthash.h"
+#include "editjournal.h"
+#include "textformat.h"
 
-// Forward declaration of the syntax highlighter
-class SyntaxHighlighter;
+class DocumentHighlighter;
+class DocumentLoader;
+class DocumentSaver;
+class DocumentSearch;
+class MappedLineIndexer;
+class QTimer;
 
 class TextDocument : public QObject
 {
@@ -14,18 +26,54 @@ class TextDocument : public QObject
     Q_PROPERTY(QString content READ content WRITE setContent NOTIFY contentChanged)
     Q_PROPERTY(bool isDirty READ isDirty NOTIFY dirtyChanged)
     Q_PROPERTY(int lineCount READ lineCount NOTIFY lineCountChanged)
+    Q_PROPERTY(bool readOnly READ isReadOnly NOTIFY readOnlyChanged)
+    Q_PROPERTY(bool loading READ isLoading NOTIFY loadingChanged)
+    Q_PROPERTY(qreal loadProgress READ loadProgress NOTIFY loadProgressChanged)
+    Q_PROPERTY(bool saving READ isSaving NOTIFY savingChanged)
+    Q_PROPERTY(bool following READ isFollowing WRITE setFollowing NOTIFY followingChanged)
+    Q_PROPERTY(int followLineLimit READ followLineLimit WRITE setFollowLineLimit NOTIFY followLineLimitChanged)
 public:
     explicit TextDocument(QObject *parent = nullptr);
     ~TextDocument();
     // File operations
     bool loadFile(const QString &filePath);
+    bool loadFileMapped(const QString &filePath);
+    bool loadFileAsync(const QString &filePath);
+    Q_INVOKABLE void cancelLoading();
+    // Rereads the file after it changed on disk. A clean buffer takes the
+    // changed lines only; a dirty one just reports changedOnDisk() unless
+    // its changes are to be discarded.
+    Q_INVOKABLE void reloadFromDisk(bool discardChanges = false);
     bool saveFile(const QString &filePath);
-    // Content accessors
+    // Follow mode: text appended to the file is read as it arrives and
+    // added at the end of the buffer. With a line limit the oldest lines
+    // are dropped, and the buffer can no longer be saved over the file.
+    bool isFollowing() const;
+    void setFollowing(bool following);
+    int followLineLimit() const;
+    void setFollowLineLimit(int lines);
+    // Content accessors; mapped files are only read by line and have no
+    // content as a whole
     QString content() const;
     void setContent(const QString &content);
+    int length() const;
+    QString text(int position, int length) const;
     // State accessors
     bool isDirty() const;
     int lineCount() const;
+    bool isReadOnly() const;
+    bool isLoading() const;
+    qreal loadProgress() const;
+    bool isSaving() const;
+    // Encoding and line endings the file is saved with
+    TextFormat textFormat() const;
+    // Bytes of the file were not valid in its encoding and were replaced, or
+    // it mixed line endings, so the buffer cannot be saved over the file
+    // without changing them
+    bool isLossy() const;
+    // Undo history memory budget, in bytes
+    qint64 undoBudget() const;
+    void setUndoBudget(qint64 bytes);
     // Editing operations
     Q_INVOKABLE void undo();
     Q_INVOKABLE void redo();
@@ -34,32 +82,166 @@ public:
     Q_INVOKABLE void replaceText(int position, int length, const QString &text);
     // Line operations
     Q_INVOKABLE QString getLine(int lineNumber) const;
-    Q_INVOKABLE int getLineStart(int lineNumber) const;
+    Q_INVOKABLE qint64 getLineStart(int lineNumber) const;
     Q_INVOKABLE int getLineLength(int lineNumber) const;
+    Q_INVOKABLE int getLineNumber(qint64 position) const;
+    // Highlighting of a line, computed in the background; lines not
+    // highlighted yet have none
+    QVector<QTextLayout::FormatRange> lineFormats(int lineNumber) const;
+    // Lines an editor shows, highlighted before the others
+    void setViewportLines(int firstLine, int lastLine);
+    // Search, run in the background; matches are kept here as they are
+    // found, sorted by position, and only their count is reported
+    Q_INVOKABLE void findAll(const QString &pattern, bool caseSensitive = false, bool regularExpression = false);
+    // Stops the search and drops its matches
+    Q_INVOKABLE void cancelSearch();
+    int searchMatchCount() const;
+    int searchMatchPosition(int match) const;
+    int searchMatchLength(int match) const;
+    // First match at or after a position, searchMatchCount() if none
+    int searchMatchAfter(int position) const;
+    // Replacing runs in the background too; the replacements are applied as
+    // one undo step once all are found, and replaceAllFinished() reports them
+    Q_INVOKABLE void replaceAll(const QString &pattern, const QString &replacement, bool caseSensitive = false,
+                                bool regularExpression = false);
 
     // Syntax highlighting
-    QTextDocument* document() const { return m_document; }
     void applySyntaxHighlighting(const QString &fileExtension);
 
+    // Crash recovery: replays a journal left by a previous run on top of
+    // the freshly loaded file, as one undoable step
+    bool recoverJournal(const EditJournal::Contents &contents);
+    void discardJournal();
+
 signals:
     void contentChanged();
+    // Every change of the buffer, after it is applied
+    void textEdited(int position, int charsRemoved, int charsAdded);
+    // Highlighting of a range of lines changed
+    void highlightingChanged(int firstLine, int lastLine);
     void dirtyChanged(bool isDirty);
     void lineCountChanged(int lineCount);
+    void readOnlyChanged(bool readOnly);
+    // Asynchronous loading
+    void loadingChanged(bool loading);
+    void loadProgressChanged(qreal progress);
+    void loadFinished(bool completed);
+    void loadFailed(const QString &error);
+    // External changes
+    void changedOnDisk();
+    void reloaded();
+    // Follow mode
+    void followingChanged(bool following);
+    void followLineLimitChanged(int lines);
+    void followAppended(int position, int length);
+    // Background saving
+    void savingChanged(bool saving);
+    void saveFinished(const QString &filePath);
+    void saveFailed(const QString &filePath, const QString &error);
+    // Background search
+    void searchMatchesFound(int matchCount);
+    void searchFinished(int matchCount);
+    void replaceAllFinished(int replacementCount);
 private:
     // Internal document representation
-    QTextDocument *m_document;
+    PieceTable m_buffer;
+    // Read-only mapped file, used instead of m_buffer when open
+    MappedTextBuffer m_mappedBuffer;
+    // Finds the lines of m_mappedBuffer while it is open
+    MappedLineIndexer *m_indexer;
     QUndoStack *m_undoStack;
     // State tracking
     bool m_isDirty;
-    QString m_originalContent;
+    // Length and hash of the text on disk; an edited buffer of the same
+    // length is hashed to tell whether it went back to the saved text
+    int m_savedLength;
+    quint64 m_savedHash;
+    ContentHash m_loadHash;
+    QTimer *m_dirtyCheckTimer;
     QString m_filePath;
-    // Syntax highlighter
-    SyntaxHighlighter *m_highlighter;
+    TextFormat m_format;
+    bool m_lossy;
+    int m_lineCount;
+    // Syntax highlighting of m_buffer
+    DocumentHighlighter *m_highlighter;
+    QString m_language;
+    // Background loading
+    DocumentLoader *m_loader;
+    qreal m_loadProgress;
+    // Edits wait until the loader cannot restart and drop the loaded text
+    bool m_loadSettled;
+    // Rereading the file after an external change
+    DocumentLoader *m_reloader;
+    QString m_reloadText;
+    ContentHash m_reloadHash;
+    // Bytes of the file the buffer was last read from or written to, which
+    // is where appended text starts
+    qint64 m_diskSize;
+    // Follow mode; m_followOffset is the size of the file read so far and
+    // m_followHash the hash of its text
+    bool m_following;
+    int m_followLineLimit;
+    qint64 m_followOffset;
+    TextDecoder m_followDecoder;
+    ContentHash m_followHash;
+    QTimer *m_followTimer;
+    // The oldest lines were dropped, the buffer is only the end of the file
+    bool m_followTrimmed;
+    bool m_appendingFromDisk;
+    // Background saving; a save requested while one runs is written after it
+    DocumentSaver *m_saver;
+    bool m_savePending;
+    QString m_pendingSavePath;
+    // Bumped on every edit, tells whether a finished save is still current
+    quint64 m_revision;
+    quint64 m_savedRevision;
+    // Crash recovery journal, started at the first edit
+    EditJournal *m_journal;
+    // Running findAll(), and the matches it found so far
+    DocumentSearch *m_search;
+    QVector<int> m_matchPositions;
+    QVector<int> m_matchLengths;
+    // Running replaceAll()
+    DocumentSearch *m_replace;
     // Helpers
+    bool isEditable() const;
+    void applyEdit(int position, int removeLength, const QString &text);
+    void pushReplacement(int position, const QString &oldText, const QString &newText);
+    void resetContent();
+    bool openMapped(const QString &filePath);
+    void closeMapped();
+    void stopLoader();
+    void finishLoading();
+    void stopReloader();
+    void stopReplace();
+    void applyReload(const QString &text, quint64 hash, const DocumentLoader *reloader);
+    bool startFollowing();
+    void stopFollowing();
+    void readAppended();
+    void trimToFollowLineLimit();
+    void startSave(const QString &filePath);
+    void finishSave();
     void updateLineCount();
     void markAsDirty(bool dirty = true);
+    void updateDirtyState();
+    void checkSavedHash();
+    quint64 bufferHash() const;
+    void startJournal();
     void resetUndoStack();
     // Commands for undo/redo
+    class EditCommand;
     class TextEditCommand;
+    class ReplaceAllCommand;
+    void pushEdit(EditCommand *command);
+    void trackUndoCommand(EditCommand *command);
+    void untrackUndoCommand(EditCommand *command);
+    void trimUndoHistory();
+    static bool isDiscarded(const QUndoCommand *command);
+    static void collectCommands(const QUndoCommand *command, QSet<const QUndoCommand *> &commands);
+    // Live edit commands by push order, and the memory their text takes
+    QMap<quint64, EditCommand *> m_undoCommands;
+    quint64 m_nextUndoSerial;
+    qint64 m_undoBytes;
+    qint64 m_undoBudget;
 };
 #endif // TEXTDOCUMENT_H
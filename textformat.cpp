@@ -0,0 +1,574 @@
+#include "textformat.h"
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTFORMAT_SSE2
+#endif
+
+static const ushort ReplacementCharacter = 0xFFFD;
+
+// Skips bytes below 0x80
+static const uchar *skipAscii(const uchar *input, const uchar *end)
+{
+#ifdef TEXTFORMAT_SSE2
+    while (end - input >= 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+        const int highBytes = _mm_movemask_epi8(bytes);
+        if (highBytes) {
+            return input + qCountTrailingZeroBits(quint32(highBytes));
+        }
+        input += 16;
+    }
+#endif
+    while (input < end && *input < 0x80) {
+        ++input;
+    }
+    return input;
+}
+
+// Length of the well-formed UTF-8 sequence starting at input, 0 if it is
+// malformed and -1 if it is cut off by end
+static int utf8SequenceLength(const uchar *input, const uchar *end)
+{
+    const uchar lead = input[0];
+    int needed;
+    uchar lower = 0x80;
+    uchar upper = 0xBF;
+
+    if (lead < 0x80) {
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        needed = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        needed = 2;
+        // No overlong forms and no surrogates
+        if (lead == 0xE0) {
+            lower = 0xA0;
+        } else if (lead == 0xED) {
+            upper = 0x9F;
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        needed = 3;
+        // No overlong forms and nothing above U+10FFFF
+        if (lead == 0xF0) {
+            lower = 0x90;
+        } else if (lead == 0xF4) {
+            upper = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    for (int i = 1; i <= needed; ++i) {
+        if (input + i == end) {
+            return -1;
+        }
+        if (input[i] < lower || input[i] > upper) {
+            return 0;
+        }
+        lower = 0x80;
+        upper = 0xBF;
+    }
+
+    return needed + 1;
+}
+
+TextFormat TextFormat::detect(const char *data, qint64 size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    TextFormat format;
+
+    // Byte order marks
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        format.hasBom = true;
+        return format;
+    }
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        format.encoding = Utf16LE;
+        format.hasBom = true;
+        return format;
+    }
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        format.encoding = Utf16BE;
+        format.hasBom = true;
+        return format;
+    }
+
+    // UTF-16 without a BOM: mostly ASCII text has every other byte zero
+    const qint64 sample = qMin(size, qint64(4096)) & ~qint64(1);
+    if (sample >= 2) {
+        qint64 evenZeros = 0;
+        qint64 oddZeros = 0;
+        for (qint64 i = 0; i < sample; i += 2) {
+            evenZeros += bytes[i] == 0;
+            oddZeros += bytes[i + 1] == 0;
+        }
+
+        const qint64 units = sample / 2;
+        if (oddZeros * 4 >= units * 3 && evenZeros * 8 <= units) {
+            format.encoding = Utf16LE;
+            return format;
+        }
+        if (evenZeros * 4 >= units * 3 && oddZeros * 8 <= units) {
+            format.encoding = Utf16BE;
+            return format;
+        }
+    }
+
+    // Valid UTF-8, allowing for a sequence cut off at the end of the sample
+    const uchar *input = bytes;
+    const uchar *end = bytes + size;
+    while (true) {
+        input = skipAscii(input, end);
+        if (input == end) {
+            return format;
+        }
+
+        const int length = utf8SequenceLength(input, end);
+        if (length < 0) {
+            return format;
+        }
+        if (length == 0) {
+            format.encoding = Latin1;
+            return format;
+        }
+        input += length;
+    }
+}
+
+TextDecoder::TextDecoder()
+    : m_detected(false)
+    , m_pendingCr(false)
+    , m_latin1Fallback(false)
+    , m_lossy(false)
+    , m_lfCount(0)
+    , m_crlfCount(0)
+{
+}
+
+TextDecoder::TextDecoder(const TextFormat &format)
+    : m_format(format)
+    , m_detected(true)
+    , m_pendingCr(false)
+    , m_latin1Fallback(false)
+    , m_lossy(false)
+    , m_lfCount(0)
+    , m_crlfCount(0)
+{
+}
+
+QString TextDecoder::decode(const char *data, qint64 size)
+{
+    QByteArray joined;
+    if (!m_pending.isEmpty()) {
+        joined = m_pending;
+        joined.append(data, int(size));
+        m_pending.clear();
+        data = joined.constData();
+        size = joined.size();
+    }
+
+    const uchar *input = reinterpret_cast<const uchar *>(data);
+    const uchar *end = input + size;
+
+    if (!m_detected) {
+        m_format = TextFormat::detect(data, size);
+        m_detected = true;
+        if (m_format.hasBom) {
+            input += m_format.encoding == TextFormat::Utf8 ? 3 : 2;
+        }
+        m_latin1Fallback = m_format.encoding == TextFormat::Utf8 && !m_format.hasBom;
+    }
+
+    // Never more characters than bytes, plus a '\r' held back last time
+    QString text;
+    text.resize(int(end - input) + 1);
+    QChar *out = text.data();
+
+    switch (m_format.encoding) {
+    case TextFormat::Utf8:
+        decodeUtf8(input, end, out);
+        break;
+    case TextFormat::Latin1:
+        decodeLatin1(input, end, out);
+        break;
+    case TextFormat::Utf16LE:
+    case TextFormat::Utf16BE:
+        decodeUtf16(input, end, out);
+        break;
+    }
+
+    // A sequence cut by the end of the block is completed by the next one
+    m_pending = QByteArray(reinterpret_cast<const char *>(input), int(end - input));
+
+    text.truncate(int(out - text.constData()));
+    return text;
+}
+
+QString TextDecoder::finish()
+{
+    QString text;
+    if (!m_pending.isEmpty()) {
+        // A sequence cut off by the end of the file
+        if (switchToLatin1()) {
+            text.resize(m_pending.size() + 1);
+            QChar *out = text.data();
+            const uchar *input = reinterpret_cast<const uchar *>(m_pending.constData());
+            decodeLatin1(input, input + m_pending.size(), out);
+            text.truncate(int(out - text.constData()));
+        } else {
+            if (m_pendingCr) {
+                text.append(QLatin1Char('\r'));
+                m_pendingCr = false;
+            }
+            text.append(QChar(ReplacementCharacter));
+            m_lossy = true;
+        }
+        m_pending.clear();
+    }
+    if (m_pendingCr) {
+        text.append(QLatin1Char('\r'));
+        m_pendingCr = false;
+    }
+
+    // The most common style wins; hasMixedLineEndings() tells when that
+    // changes the other lines
+    m_format.lineEnding = m_crlfCount > m_lfCount ? TextFormat::CrLf : TextFormat::Lf;
+    return text;
+}
+
+TextFormat TextDecoder::format() const
+{
+    return m_format;
+}
+
+bool TextDecoder::isLossy() const
+{
+    return m_lossy;
+}
+
+bool TextDecoder::hasMixedLineEndings() const
+{
+    return m_format.lineEnding == TextFormat::CrLf ? m_lfCount > 0 : m_crlfCount > 0;
+}
+
+bool TextDecoder::switchToLatin1()
+{
+    if (!m_latin1Fallback) {
+        return false;
+    }
+
+    m_latin1Fallback = false;
+    m_format.encoding = TextFormat::Latin1;
+    return true;
+}
+
+void TextDecoder::put(QChar *&out, ushort unit)
+{
+    if (m_pendingCr) {
+        m_pendingCr = false;
+        if (unit == '\n') {
+            ++m_crlfCount;
+            *out++ = QLatin1Char('\n');
+            return;
+        }
+        *out++ = QLatin1Char('\r');
+    }
+
+    if (unit == '\r') {
+        m_pendingCr = true;
+        return;
+    }
+    if (unit == '\n') {
+        ++m_lfCount;
+    }
+    *out++ = QChar(unit);
+}
+
+void TextDecoder::decodeUtf8(const uchar *&input, const uchar *end, QChar *&out)
+{
+    while (input < end) {
+        // Plain ASCII is widened in bulk, the rest one sequence at a time.
+        // After a '\r' the next character has to go through put().
+        if (!m_pendingCr) {
+            input = widenAscii(input, end, out, false);
+            if (input == end) {
+                break;
+            }
+        }
+
+        const int length = utf8SequenceLength(input, end);
+        if (length < 0) {
+            break;
+        }
+        if (length == 0) {
+            if (switchToLatin1()) {
+                decodeLatin1(input, end, out);
+                return;
+            }
+            put(out, ReplacementCharacter);
+            m_lossy = true;
+            ++input;
+            continue;
+        }
+        if (length > 1) {
+            m_latin1Fallback = false;
+        }
+
+        uint codePoint = length == 1 ? input[0] : input[0] & (0x7F >> length);
+        for (int i = 1; i < length; ++i) {
+            codePoint = (codePoint << 6) | (input[i] & 0x3F);
+        }
+        input += length;
+
+        if (codePoint >= 0x10000) {
+            put(out, QChar::highSurrogate(codePoint));
+            put(out, QChar::lowSurrogate(codePoint));
+        } else {
+            put(out, ushort(codePoint));
+        }
+    }
+}
+
+void TextDecoder::decodeLatin1(const uchar *&input, const uchar *end, QChar *&out)
+{
+    while (input < end) {
+        if (!m_pendingCr) {
+            input = widenAscii(input, end, out, true);
+            if (input == end) {
+                break;
+            }
+        }
+        put(out, *input++);
+    }
+}
+
+void TextDecoder::decodeUtf16(const uchar *&input, const uchar *end, QChar *&out)
+{
+    const bool bigEndian = m_format.encoding == TextFormat::Utf16BE;
+    while (end - input >= 2) {
+        const ushort unit = bigEndian ? ushort(input[0] << 8 | input[1]) : ushort(input[1] << 8 | input[0]);
+        put(out, unit);
+        input += 2;
+    }
+}
+
+// Copies bytes to characters up to the first '\r', or the first byte above
+// 0x7F unless allowHighBytes, counting line feeds on the way
+const uchar *TextDecoder::widenAscii(const uchar *input, const uchar *end, QChar *&out, bool allowHighBytes)
+{
+#ifdef TEXTFORMAT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i lineFeed = _mm_set1_epi8('\n');
+
+    while (end - input >= 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+        int stop = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, carriageReturn));
+        if (!allowHighBytes) {
+            stop |= _mm_movemask_epi8(bytes);
+        }
+
+        if (stop) {
+            // Finish the bytes before the stop below
+            end = input + qCountTrailingZeroBits(quint32(stop));
+            break;
+        }
+
+        m_lfCount += qPopulationCount(quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, lineFeed))));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+        input += 16;
+        out += 16;
+    }
+#endif
+
+    while (input < end) {
+        const uchar byte = *input;
+        if (byte == '\r' || (byte >= 0x80 && !allowHighBytes)) {
+            break;
+        }
+        if (byte == '\n') {
+            ++m_lfCount;
+        }
+        *out++ = QChar(ushort(byte));
+        ++input;
+    }
+    return input;
+}
+
+TextEncoder::TextEncoder(const TextFormat &format)
+    : m_format(format)
+    , m_pendingHighSurrogate(0)
+{
+}
+
+QByteArray TextEncoder::header() const
+{
+    if (!m_format.hasBom) {
+        return QByteArray();
+    }
+
+    switch (m_format.encoding) {
+    case TextFormat::Utf8:
+        return QByteArray("\xEF\xBB\xBF", 3);
+    case TextFormat::Utf16LE:
+        return QByteArray("\xFF\xFE", 2);
+    case TextFormat::Utf16BE:
+        return QByteArray("\xFE\xFF", 2);
+    case TextFormat::Latin1:
+        break;
+    }
+    return QByteArray();
+}
+
+void TextEncoder::encode(const QChar *data, int length, QByteArray &out)
+{
+    // Worst case is 3 bytes for a BMP character in UTF-8, or a line break
+    // expanded to "\r\n" in UTF-16, plus a surrogate from the last block
+    const int start = out.size();
+    out.resize(start + length * 4 + 4);
+    char *output = out.data() + start;
+
+    switch (m_format.encoding) {
+    case TextFormat::Utf8:
+        encodeUtf8(data, data + length, output);
+        break;
+    case TextFormat::Latin1:
+        encodeLatin1(data, data + length, output);
+        break;
+    case TextFormat::Utf16LE:
+    case TextFormat::Utf16BE:
+        encodeUtf16(data, data + length, output);
+        break;
+    }
+
+    out.truncate(int(output - out.constData()));
+}
+
+void TextEncoder::finish(QByteArray &out)
+{
+    // A lone high surrogate at the very end
+    if (m_pendingHighSurrogate) {
+        m_pendingHighSurrogate = 0;
+        const QChar replacement(ReplacementCharacter);
+        encode(&replacement, 1, out);
+    }
+}
+
+void TextEncoder::encodeUtf8(const QChar *data, const QChar *end, char *&out)
+{
+    const bool crlf = m_format.lineEnding == TextFormat::CrLf;
+
+    while (data < end) {
+#ifdef TEXTFORMAT_SSE2
+        // Eight ASCII characters at a time, narrowed to bytes
+        if (!m_pendingHighSurrogate) {
+            const __m128i nonAscii = _mm_set1_epi16(short(0xFF80));
+            const __m128i lineFeed = _mm_set1_epi16('\n');
+            const __m128i zero = _mm_setzero_si128();
+
+            while (end - data >= 8) {
+                const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+                int plain = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, nonAscii), zero));
+                if (crlf) {
+                    plain &= ~_mm_movemask_epi8(_mm_cmpeq_epi16(units, lineFeed));
+                }
+                if (plain != 0xFFFF) {
+                    break;
+                }
+
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(units, units));
+                data += 8;
+                out += 8;
+            }
+
+            if (data == end) {
+                break;
+            }
+        }
+#endif
+
+        uint codePoint = data->unicode();
+        ++data;
+
+        if (m_pendingHighSurrogate) {
+            const ushort high = m_pendingHighSurrogate;
+            m_pendingHighSurrogate = 0;
+            if (QChar::isLowSurrogate(codePoint)) {
+                codePoint = QChar::surrogateToUcs4(high, ushort(codePoint));
+            } else {
+                // Unpaired, write a replacement and handle this one normally
+                *out++ = char(0xEF);
+                *out++ = char(0xBF);
+                *out++ = char(0xBD);
+            }
+        }
+
+        if (QChar::isHighSurrogate(codePoint)) {
+            m_pendingHighSurrogate = ushort(codePoint);
+            continue;
+        }
+        if (QChar::isLowSurrogate(codePoint)) {
+            codePoint = ReplacementCharacter;
+        }
+
+        if (codePoint < 0x80) {
+            if (codePoint == '\n' && crlf) {
+                *out++ = '\r';
+            }
+            *out++ = char(codePoint);
+        } else if (codePoint < 0x800) {
+            *out++ = char(0xC0 | (codePoint >> 6));
+            *out++ = char(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            *out++ = char(0xE0 | (codePoint >> 12));
+            *out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+            *out++ = char(0x80 | (codePoint & 0x3F));
+        } else {
+            *out++ = char(0xF0 | (codePoint >> 18));
+            *out++ = char(0x80 | ((codePoint >> 12) & 0x3F));
+            *out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+            *out++ = char(0x80 | (codePoint & 0x3F));
+        }
+    }
+}
+
+void TextEncoder::encodeLatin1(const QChar *data, const QChar *end, char *&out)
+{
+    const bool crlf = m_format.lineEnding == TextFormat::CrLf;
+
+    for (; data < end; ++data) {
+        const ushort unit = data->unicode();
+        if (unit == '\n' && crlf) {
+            *out++ = '\r';
+        }
+        // Characters Latin-1 cannot represent
+        *out++ = unit < 0x100 ? char(unit) : '?';
+    }
+}
+
+void TextEncoder::encodeUtf16(const QChar *data, const QChar *end, char *&out)
+{
+    const bool crlf = m_format.lineEnding == TextFormat::CrLf;
+    const bool bigEndian = m_format.encoding == TextFormat::Utf16BE;
+
+    auto write = [&out, bigEndian](ushort unit) {
+        if (bigEndian) {
+            *out++ = char(unit >> 8);
+            *out++ = char(unit & 0xFF);
+        } else {
+            *out++ = char(unit & 0xFF);
+            *out++ = char(unit >> 8);
+        }
+    };
+
+    for (; data < end; ++data) {
+        const ushort unit = data->unicode();
+        if (unit == '\n' && crlf) {
+            write('\r');
+        }
+        write(unit);
+    }
+}
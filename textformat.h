@@ -0,0 +1,108 @@
+#ifndef TEXTFORMAT_H
+#define TEXTFORMAT_H
+
+#include <QString>
+#include <QByteArray>
+
+// How a text file is stored on disk. The buffer itself is always UTF-16
+// with '\n' line breaks; the format is what loading took away and saving
+// puts back.
+struct TextFormat
+{
+    enum Encoding {
+        Utf8,
+        Utf16LE,
+        Utf16BE,
+        Latin1
+    };
+
+    enum LineEnding {
+        Lf,
+        CrLf
+    };
+
+    Encoding encoding = Utf8;
+    bool hasBom = false;
+    LineEnding lineEnding = Lf;
+
+    // Guesses the format from the first bytes of a file: a BOM, UTF-16
+    // without a BOM, valid UTF-8, and Latin-1 for everything else
+    static TextFormat detect(const char *data, qint64 size);
+};
+
+// Streaming decoder for file contents.
+//
+// The format is detected from the first block passed to decode(). Every
+// block is transcoded straight into the output string in one pass, which
+// also turns "\r\n" into '\n' and counts both kinds of line ending. Runs of
+// ASCII, the bulk of source files, are widened 16 bytes at a time. Sequences
+// split across blocks are carried over to the next one.
+//
+// Invalid UTF-8 found after the first block means the guess was wrong. As
+// long as nothing but ASCII was decoded, which reads the same in Latin-1,
+// the decoder switches to Latin-1 on the spot. Otherwise the bytes decode to
+// U+FFFD and the text is lossy: saving it would not give the file back.
+class TextDecoder
+{
+public:
+    TextDecoder();
+    // Decoder for bytes in a known format that do not start the file, so
+    // there is nothing to detect and no byte order mark to skip
+    explicit TextDecoder(const TextFormat &format);
+
+    QString decode(const char *data, qint64 size);
+    // Flushes what was held back at the end of the last block
+    QString finish();
+
+    // The detected format; the line ending is final after finish()
+    TextFormat format() const;
+    // Whether bytes that are not valid in the format were replaced
+    bool isLossy() const;
+    // Whether line breaks other than the format's were decoded; a file
+    // mixing both cannot be saved back with one style. Final after finish().
+    bool hasMixedLineEndings() const;
+
+private:
+    void put(QChar *&out, ushort unit);
+    bool switchToLatin1();
+    void decodeUtf8(const uchar *&input, const uchar *end, QChar *&out);
+    void decodeLatin1(const uchar *&input, const uchar *end, QChar *&out);
+    void decodeUtf16(const uchar *&input, const uchar *end, QChar *&out);
+    const uchar *widenAscii(const uchar *input, const uchar *end, QChar *&out, bool allowHighBytes);
+
+    TextFormat m_format;
+    bool m_detected;
+    // Bytes of an incomplete sequence at the end of the previous block
+    QByteArray m_pending;
+    bool m_pendingCr;
+    // UTF-8 was guessed and only ASCII decoded so far
+    bool m_latin1Fallback;
+    bool m_lossy;
+    qint64 m_lfCount;
+    qint64 m_crlfCount;
+};
+
+// Streaming encoder, the counterpart of TextDecoder. Line breaks are
+// expanded and characters encoded in the same pass.
+class TextEncoder
+{
+public:
+    explicit TextEncoder(const TextFormat &format);
+
+    // Byte order mark to write first, if the format has one
+    QByteArray header() const;
+    // Appends the encoded text to out
+    void encode(const QChar *data, int length, QByteArray &out);
+    void finish(QByteArray &out);
+
+private:
+    void encodeUtf8(const QChar *data, const QChar *end, char *&out);
+    void encodeLatin1(const QChar *data, const QChar *end, char *&out);
+    void encodeUtf16(const QChar *data, const QChar *end, char *&out);
+
+    TextFormat m_format;
+    // High surrogate at the end of the previous block
+    ushort m_pendingHighSurrogate;
+};
+
+#endif // TEXTFORMAT_H
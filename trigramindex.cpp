@@ -0,0 +1,561 @@
+#include "trigramindex.h"
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+// Larger files are not indexed and are candidates for every query
+static const qint64 MaxIndexedFileSize = 4 * 1024 * 1024;
+// Bytes looked at for a NUL to tell binary files apart
+static const qint64 BinaryCheckSize = 8 * 1024;
+
+static inline uchar foldByte(uchar byte)
+{
+    return (byte >= 'A' && byte <= 'Z') ? uchar(byte | 0x20) : byte;
+}
+
+// Unique trigrams of a pattern, folded like the index
+static QVector<quint32> patternTrigrams(const QByteArray &pattern)
+{
+    QVector<quint32> trigrams;
+    for (int i = 0; i + 2 < pattern.size(); ++i) {
+        trigrams.append(quint32(foldByte(uchar(pattern.at(i)))) << 16
+                        | quint32(foldByte(uchar(pattern.at(i + 1)))) << 8
+                        | quint32(foldByte(uchar(pattern.at(i + 2)))));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+static void appendVarint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Writes a new index for a folder on a worker thread. The result goes to
+// indexPath + ".new"; TrigramIndex swaps it in once the thread finished.
+class TrigramIndexBuilder : public QThread
+{
+public:
+    TrigramIndexBuilder(const QString &rootPath, const QString &indexPath, QObject *parent)
+        : QThread(parent)
+        , m_rootPath(rootPath)
+        , m_indexPath(indexPath)
+        , m_cancelled(0)
+        , m_succeeded(false)
+        , m_seen(1 << 18, 0)
+    {
+    }
+
+    ~TrigramIndexBuilder()
+    {
+        // Never destroy a running thread
+        cancel();
+        wait();
+    }
+
+    void cancel()
+    {
+        m_cancelled.storeRelaxed(1);
+    }
+
+    bool isCancelled() const
+    {
+        return m_cancelled.loadRelaxed() != 0;
+    }
+
+    bool succeeded() const
+    {
+        return m_succeeded;
+    }
+
+    QString outputPath() const
+    {
+        return m_indexPath + ".new";
+    }
+
+protected:
+    void run() override
+    {
+        QFile previousFile(m_indexPath);
+        TrigramIndex::View previous;
+        if (previousFile.open(QIODevice::ReadOnly)) {
+            const qint64 size = previousFile.size();
+            const uchar *data = size > 0 ? previousFile.map(0, size) : nullptr;
+            if (data) {
+                previous.open(data, size);
+            }
+        }
+
+        // Files of the previous index by relative path
+        QHash<QString, quint32> previousFiles;
+        if (previous.isValid()) {
+            previousFiles.reserve(int(previous.header->fileCount));
+            for (quint32 file = 0; file < previous.header->fileCount; ++file) {
+                previousFiles.insert(previous.relativePath(file), file);
+            }
+        }
+        QVector<qint64> renumbered(previous.isValid() ? int(previous.header->fileCount) : 0, -1);
+
+        // Hidden entries are skipped by leaving out QDir::Hidden
+        const QDir root(m_rootPath);
+        QDirIterator it(m_rootPath, QDir::Files | QDir::Readable | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            if (isCancelled()) {
+                return;
+            }
+
+            const QString filePath = it.next();
+            const QFileInfo info = it.fileInfo();
+            TrigramIndex::FileEntry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.modified = info.lastModified().toMSecsSinceEpoch();
+            entry.size = info.size();
+
+            const QByteArray relativePath = root.relativeFilePath(filePath).toUtf8();
+            entry.pathOffset = quint32(m_strings.size());
+            entry.pathLength = quint32(relativePath.size());
+            m_strings += relativePath;
+
+            // Unchanged files keep their trigrams
+            const quint32 number = quint32(m_files.size());
+            const auto found = previousFiles.constFind(QString::fromUtf8(relativePath));
+            if (found != previousFiles.constEnd()
+                && previous.files[found.value()].modified == entry.modified
+                && previous.files[found.value()].size == entry.size) {
+                entry.flags = previous.files[found.value()].flags;
+                renumbered[int(found.value())] = number;
+            } else {
+                entry.flags = indexFile(filePath, number);
+            }
+            m_files.append(entry);
+        }
+
+        // Carry the postings of unchanged files over
+        if (previous.isValid()) {
+            for (quint32 i = 0; i < previous.header->trigramCount && !isCancelled(); ++i) {
+                const TrigramIndex::TrigramEntry *entry = previous.trigrams + i;
+                const QVector<quint32> files = previous.postingsOf(entry);
+                QVector<quint32> *postings = nullptr;
+                for (quint32 file : files) {
+                    if (renumbered[int(file)] >= 0) {
+                        if (!postings) {
+                            postings = &m_postings[entry->trigram];
+                        }
+                        postings->append(quint32(renumbered[int(file)]));
+                    }
+                }
+            }
+        }
+        previousFile.close();
+
+        if (!isCancelled()) {
+            m_succeeded = write();
+        }
+    }
+
+private:
+    // Adds the trigrams of a file under its number and returns its flags
+    quint32 indexFile(const QString &filePath, quint32 number)
+    {
+        QFile file(filePath);
+        const qint64 size = file.size();
+        if (size > MaxIndexedFileSize || !file.open(QIODevice::ReadOnly)) {
+            return TrigramIndex::Unindexed;
+        }
+        if (size == 0) {
+            return 0;
+        }
+
+        const uchar *data = file.map(0, size);
+        if (!data) {
+            return TrigramIndex::Unindexed;
+        }
+        if (std::memchr(data, 0, size_t(qMin(size, BinaryCheckSize)))) {
+            file.unmap(const_cast<uchar *>(data));
+            return TrigramIndex::Binary;
+        }
+
+        // Each trigram is recorded once per file, the bitset covers all 2^24
+        quint64 *seen = m_seen.data();
+        quint32 trigram = quint32(foldByte(data[0])) << 8 | (size > 1 ? foldByte(data[1]) : 0);
+        for (qint64 i = 2; i < size; ++i) {
+            trigram = ((trigram << 8) | foldByte(data[i])) & 0xffffff;
+            const quint64 bit = quint64(1) << (trigram & 63);
+            if (!(seen[trigram >> 6] & bit)) {
+                seen[trigram >> 6] |= bit;
+                m_fileTrigrams.append(trigram);
+            }
+        }
+        file.unmap(const_cast<uchar *>(data));
+
+        for (quint32 found : m_fileTrigrams) {
+            m_postings[found].append(number);
+            seen[found >> 6] = 0;
+        }
+        m_fileTrigrams.clear();
+        return 0;
+    }
+
+    bool write()
+    {
+        QVector<quint32> trigrams;
+        trigrams.reserve(m_postings.size());
+        for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+            trigrams.append(it.key());
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+
+        QVector<TrigramIndex::TrigramEntry> entries;
+        entries.reserve(trigrams.size());
+        QByteArray postings;
+        for (quint32 trigram : trigrams) {
+            QVector<quint32> &files = m_postings[trigram];
+            std::sort(files.begin(), files.end());
+
+            TrigramIndex::TrigramEntry entry;
+            entry.trigram = trigram;
+            entry.postingsOffset = quint32(postings.size());
+            entry.postingCount = quint32(files.size());
+            entries.append(entry);
+
+            quint32 last = 0;
+            for (quint32 file : files) {
+                appendVarint(postings, file - last);
+                last = file;
+            }
+            if (isCancelled()) {
+                return false;
+            }
+        }
+
+        TrigramIndex::Header header;
+        header.magic = TrigramIndex::Magic;
+        header.version = TrigramIndex::Version;
+        header.fileCount = quint32(m_files.size());
+        header.trigramCount = quint32(entries.size());
+        header.postingsSize = quint32(postings.size());
+        header.stringsSize = quint32(m_strings.size());
+
+        QFile file(outputPath());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+        bool written = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header))
+            && file.write(reinterpret_cast<const char *>(m_files.constData()),
+                          qint64(m_files.size()) * qint64(sizeof(TrigramIndex::FileEntry)))
+                   == qint64(m_files.size()) * qint64(sizeof(TrigramIndex::FileEntry))
+            && file.write(reinterpret_cast<const char *>(entries.constData()),
+                          qint64(entries.size()) * qint64(sizeof(TrigramIndex::TrigramEntry)))
+                   == qint64(entries.size()) * qint64(sizeof(TrigramIndex::TrigramEntry))
+            && file.write(postings) == postings.size()
+            && file.write(m_strings) == m_strings.size();
+        file.close();
+
+        if (!written) {
+            file.remove();
+        }
+        return written;
+    }
+
+    QString m_rootPath;
+    QString m_indexPath;
+    QAtomicInt m_cancelled;
+    bool m_succeeded;
+
+    QVector<TrigramIndex::FileEntry> m_files;
+    QByteArray m_strings;
+    QHash<quint32, QVector<quint32>> m_postings;
+    QVector<quint64> m_seen;
+    QVector<quint32> m_fileTrigrams;
+};
+
+bool TrigramIndex::View::open(const uchar *data, qint64 size)
+{
+    *this = View();
+    if (size < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    const Header *candidate = reinterpret_cast<const Header *>(data);
+    if (candidate->magic != Magic || candidate->version != Version) {
+        return false;
+    }
+
+    const qint64 filesSize = qint64(candidate->fileCount) * qint64(sizeof(FileEntry));
+    const qint64 trigramsSize = qint64(candidate->trigramCount) * qint64(sizeof(TrigramEntry));
+    if (qint64(sizeof(Header)) + filesSize + trigramsSize + candidate->postingsSize + candidate->stringsSize != size) {
+        return false;
+    }
+
+    header = candidate;
+    files = reinterpret_cast<const FileEntry *>(data + sizeof(Header));
+    trigrams = reinterpret_cast<const TrigramEntry *>(data + sizeof(Header) + filesSize);
+    postings = data + sizeof(Header) + filesSize + trigramsSize;
+    strings = reinterpret_cast<const char *>(postings + header->postingsSize);
+    for (quint32 file = 0; file < header->fileCount; ++file) {
+        if (files[file].flags & Unindexed) {
+            unindexed.append(file);
+        }
+    }
+    return true;
+}
+
+const TrigramIndex::TrigramEntry *TrigramIndex::View::find(quint32 trigram) const
+{
+    const TrigramEntry *end = trigrams + header->trigramCount;
+    const TrigramEntry *entry = std::lower_bound(trigrams, end, trigram,
+                                                 [](const TrigramEntry &e, quint32 t) { return e.trigram < t; });
+    return (entry != end && entry->trigram == trigram) ? entry : nullptr;
+}
+
+QVector<quint32> TrigramIndex::View::postingsOf(const TrigramEntry *entry) const
+{
+    QVector<quint32> files;
+    files.reserve(int(entry->postingCount));
+
+    const uchar *input = postings + entry->postingsOffset;
+    const uchar *end = postings + header->postingsSize;
+    quint32 file = 0;
+    for (quint32 i = 0; i < entry->postingCount && input < end; ++i) {
+        quint32 delta = 0;
+        int shift = 0;
+        while (input < end && (*input & 0x80)) {
+            delta |= quint32(*input++ & 0x7f) << shift;
+            shift += 7;
+        }
+        if (input < end) {
+            delta |= quint32(*input++) << shift;
+        }
+        file += delta;
+        if (file >= header->fileCount) {
+            break;
+        }
+        files.append(file);
+    }
+    return files;
+}
+
+QString TrigramIndex::View::relativePath(quint32 file) const
+{
+    const FileEntry &entry = files[file];
+    if (quint64(entry.pathOffset) + entry.pathLength > header->stringsSize) {
+        return QString();
+    }
+    return QString::fromUtf8(strings + entry.pathOffset, int(entry.pathLength));
+}
+
+TrigramIndex::TrigramIndex(QObject *parent)
+    : QObject(parent)
+    , m_data(nullptr)
+    , m_builder(nullptr)
+{
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    delete m_builder;
+    unmapIndex();
+}
+
+QString TrigramIndex::rootPath() const
+{
+    return m_rootPath;
+}
+
+void TrigramIndex::setRootPath(const QString &path)
+{
+    if (m_rootPath == path) {
+        return;
+    }
+
+    const bool wasReady = isReady();
+    delete m_builder;
+    m_builder = nullptr;
+    unmapIndex();
+    m_lastUpdate.invalidate();
+
+    m_rootPath = path;
+    m_indexPath = path.isEmpty() ? QString() : indexPathFor(path);
+    if (!path.isEmpty()) {
+        // An index from an earlier session is used while it is brought up to date
+        mapIndex();
+        update();
+    }
+
+    if (wasReady != isReady()) {
+        emit readyChanged();
+    }
+}
+
+bool TrigramIndex::isReady() const
+{
+    return m_view.isValid();
+}
+
+bool TrigramIndex::isUpdating() const
+{
+    return m_builder != nullptr;
+}
+
+void TrigramIndex::update(qint64 minimumInterval)
+{
+    if (m_rootPath.isEmpty() || m_builder) {
+        return;
+    }
+    if (minimumInterval > 0 && m_lastUpdate.isValid() && m_lastUpdate.elapsed() < minimumInterval) {
+        return;
+    }
+
+    TrigramIndexBuilder *builder = new TrigramIndexBuilder(m_rootPath, m_indexPath, this);
+    connect(builder, &QThread::finished, this, [this, builder]() {
+        if (builder == m_builder) {
+            finishUpdate();
+        }
+    });
+    m_builder = builder;
+    builder->setPriority(QThread::LowPriority);
+    builder->start();
+}
+
+QStringList TrigramIndex::candidates(const QByteArray &pattern, bool &narrowed) const
+{
+    narrowed = false;
+    if (!m_view.isValid() || pattern.size() < 3) {
+        return QStringList();
+    }
+    narrowed = true;
+
+    // The rarest trigram goes first, every other one can only shrink it
+    QVector<const TrigramEntry *> entries;
+    bool missing = false;
+    for (quint32 trigram : patternTrigrams(pattern)) {
+        const TrigramEntry *entry = m_view.find(trigram);
+        if (!entry) {
+            missing = true;
+            break;
+        }
+        entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const TrigramEntry *a, const TrigramEntry *b) { return a->postingCount < b->postingCount; });
+
+    QVector<quint32> files;
+    if (!missing && !entries.isEmpty()) {
+        files = m_view.postingsOf(entries.first());
+        for (int i = 1; i < entries.size() && !files.isEmpty(); ++i) {
+            const QVector<quint32> other = m_view.postingsOf(entries.at(i));
+            QVector<quint32> both;
+            std::set_intersection(files.constBegin(), files.constEnd(), other.constBegin(), other.constEnd(),
+                                  std::back_inserter(both));
+            files.swap(both);
+        }
+    }
+
+    // Files too large to index are always searched
+    const QVector<quint32> &unindexed = m_view.unindexed;
+    if (!unindexed.isEmpty()) {
+        QVector<quint32> merged;
+        std::set_union(files.constBegin(), files.constEnd(), unindexed.constBegin(), unindexed.constEnd(),
+                       std::back_inserter(merged));
+        files.swap(merged);
+    }
+
+    const QDir root(m_rootPath);
+    QStringList paths;
+    paths.reserve(files.size());
+    for (quint32 file : files) {
+        paths.append(root.filePath(m_view.relativePath(file)));
+    }
+    return paths;
+}
+
+QSharedPointer<const TrigramIndex::FileStamps> TrigramIndex::fileStamps() const
+{
+    return m_stamps;
+}
+
+QString TrigramIndex::indexPathFor(const QString &rootPath)
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/index";
+    QDir().mkpath(directory);
+
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(rootPath).absoluteFilePath().toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return directory + "/" + QString::fromLatin1(key) + ".trigrams";
+}
+
+bool TrigramIndex::mapIndex()
+{
+    m_file.setFileName(m_indexPath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    m_data = size > 0 ? m_file.map(0, size) : nullptr;
+    if (!m_data || !m_view.open(m_data, size)) {
+        unmapIndex();
+        return false;
+    }
+
+    QSharedPointer<FileStamps> stamps = QSharedPointer<FileStamps>::create();
+    stamps->reserve(int(m_view.header->fileCount));
+    for (quint32 file = 0; file < m_view.header->fileCount; ++file) {
+        const FileEntry &entry = m_view.files[file];
+        stamps->insert(m_view.relativePath(file), { entry.modified, entry.size });
+    }
+    m_stamps = stamps;
+    return true;
+}
+
+void TrigramIndex::unmapIndex()
+{
+    m_view = View();
+    m_stamps.clear();
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+void TrigramIndex::finishUpdate()
+{
+    TrigramIndexBuilder *builder = m_builder;
+    m_builder = nullptr;
+    builder->deleteLater();
+
+    const bool wasReady = isReady();
+    if (builder->succeeded()) {
+        // The mapping has to go before the file can be replaced everywhere
+        unmapIndex();
+        QFile::remove(m_indexPath);
+        QFile::rename(builder->outputPath(), m_indexPath);
+        mapIndex();
+    } else {
+        QFile::remove(builder->outputPath());
+    }
+    m_lastUpdate.start();
+
+    if (wasReady != isReady()) {
+        emit readyChanged();
+    }
+    emit updateFinished();
+}
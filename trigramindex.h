@@ -0,0 +1,147 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QElapsedTimer>
+
+class TrigramIndexBuilder;
+
+// On-disk trigram index of the files below a folder.
+//
+// Every file is reduced to the set of byte trigrams it contains, with ASCII
+// letters folded to lower case so one index serves case-sensitive and
+// case-insensitive queries. The index maps each trigram to the sorted list
+// of files containing it. A query looks up the trigrams of the pattern and
+// intersects their lists, which leaves the few files that can contain a
+// match; those still have to be scanned to verify it.
+//
+// The index is built by a worker thread and written next to the edit
+// journals, one file per folder. Queries read it through a memory mapping.
+// Rebuilding is incremental: files whose modification time and size did not
+// change keep their trigrams from the previous index, only the others are
+// read again.
+class TrigramIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TrigramIndex(QObject *parent = nullptr);
+    ~TrigramIndex();
+
+    QString rootPath() const;
+    // Maps the index of a folder if there is one and starts updating it
+    void setRootPath(const QString &path);
+
+    // True once an index for the root is mapped
+    bool isReady() const;
+    bool isUpdating() const;
+
+    // Brings the index up to date in the background; does nothing if an
+    // update is running or the last one finished less than interval ago
+    void update(qint64 minimumInterval = 0);
+
+    // Absolute paths of the files that may contain an UTF-8 pattern. Patterns
+    // shorter than a trigram cannot narrow anything, narrowed is then false
+    // and nothing is returned.
+    QStringList candidates(const QByteArray &pattern, bool &narrowed) const;
+
+    // Modification time and size a file had when it was indexed
+    struct FileStamp
+    {
+        qint64 modified;
+        qint64 size;
+    };
+    typedef QHash<QString, FileStamp> FileStamps;
+    // Stamps of the indexed files by path relative to the root, null until
+    // an index is mapped. Files missing from it or stamped differently
+    // changed since, and candidates() knows nothing about them. Never
+    // modified, so a search can hold on to it on another thread.
+    QSharedPointer<const FileStamps> fileStamps() const;
+
+    static QString indexPathFor(const QString &rootPath);
+
+signals:
+    void readyChanged();
+    void updateFinished();
+
+private:
+    friend class TrigramIndexBuilder;
+
+    // Layout of the index file, all in host byte order
+    static const quint32 Magic = 0x57545249; // "WTRI"
+    static const quint32 Version = 1;
+
+    enum FileFlags {
+        // Too large to index, a candidate for every query
+        Unindexed = 0x1,
+        // Binary, never a candidate
+        Binary = 0x2
+    };
+
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 fileCount;
+        quint32 trigramCount;
+        quint32 postingsSize;
+        quint32 stringsSize;
+    };
+
+    struct FileEntry
+    {
+        quint32 pathOffset;
+        quint32 pathLength;
+        qint64 modified;
+        qint64 size;
+        quint32 flags;
+        quint32 reserved;
+    };
+
+    // Postings are file numbers, delta and varint encoded
+    struct TrigramEntry
+    {
+        quint32 trigram;
+        quint32 postingsOffset;
+        quint32 postingCount;
+    };
+
+    // Read-only view of a mapped index file
+    struct View
+    {
+        const Header *header = nullptr;
+        const FileEntry *files = nullptr;
+        const TrigramEntry *trigrams = nullptr;
+        const uchar *postings = nullptr;
+        const char *strings = nullptr;
+        // Files flagged Unindexed, collected once when the index is opened
+        QVector<quint32> unindexed;
+
+        bool isValid() const { return header != nullptr; }
+        bool open(const uchar *data, qint64 size);
+        const TrigramEntry *find(quint32 trigram) const;
+        QVector<quint32> postingsOf(const TrigramEntry *entry) const;
+        QString relativePath(quint32 file) const;
+    };
+
+    bool mapIndex();
+    void unmapIndex();
+    void finishUpdate();
+
+    QString m_rootPath;
+    QString m_indexPath;
+    QFile m_file;
+    uchar *m_data;
+    View m_view;
+    QSharedPointer<const FileStamps> m_stamps;
+    TrigramIndexBuilder *m_builder;
+    QElapsedTimer m_lastUpdate;
+};
+
+#endif // TRIGRAMINDEX_H
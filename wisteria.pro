@@ -1,12 +1,32 @@
 QT += quick
 
 SOURCES += \
+        contenthash.cpp \
+        documenthighlighter.cpp \
+        documentloader.cpp \
+        documentsaver.cpp \
+        documentsearch.cpp \
+        editjournal.cpp \
+        editorview.cpp \
         filemanager.cpp \
         filetreemodel.cpp \
+        glyphatlas.cpp \
+        languagecache.cpp \
+        linediff.cpp \
+        linenumbergutter.cpp \
         main.cpp \
-        syntaxhighlighter.cpp \
+        minimap.cpp \
+        mappedlineindexer.cpp \
+        mappedtextbuffer.cpp \
+        piecetable.cpp \
+        quickopenmodel.cpp \
+        sceneitem.cpp \
+        syntaxlexer.cpp \
         textdocument.cpp \
-        theme.cpp
+        textformat.cpp \
+        theme.cpp \
+        trigramindex.cpp \
+        workspacesearch.cpp
 
 resources.files = main.qml 
 resources.prefix = /$${TARGET}
@@ -25,11 +45,31 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    contenthash.h \
+    documenthighlighter.h \
+    documentloader.h \
+    documentsaver.h \
+    documentsearch.h \
+    editjournal.h \
+    editorview.h \
     filemanager.h \
     filetreemodel.h \
-    syntaxhighlighter.h \
+    glyphatlas.h \
+    languagecache.h \
+    linediff.h \
+    linenumbergutter.h \
+    mappedlineindexer.h \
+    mappedtextbuffer.h \
+    minimap.h \
+    piecetable.h \
+    quickopenmodel.h \
+    sceneitem.h \
+    syntaxlexer.h \
     textdocument.h \
-    theme.h
+    textformat.h \
+    theme.h \
+    trigramindex.h \
+    workspacesearch.h
 
 DISTFILES += \
     README.md
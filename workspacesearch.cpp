@@ -0,0 +1,561 @@
+#include "workspacesearch.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSet>
+#include <QStringList>
+#include <QtAlgorithms>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WORKSPACESEARCH_SSE2
+#endif
+
+// Files handed to a scan task at once; small so scanning starts right away
+static const int FilesPerTask = 16;
+// Bytes looked at for a NUL to tell binary files apart
+static const qint64 BinaryCheckSize = 8 * 1024;
+// Matches reported per file, the rest of a file is skipped
+static const int MaxMatchesPerFile = 1000;
+// Bytes of a long line kept before a match and in all of its preview
+static const int PreviewContext = 40;
+static const int PreviewLength = 200;
+
+// Shared state of one search, owned by the model and every task of it
+class WorkspaceSearchJob
+{
+public:
+    WorkspaceSearchJob(WorkspaceSearch *model, int generation, const QString &rootPath,
+                       const QByteArray &pattern, bool caseSensitive)
+        : model(model)
+        , generation(generation)
+        , rootPath(rootPath)
+        , pattern(pattern)
+        , caseSensitive(caseSensitive)
+        , cancelled(0)
+        , pendingTasks(0)
+        , matchBudget(WorkspaceSearch::MaxMatches)
+    {
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled.loadRelaxed() != 0;
+    }
+
+    void startTask(QThreadPool *pool, QRunnable *task)
+    {
+        pendingTasks.ref();
+        pool->start(task);
+    }
+
+    // The last task to finish reports the end of the search
+    void finishTask()
+    {
+        if (!pendingTasks.deref()) {
+            // The budget only goes negative once a match was dropped
+            const bool truncated = matchBudget.loadRelaxed() < 0;
+            WorkspaceSearch *target = model;
+            const int searchGeneration = generation;
+            QMetaObject::invokeMethod(model, [target, searchGeneration, truncated]() {
+                target->finishSearch(searchGeneration, truncated);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    void report(const QVector<WorkspaceMatch> &matches)
+    {
+        WorkspaceSearch *target = model;
+        const int searchGeneration = generation;
+        QMetaObject::invokeMethod(model, [target, searchGeneration, matches]() {
+            target->addMatches(searchGeneration, matches);
+        }, Qt::QueuedConnection);
+    }
+
+    WorkspaceSearch *model;
+    const int generation;
+    const QString rootPath;
+    const QByteArray pattern;
+    const bool caseSensitive;
+    QAtomicInt cancelled;
+    QAtomicInt pendingTasks;
+    QAtomicInt matchBudget;
+};
+
+// Start of the UTF-8 sequence that position is in
+static const char *sequenceStart(const char *position, const char *begin)
+{
+    while (position > begin && (uchar(*position) & 0xc0) == 0x80) {
+        --position;
+    }
+    return position;
+}
+
+static int utf16Length(const char *begin, const char *end)
+{
+    return QString::fromUtf8(begin, int(end - begin)).length();
+}
+
+// Scans a batch of files and reports the matches of each file at once
+class WorkspaceScanTask : public QRunnable
+{
+public:
+    WorkspaceScanTask(const QSharedPointer<WorkspaceSearchJob> &job, const QStringList &filePaths)
+        : m_job(job)
+        , m_filePaths(filePaths)
+    {
+    }
+
+    void run() override
+    {
+        for (const QString &filePath : m_filePaths) {
+            if (m_job->isCancelled()) {
+                break;
+            }
+            scanFile(filePath);
+        }
+        m_job->finishTask();
+    }
+
+private:
+    void scanFile(const QString &filePath)
+    {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+
+        const qint64 size = file.size();
+        if (size < m_job->pattern.size()) {
+            return;
+        }
+
+        uchar *mapped = file.map(0, size);
+        if (!mapped) {
+            return;
+        }
+#ifdef Q_OS_UNIX
+        madvise(mapped, size_t(size), MADV_SEQUENTIAL);
+#endif
+
+        const char *data = reinterpret_cast<const char *>(mapped);
+        const char *end = data + size;
+
+        // Text files have no NUL bytes, and UTF-16 files are not searched
+        if (!std::memchr(data, 0, size_t(qMin(size, BinaryCheckSize)))) {
+            scanData(filePath, data, end);
+        }
+
+        file.unmap(mapped);
+    }
+
+    void scanData(const QString &filePath, const char *data, const char *end)
+    {
+        const QByteArray &pattern = m_job->pattern;
+        QVector<WorkspaceMatch> matches;
+
+        // Lines are counted incrementally from the previous match
+        const char *counted = data;
+        int line = 0;
+
+        const char *position = data;
+        while ((position = WorkspaceSearch::findBytes(position, end, pattern, m_job->caseSensitive))) {
+            if (matches.size() >= MaxMatchesPerFile || m_job->isCancelled()) {
+                break;
+            }
+            if (m_job->matchBudget.fetchAndSubRelaxed(1) <= 0) {
+                m_job->cancelled.storeRelaxed(1);
+                break;
+            }
+
+            for (const char *lineBreak = counted;
+                 (lineBreak = static_cast<const char *>(std::memchr(lineBreak, '\n', size_t(position - lineBreak))));
+                 ++lineBreak) {
+                ++line;
+                counted = lineBreak + 1;
+            }
+            const char *lineStart = counted;
+            const char *lineEnd = static_cast<const char *>(std::memchr(position, '\n', size_t(end - position)));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            if (lineEnd > lineStart && lineEnd[-1] == '\r') {
+                --lineEnd;
+            }
+
+            const char *matchEnd = position + pattern.size();
+            WorkspaceMatch match;
+            match.filePath = filePath;
+            match.line = line;
+            match.column = utf16Length(lineStart, position);
+            match.length = utf16Length(position, matchEnd);
+
+            // Leading indentation is left out of the preview, long lines
+            // are cut around the match
+            const char *previewStart = lineStart;
+            while (previewStart < position && (*previewStart == ' ' || *previewStart == '\t')) {
+                ++previewStart;
+            }
+            if (position - previewStart > PreviewContext) {
+                previewStart = sequenceStart(position - PreviewContext, previewStart);
+            }
+            const char *previewEnd = lineEnd;
+            if (previewEnd - previewStart > PreviewLength && matchEnd <= previewStart + PreviewLength) {
+                previewEnd = sequenceStart(previewStart + PreviewLength, previewStart);
+            }
+            match.preview = QString::fromUtf8(previewStart, int(qMax(previewEnd, matchEnd) - previewStart));
+            match.previewStart = utf16Length(previewStart, position);
+            matches.append(match);
+
+            position = matchEnd;
+        }
+
+        if (!matches.isEmpty()) {
+            m_job->report(matches);
+        }
+    }
+
+    QSharedPointer<WorkspaceSearchJob> m_job;
+    QStringList m_filePaths;
+};
+
+// Walks the tree and starts a scan task for every few files found. With
+// the stamps of an index, only files the index does not know as they are
+// now are scanned, and none of those already scanned as its candidates.
+class WorkspaceWalkTask : public QRunnable
+{
+public:
+    WorkspaceWalkTask(const QSharedPointer<WorkspaceSearchJob> &job, QThreadPool *pool,
+                      const QSharedPointer<const TrigramIndex::FileStamps> &indexed = {},
+                      const QSet<QString> &candidates = QSet<QString>())
+        : m_job(job)
+        , m_pool(pool)
+        , m_indexed(indexed)
+        , m_candidates(candidates)
+    {
+    }
+
+    void run() override
+    {
+        // Hidden entries are skipped by leaving out QDir::Hidden
+        const QDir root(m_job->rootPath);
+        QDirIterator it(m_job->rootPath, QDir::Files | QDir::Readable | QDir::NoSymLinks,
+                        QDirIterator::Subdirectories);
+        QStringList batch;
+        while (it.hasNext() && !m_job->isCancelled()) {
+            const QString filePath = it.next();
+            if (m_indexed && !isChanged(root, filePath, it.fileInfo())) {
+                continue;
+            }
+            batch.append(filePath);
+            if (batch.size() >= FilesPerTask) {
+                m_job->startTask(m_pool, new WorkspaceScanTask(m_job, batch));
+                batch.clear();
+            }
+        }
+
+        if (!batch.isEmpty() && !m_job->isCancelled()) {
+            m_job->startTask(m_pool, new WorkspaceScanTask(m_job, batch));
+        }
+        m_job->finishTask();
+    }
+
+private:
+    // Added or modified since the index was built, like its builder tells
+    bool isChanged(const QDir &root, const QString &filePath, const QFileInfo &info) const
+    {
+        if (m_candidates.contains(filePath)) {
+            return false;
+        }
+        const auto found = m_indexed->constFind(root.relativeFilePath(filePath));
+        return found == m_indexed->constEnd() || found->modified != info.lastModified().toMSecsSinceEpoch()
+               || found->size != info.size();
+    }
+
+    QSharedPointer<WorkspaceSearchJob> m_job;
+    QThreadPool *m_pool;
+    QSharedPointer<const TrigramIndex::FileStamps> m_indexed;
+    QSet<QString> m_candidates;
+};
+
+WorkspaceSearch::WorkspaceSearch(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_generation(0)
+    , m_searching(false)
+    , m_truncated(false)
+    , m_fileCount(0)
+{
+}
+
+WorkspaceSearch::~WorkspaceSearch()
+{
+    // Tasks point back at this model
+    cancel();
+    m_pool.waitForDone();
+}
+
+QString WorkspaceSearch::rootPath() const
+{
+    return m_rootPath;
+}
+
+void WorkspaceSearch::setRootPath(const QString &path)
+{
+    if (m_rootPath == path) {
+        return;
+    }
+
+    clear();
+    m_rootPath = path;
+    m_index.setRootPath(path);
+    emit rootPathChanged();
+}
+
+bool WorkspaceSearch::isSearching() const
+{
+    return m_searching;
+}
+
+int WorkspaceSearch::matchCount() const
+{
+    return m_matches.size();
+}
+
+int WorkspaceSearch::fileCount() const
+{
+    return m_fileCount;
+}
+
+bool WorkspaceSearch::isTruncated() const
+{
+    return m_truncated;
+}
+
+void WorkspaceSearch::search(const QString &pattern, bool caseSensitive)
+{
+    clear();
+
+    if (pattern.isEmpty() || m_rootPath.isEmpty() || !QFileInfo(m_rootPath).isDir()) {
+        return;
+    }
+
+    const QByteArray utf8 = pattern.toUtf8();
+    m_job = QSharedPointer<WorkspaceSearchJob>::create(this, m_generation, m_rootPath, utf8, caseSensitive);
+    setSearching(true);
+
+    bool narrowed = false;
+    const QStringList candidates = m_index.candidates(utf8, narrowed);
+    const QSharedPointer<const TrigramIndex::FileStamps> stamps = m_index.fileStamps();
+    if (narrowed && stamps) {
+        // Held while the candidates are handed out, so an empty list still
+        // finishes the search
+        m_job->pendingTasks.ref();
+        for (int i = 0; i < candidates.size(); i += FilesPerTask) {
+            m_job->startTask(&m_pool, new WorkspaceScanTask(m_job, candidates.mid(i, FilesPerTask)));
+        }
+        // Files saved or added since the index was built are not among the
+        // candidates; the tree is walked for them meanwhile
+        const QSet<QString> scanned(candidates.constBegin(), candidates.constEnd());
+        m_job->startTask(&m_pool, new WorkspaceWalkTask(m_job, &m_pool, stamps, scanned));
+        m_job->finishTask();
+    } else {
+        m_job->startTask(&m_pool, new WorkspaceWalkTask(m_job, &m_pool));
+    }
+
+    // Picks up files changed since the index was written
+    m_index.update(IndexUpdateInterval);
+}
+
+void WorkspaceSearch::cancel()
+{
+    if (m_job) {
+        m_job->cancelled.storeRelaxed(1);
+        m_job.clear();
+    }
+    // Whatever is still queued for the cancelled search is dropped
+    ++m_generation;
+    setSearching(false);
+}
+
+void WorkspaceSearch::clear()
+{
+    cancel();
+
+    beginResetModel();
+    m_matches.clear();
+    m_fileCount = 0;
+    m_truncated = false;
+    endResetModel();
+    emit matchCountChanged();
+}
+
+void WorkspaceSearch::addMatches(int generation, const QVector<WorkspaceMatch> &matches)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_matches.size(), m_matches.size() + matches.size() - 1);
+    m_matches += matches;
+    ++m_fileCount;
+    endInsertRows();
+    emit matchCountChanged();
+}
+
+void WorkspaceSearch::finishSearch(int generation, bool truncated)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    m_job.clear();
+    if (truncated) {
+        m_truncated = true;
+        emit matchCountChanged();
+    }
+    setSearching(false);
+}
+
+void WorkspaceSearch::setSearching(bool searching)
+{
+    if (m_searching != searching) {
+        m_searching = searching;
+        emit searchingChanged();
+    }
+}
+
+int WorkspaceSearch::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_matches.size();
+}
+
+QVariant WorkspaceSearch::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_matches.size()) {
+        return QVariant();
+    }
+
+    const WorkspaceMatch &match = m_matches.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case PreviewRole:
+        return match.preview;
+    case FilePathRole:
+        return match.filePath;
+    case FileNameRole:
+        return QFileInfo(match.filePath).fileName();
+    case RelativePathRole:
+        return QDir(m_rootPath).relativeFilePath(match.filePath);
+    case LineRole:
+        return match.line;
+    case ColumnRole:
+        return match.column;
+    case LengthRole:
+        return match.length;
+    case PreviewStartRole:
+        return match.previewStart;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> WorkspaceSearch::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[FilePathRole] = "filePath";
+    roles[FileNameRole] = "fileName";
+    roles[RelativePathRole] = "relativePath";
+    roles[LineRole] = "line";
+    roles[ColumnRole] = "column";
+    roles[LengthRole] = "matchLength";
+    roles[PreviewRole] = "preview";
+    roles[PreviewStartRole] = "previewStart";
+    return roles;
+}
+
+// Folds ASCII letters, the only case folding done on raw bytes
+static inline uchar foldBit(uchar byte)
+{
+    return ((byte | 0x20) >= 'a' && (byte | 0x20) <= 'z') ? 0x20 : 0;
+}
+
+static inline bool matchesAt(const char *data, const QByteArray &pattern, bool caseSensitive)
+{
+    if (caseSensitive) {
+        return std::memcmp(data, pattern.constData(), size_t(pattern.size())) == 0;
+    }
+
+    for (int i = 0; i < pattern.size(); ++i) {
+        const uchar byte = uchar(data[i]);
+        const uchar expected = uchar(pattern.at(i));
+        const uchar fold = foldBit(expected);
+        if ((byte | fold) != (expected | fold)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *WorkspaceSearch::findBytes(const char *data, const char *end, const QByteArray &pattern,
+                                       bool caseSensitive)
+{
+    const qint64 patternLength = pattern.size();
+    if (patternLength == 0 || end - data < patternLength) {
+        return nullptr;
+    }
+
+    const uchar first = uchar(pattern.at(0));
+    const uchar last = uchar(pattern.at(int(patternLength - 1)));
+    const uchar firstFold = caseSensitive ? 0 : foldBit(first);
+    const uchar lastFold = caseSensitive ? 0 : foldBit(last);
+    const uchar firstValue = first | firstFold;
+    const uchar lastValue = last | lastFold;
+    const char *lastStart = end - patternLength;
+    const char *position = data;
+
+#ifdef WORKSPACESEARCH_SSE2
+    // Candidates have both the first and the last byte in place
+    const __m128i firstMask = _mm_set1_epi8(char(firstFold));
+    const __m128i lastMask = _mm_set1_epi8(char(lastFold));
+    const __m128i firstVector = _mm_set1_epi8(char(firstValue));
+    const __m128i lastVector = _mm_set1_epi8(char(lastValue));
+
+    while (position + 16 <= lastStart + 1) {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position + patternLength - 1));
+        const __m128i both = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(head, firstMask), firstVector),
+                                           _mm_cmpeq_epi8(_mm_or_si128(tail, lastMask), lastVector));
+
+        quint32 candidates = quint32(_mm_movemask_epi8(both));
+        while (candidates) {
+            const char *candidate = position + qCountTrailingZeroBits(candidates);
+            if (matchesAt(candidate, pattern, caseSensitive)) {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+        position += 16;
+    }
+#endif
+
+    for (; position <= lastStart; ++position) {
+        if ((uchar(position[0]) | firstFold) == firstValue
+            && (uchar(position[patternLength - 1]) | lastFold) == lastValue
+            && matchesAt(position, pattern, caseSensitive)) {
+            return position;
+        }
+    }
+
+    return nullptr;
+}
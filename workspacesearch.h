@@ -0,0 +1,115 @@
+#ifndef WORKSPACESEARCH_H
+#define WORKSPACESEARCH_H
+
+#include <QAbstractListModel>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "trigramindex.h"
+
+class WorkspaceSearchJob;
+
+// A match found by a workspace search
+struct WorkspaceMatch
+{
+    QString filePath;
+    // Zero-based line, column and length in UTF-16 code units
+    int line;
+    int column;
+    int length;
+    // The matching line, shortened around the match if it is long
+    QString preview;
+    int previewStart;
+};
+
+// Searches every file below a root folder for a literal pattern.
+//
+// Once the trigram index of the folder is ready, only the files it lists as
+// candidates are scanned, along with those added to the tree or whose
+// modification time or size changed since the index was built. Otherwise
+// one task walks the tree and hands out files in small batches to the other
+// threads of a private pool as soon as they are found, so the first results
+// show up before the walk is done.
+// Files are mapped instead of read, binary files (a NUL byte near the start)
+// are skipped, and candidates are found 16 bytes at a time by comparing the
+// first and last byte of the UTF-8 encoded pattern. Case-insensitive searches
+// fold ASCII letters only; hidden files and folders and symbolic links are
+// not followed.
+//
+// Matches stream into the model through queued calls. Every search gets a
+// new generation, and results of an earlier one are dropped, so changing the
+// query never shows stale rows.
+class WorkspaceSearch : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString rootPath READ rootPath WRITE setRootPath NOTIFY rootPathChanged)
+    Q_PROPERTY(bool searching READ isSearching NOTIFY searchingChanged)
+    Q_PROPERTY(int matchCount READ matchCount NOTIFY matchCountChanged)
+    Q_PROPERTY(int fileCount READ fileCount NOTIFY matchCountChanged)
+    Q_PROPERTY(bool truncated READ isTruncated NOTIFY matchCountChanged)
+
+public:
+    enum Roles {
+        FilePathRole = Qt::UserRole + 1,
+        FileNameRole,
+        RelativePathRole,
+        LineRole,
+        ColumnRole,
+        LengthRole,
+        PreviewRole,
+        PreviewStartRole
+    };
+
+    explicit WorkspaceSearch(QObject *parent = nullptr);
+    ~WorkspaceSearch();
+
+    QString rootPath() const;
+    void setRootPath(const QString &path);
+    bool isSearching() const;
+    int matchCount() const;
+    int fileCount() const;
+    bool isTruncated() const;
+
+    // Starts a new search, cancelling the running one
+    Q_INVOKABLE void search(const QString &pattern, bool caseSensitive);
+    Q_INVOKABLE void cancel();
+    Q_INVOKABLE void clear();
+
+    // QAbstractListModel implementation
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Position of the next match of an UTF-8 pattern in data, or nullptr
+    static const char *findBytes(const char *data, const char *end, const QByteArray &pattern, bool caseSensitive);
+
+signals:
+    void rootPathChanged();
+    void searchingChanged();
+    void matchCountChanged();
+
+private:
+    friend class WorkspaceSearchJob;
+
+    // Results are dropped after this many matches
+    static const int MaxMatches = 20000;
+    // Searches refresh the index at most this often, in milliseconds
+    static const int IndexUpdateInterval = 30 * 1000;
+
+    void addMatches(int generation, const QVector<WorkspaceMatch> &matches);
+    void finishSearch(int generation, bool truncated);
+    void setSearching(bool searching);
+
+    QString m_rootPath;
+    QThreadPool m_pool;
+    TrigramIndex m_index;
+    QSharedPointer<WorkspaceSearchJob> m_job;
+    int m_generation;
+    bool m_searching;
+    bool m_truncated;
+    QVector<WorkspaceMatch> m_matches;
+    int m_fileCount;
+};
+
+#endif // WORKSPACESEARCH_H